@@ -0,0 +1,65 @@
+#pragma once
+
+// What every benchmark that runs CanRed's own code sets up first, so it
+// can't touch a real database, and CanRed's output doesn't bury the results.
+
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+namespace Bench {
+
+inline char* working_directory()
+{
+    static char directory[PATH_MAX] = {};
+    return directory;
+}
+
+inline void remove_working_directory()
+{
+    const auto remove_entry = [](const char* path, const struct stat*, int, struct FTW*) { return remove(path); };
+    nftw(working_directory(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Gives the benchmark its own temporary directory, with its own .env and database,
+// and makes it the working directory. It's removed when the benchmark exits.
+// Call it before anything opens the database, so the database is closed by then.
+inline void setup_working_directory(const char* name)
+{
+    char* directory = working_directory();
+    snprintf(directory, PATH_MAX, "/tmp/%s.XXXXXX", name);
+
+    if (!mkdtemp(directory)) {
+        fmt::print(stderr, "Failed to create a temporary directory!\n");
+        exit(1);
+    }
+
+    // Exit handlers run in the reverse order they were registered, along with the
+    // destructors of statics, so this runs after Database::the() is destroyed.
+    atexit(remove_working_directory);
+
+    std::ofstream(std::string(directory) + "/.env") << "dbFile=" << directory << "/bench.db\nuserDir=" << directory << "\n";
+
+    if (chdir(directory) != 0) {
+        fmt::print(stderr, "Failed to chdir into {}!\n", directory);
+        exit(1);
+    }
+}
+
+// Everything CanRed prints goes to stdout, results go to stderr.
+inline void silence_stdout()
+{
+    fflush(stdout);
+    int32_t null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+}
+
+} // namespace Bench
@@ -0,0 +1,459 @@
+// End to end benchmark of CanRed's frame handling, built from the real
+// CanManager, LongFrameHandler, ACKHandler and SerialInterface framing.
+// Synthetic module traffic is pushed either straight into CanManager
+// (memory), or serialized through a pty and read back by a SerialInterface
+// (pty), which is what the USB-serial bridge looks like to CanRed.
+
+// Scenarios:
+// - check_in:      Every module CHECK_IN's at once, CanRed asks each one for its config.
+// - reply_command: Modules answer a flood of socket requests with REPLY_COMMAND.
+// - config_upload: Every module uploads its JSON config, as long frames.
+// - descriptor_upload: The same config, as a binary ModuleDescriptor.
+
+// For every scenario we report frames/s, the p50/p99 latency from a frame
+// arriving, to CanManager being done with it, the CPU time per frame
+// of the thread doing the dispatching, and heap allocations per frame.
+
+// The benchmark runs in its own temporary directory, with its own database,
+// and everything CanRed prints is sent to /dev/null.
+
+// Usage: canred_bench [--frames <count>] [--modules <count>] [--batch <size>] [--transport <memory | pty | both>]
+
+#include "bench_environment.h"
+
+#include <CanManager.h>
+#include <CanSerializer.h>
+#include <SerialCommon.h>
+#include <SerialInterface.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <new>
+#include <get_monotonic_time_ns.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Counts every heap allocation, so we can see how many handling a frame takes.
+static std::atomic<uint64_t> heap_allocations { 0 };
+
+void* operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* pointer = malloc(size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+namespace {
+
+// Where results go, since stdout is sent to /dev/null.
+FILE* output = stderr;
+
+struct Options {
+    size_t frame_count { 20000 };
+    size_t module_count { 50 };
+    size_t batch_size { 64 };
+    bool use_memory { true };
+    bool use_pty { true };
+};
+
+struct Scenario {
+    std::string name;
+    std::vector<CAN::Frame> frames;
+    // Socket requests CanRed is waiting on, before the first frame arrives.
+    std::vector<SocketRequest> socket_requests;
+};
+
+uint16_t module_uid(size_t index)
+{
+    return 10 + index;
+}
+
+// Splits buffer into long frames, the same way modules do.
+void append_long_frames(std::vector<CAN::Frame>& frames, uint16_t from_id, uint8_t group_uid, const std::vector<uint8_t>& buffer)
+{
+    CAN::ID id(from_id, CAN::UID::MCM, CAN::Priority::NORMAL, CAN::FrameFormat::Long);
+
+    size_t bytes_sent = 0;
+    while (bytes_sent < buffer.size()) {
+        const uint8_t bytes_to_send = std::min<size_t>(7, buffer.size() - bytes_sent);
+
+        CAN::Frame frame(id, nullptr, bytes_to_send + 1);
+        frame.data[0] = group_uid;
+        memcpy(&frame.data[1], &buffer[bytes_sent], bytes_to_send);
+        frames.push_back(frame);
+
+        bytes_sent += bytes_to_send;
+    }
+
+    // A group ends with a frame that isn't full.
+    if (frames.back().can_dlc == 8) {
+        CAN::Frame frame(id, nullptr, 1);
+        frame.data[0] = group_uid;
+        frames.push_back(frame);
+    }
+}
+
+Scenario create_check_in_storm(const Options& options)
+{
+    Scenario scenario;
+    scenario.name = "check_in";
+
+    uint8_t data[1] = { CAN::Protocol::CHECK_IN };
+    for (size_t i = 0; i < options.frame_count; i += 1) {
+        scenario.frames.push_back(CAN::Frame(CAN::ID(module_uid(i % options.module_count), CAN::UID::MCM), data, 1));
+    }
+    return scenario;
+}
+
+Scenario create_reply_command_flood(const Options& options, int32_t reply_socket)
+{
+    Scenario scenario;
+    scenario.name = "reply_command";
+
+    uint8_t data[4] = { CAN::Protocol::REPLY_COMMAND, 1, CAN::Primitive::BOOL_1_BYTES, 1 };
+    for (size_t i = 0; i < options.frame_count; i += 1) {
+        const uint16_t from_id = module_uid(i % options.module_count);
+        data[1] = 1 + (i % 4);
+
+        scenario.frames.push_back(CAN::Frame(CAN::ID(from_id, CAN::UID::MCM), data, 4));
+
+        SocketRequest request;
+        request.module_name = fmt::format("Module {}", from_id);
+        request.module_function = fmt::format("Command {}", data[1]);
+        request.module_uid = from_id;
+        request.command_uid = data[1];
+        request.file_descriptor = reply_socket;
+        scenario.socket_requests.push_back(request);
+    }
+    return scenario;
+}
+
+Scenario create_config_upload(const Options& options)
+{
+    Scenario scenario;
+    scenario.name = "config_upload";
+
+    for (size_t i = 0; scenario.frames.size() < options.frame_count; i += 1) {
+        const uint16_t from_id = module_uid(i % options.module_count);
+
+        std::string config = fmt::format(R"({{"Name": "Module {}", "Type": "WRITER", "Description": "A module uploading its config", "Commands": [)", from_id);
+        for (size_t command = 1; command <= 4; command += 1) {
+            config += fmt::format(R"({}{{"CommandName": "Command {}", "CommandID": {}, "ReturnFormat": "-"}})", command > 1 ? ", " : "", command, command);
+        }
+        config += "]}";
+
+        std::vector<uint8_t> buffer;
+        buffer.push_back(CAN::Protocol::REPLY_UPDATE_INFO);
+        buffer.insert(buffer.end(), config.begin(), config.end());
+
+        append_long_frames(scenario.frames, from_id, i % 255, buffer);
+    }
+    return scenario;
+}
+
+Scenario create_descriptor_upload(const Options& options)
+{
+    Scenario scenario;
+    scenario.name = "descriptor_upload";
+
+    static constexpr auto descriptor = ModuleDescriptor::module(ModuleDescriptor::TypeFlags::WRITER, "Module", "A module uploading its config",
+        ModuleDescriptor::command(1, CAN::Primitive::VOID, "Command 1"),
+        ModuleDescriptor::command(2, CAN::Primitive::VOID, "Command 2"),
+        ModuleDescriptor::command(3, CAN::Primitive::VOID, "Command 3"),
+        ModuleDescriptor::command(4, CAN::Primitive::VOID, "Command 4"));
+
+    std::vector<uint8_t> buffer;
+    buffer.push_back(CAN::Protocol::REPLY_UPDATE_INFO_BINARY);
+    buffer.insert(buffer.end(), descriptor.data, &descriptor.data[descriptor.size()]);
+
+    for (size_t i = 0; scenario.frames.size() < options.frame_count; i += 1) {
+        append_long_frames(scenario.frames, module_uid(i % options.module_count), i % 255, buffer);
+    }
+    return scenario;
+}
+
+// Records nothing, sends nowhere.
+class NullInterface : public AutomatoInterface {
+public:
+    bool read_frame(CAN::Frame*) override { return false; }
+    bool send_frame(const CAN::Frame&) override { return true; }
+    size_t send_frames(const CAN::Frame[], size_t frame_count) override { return frame_count; }
+};
+
+uint64_t thread_cpu_time_ns()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+}
+
+struct Result {
+    size_t frames { 0 };
+    double seconds { 0 };
+    uint64_t cpu_ns { 0 };
+    uint64_t allocations { 0 };
+    std::vector<uint64_t> latencies_ns;
+};
+
+void print_result(const char* transport, const Scenario& scenario, Result& result)
+{
+    std::sort(result.latencies_ns.begin(), result.latencies_ns.end());
+
+    const auto percentile = [&](double p) {
+        if (result.latencies_ns.empty()) {
+            return 0.0;
+        }
+        const size_t index = std::min(result.latencies_ns.size() - 1, static_cast<size_t>(p * result.latencies_ns.size()));
+        return result.latencies_ns[index] / 1000.0;
+    };
+
+    fmt::print(output, "{:>6} {:>13}: {:>10.0f} frames/s | p50 {:>8.1f}us | p99 {:>8.1f}us | {:>6.0f}ns CPU/frame | {:>5.2f} allocs/frame | {} frames\n",
+        transport,
+        scenario.name,
+        result.frames / result.seconds,
+        percentile(0.50),
+        percentile(0.99),
+        static_cast<double>(result.cpu_ns) / result.frames,
+        static_cast<double>(result.allocations) / result.frames,
+        result.frames);
+}
+
+// Where CanManager spent its time, per protocol handler.
+void print_protocol_handler_stats(const CanManager& manager)
+{
+    for (const auto& handler : manager.protocol_handler_stats()) {
+        if (handler.invocations == 0) {
+            continue;
+        }
+
+        fmt::print(output, "{:>22}: {:>8} calls, {:>8.0f}ns avg, {:>8.1f}us max\n",
+            handler.name,
+            handler.invocations,
+            static_cast<double>(handler.total_ns) / handler.invocations,
+            handler.max_ns / 1000.0);
+    }
+}
+
+void add_socket_requests(CanManager& manager, const Scenario& scenario)
+{
+    for (const auto& request : scenario.socket_requests) {
+        manager.send_socket_request(request);
+    }
+}
+
+void run_memory(const Options& options, const Scenario& scenario)
+{
+    NullInterface interface;
+    std::vector<AutomatoInterface*> interfaces { &interface };
+    ModuleRegistry module_registry;
+    SocketRequestTable socket_requests;
+    CanManager manager(interfaces, module_registry, socket_requests);
+
+    add_socket_requests(manager, scenario);
+
+    Result result;
+    result.frames = scenario.frames.size();
+    result.latencies_ns.reserve(result.frames);
+
+    const uint64_t allocations_start = heap_allocations.load();
+    const uint64_t cpu_start = thread_cpu_time_ns();
+    const uint64_t start = get_monotonic_time_ns();
+
+    // Every frame in a batch "arrives" at the start of its batch.
+    for (size_t i = 0; i < scenario.frames.size(); i += options.batch_size) {
+        const size_t batch_size = std::min(options.batch_size, scenario.frames.size() - i);
+
+        const uint64_t batch_start = get_monotonic_time_ns();
+        manager.handle_incoming_frames(&scenario.frames[i], batch_size);
+        const uint64_t batch_end = get_monotonic_time_ns();
+
+        result.latencies_ns.insert(result.latencies_ns.end(), batch_size, batch_end - batch_start);
+    }
+
+    result.seconds = (get_monotonic_time_ns() - start) / 1e9;
+    result.cpu_ns = thread_cpu_time_ns() - cpu_start;
+    result.allocations = heap_allocations.load() - allocations_start;
+
+    print_result("memory", scenario, result);
+    print_protocol_handler_stats(manager);
+}
+
+Result run_pty(const Scenario& scenario)
+{
+    int32_t master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd == -1 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        fmt::print(output, "Failed to create a pty pair!\n");
+        exit(1);
+    }
+
+    SerialInterface interface(ptsname(master_fd));
+    std::vector<AutomatoInterface*> interfaces { &interface };
+    ModuleRegistry module_registry;
+    SocketRequestTable socket_requests;
+    CanManager manager(interfaces, module_registry, socket_requests);
+
+    // When each frame was written to the pty.
+    std::vector<uint64_t> written_at(scenario.frames.size(), 0);
+    std::atomic<size_t> frames_written { 0 };
+
+    std::atomic<bool> is_done { false };
+
+    // Whatever CanRed sends back has to be read, or the pty fills up.
+    // close() won't wake up a blocked read(), so we poll for is_done.
+    auto drain = std::thread([&]() {
+        uint8_t buffer[4096];
+        pollfd poll_fd { master_fd, POLLIN, 0 };
+        while (!is_done) {
+            if (poll(&poll_fd, 1, 100) > 0 && read(master_fd, buffer, sizeof(buffer)) <= 0) {
+                return;
+            }
+        }
+    });
+
+    // Sending the requests' COMMAND's needs the drain running.
+    add_socket_requests(manager, scenario);
+
+    auto writer = std::thread([&]() {
+        uint8_t buffer[CAN::Frame::MAX_SERIALIZED_SIZE + 2];
+        buffer[0] = SERIAL_MESSAGE_START_BYTE;
+
+        for (size_t i = 0; i < scenario.frames.size(); i += 1) {
+            const uint8_t bytes_used = CAN::serialize_frame(scenario.frames[i], &buffer[1]);
+            buffer[1 + bytes_used] = SERIAL_MESSAGE_STOP_BYTE;
+
+            written_at[i] = get_monotonic_time_ns();
+            frames_written.store(i + 1, std::memory_order_release);
+
+            if (write(master_fd, buffer, bytes_used + 2) == -1) {
+                fmt::print(output, "Failed to write to the pty!\n");
+                return;
+            }
+        }
+    });
+
+    Result result;
+    result.frames = scenario.frames.size();
+    result.latencies_ns.reserve(result.frames);
+
+    std::vector<CAN::Frame> frames;
+    frames.reserve(1024);
+    size_t frames_handled = 0;
+
+    const uint64_t allocations_start = heap_allocations.load();
+    const uint64_t cpu_start = thread_cpu_time_ns();
+    const uint64_t start = get_monotonic_time_ns();
+
+    while (frames_handled < scenario.frames.size()) {
+        frames.clear();
+        interface.read_frames(frames);
+
+        manager.handle_incoming_frames(frames.data(), frames.size());
+        const uint64_t handled_at = get_monotonic_time_ns();
+
+        // The pty keeps frames in order, so the n'th frame we read is the n'th written.
+        // Pairs with the writer's release, so written_at is up to date.
+        frames_written.load(std::memory_order_acquire);
+        for (size_t i = 0; i < frames.size(); i += 1) {
+            result.latencies_ns.push_back(handled_at - written_at[frames_handled + i]);
+        }
+        frames_handled += frames.size();
+    }
+
+    result.seconds = (get_monotonic_time_ns() - start) / 1e9;
+    result.cpu_ns = thread_cpu_time_ns() - cpu_start;
+    result.allocations = heap_allocations.load() - allocations_start;
+
+    writer.join();
+    is_done = true;
+    drain.join();
+    close(master_fd);
+
+    return result;
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i += 1) {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--frames") == 0 && has_value) {
+            options.frame_count = std::stoul(argv[++i]);
+        } else if (strcmp(argv[i], "--modules") == 0 && has_value) {
+            options.module_count = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--batch") == 0 && has_value) {
+            options.batch_size = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--transport") == 0 && has_value) {
+            const std::string transport = argv[++i];
+            options.use_memory = (transport == "memory" || transport == "both");
+            options.use_pty = (transport == "pty" || transport == "both");
+        } else {
+            fmt::print(output, "Usage: canred_bench [--frames <count>] [--modules <count>] [--batch <size>] [--transport <memory | pty | both>]\n");
+            return 1;
+        }
+    }
+
+    Bench::setup_working_directory("canred_bench");
+    Bench::silence_stdout();
+
+    // REPLY_COMMAND's are answered over this socket.
+    int32_t reply_sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, reply_sockets) == -1) {
+        fmt::print(output, "Failed to create a socketpair!\n");
+        return 1;
+    }
+
+    std::atomic<bool> is_done { false };
+    auto reply_drain = std::thread([&]() {
+        char buffer[4096];
+        while (!is_done && read(reply_sockets[1], buffer, sizeof(buffer)) > 0) { }
+    });
+
+    std::vector<Scenario> scenarios;
+    scenarios.push_back(create_check_in_storm(options));
+    scenarios.push_back(create_reply_command_flood(options, reply_sockets[0]));
+    scenarios.push_back(create_config_upload(options));
+    scenarios.push_back(create_descriptor_upload(options));
+
+    fmt::print(output, "{} frames per scenario from {} modules, memory batches of {}\n", options.frame_count, options.module_count, options.batch_size);
+
+    for (const auto& scenario : scenarios) {
+        if (options.use_memory) {
+            run_memory(options, scenario);
+        }
+
+        if (options.use_pty) {
+            auto result = run_pty(scenario);
+            print_result("pty", scenario, result);
+        }
+    }
+
+    is_done = true;
+    shutdown(reply_sockets[0], SHUT_RDWR);
+    reply_drain.join();
+
+    return 0;
+}
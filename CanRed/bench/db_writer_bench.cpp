@@ -0,0 +1,118 @@
+// How long a thread is held up by writes to the database, and how many
+// times SQLite syncs to disk for them, with and without the DatabaseWriter.
+
+// A module command is written --writes times, in three ways:
+// - direct:    on the caller, through Database::the(), like writes used to be,
+//              every write is its own transaction.
+// - queued:    through DatabaseWriter::write(), the caller only queues them.
+// - completed: through DatabaseWriter::write_with_completion(), and the
+//              caller waits on every one, which is the worst case for latency.
+
+// Syncs are counted the same way as flow_deploy_bench. The benchmark runs in
+// its own temporary directory, with its own database, and everything CanRed
+// prints is sent to /dev/null.
+
+// Usage: db_writer_bench [--writes <count>]
+
+#include "bench_environment.h"
+
+#include <Database.h>
+#include <DatabaseWriter.h>
+#include <TypedQuery.h>
+#include <atomic>
+#include <chrono>
+#include <fmt/format.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Where results go, since stdout is sent to /dev/null.
+FILE* output = stderr;
+
+std::atomic<uint64_t> syncs { 0 };
+
+} // namespace
+
+extern "C" int fsync(int fd)
+{
+    syncs += 1;
+    return syscall(SYS_fsync, fd);
+}
+
+extern "C" int fdatasync(int fd)
+{
+    syncs += 1;
+    return syscall(SYS_fdatasync, fd);
+}
+
+namespace {
+
+struct Options {
+    size_t write_count { 2000 };
+};
+
+const TypedQuery<void, uint16_t, uint8_t, std::string, std::string> insert_command("INSERT INTO can_module_commands (module_uid, command_uid, name, return_format) VALUES (?, ?, ?, ?)");
+
+template<typename Write>
+void measure(const char* name, size_t write_count, Write write)
+{
+    const auto groups_start = DatabaseWriter::the().stats().groups;
+    const uint64_t syncs_start = syncs.load();
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < write_count; i += 1) {
+        write(i);
+    }
+
+    const double caller_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    DatabaseWriter::the().flush();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fmt::print(output, "{:>9}: {} writes, caller held for {:>8.3f}s ({:>7.1f}us/write) | written in {:>8.3f}s | {:>6} syncs | {:>5} groups\n",
+        name, write_count, caller_seconds, caller_seconds * 1000000 / write_count, seconds,
+        syncs.load() - syncs_start, DatabaseWriter::the().stats().groups - groups_start);
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i += 1) {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--writes") == 0 && has_value) {
+            options.write_count = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else {
+            fmt::print(output, "Usage: db_writer_bench [--writes <count>]\n");
+            return 1;
+        }
+    }
+
+    Bench::setup_working_directory("db_writer_bench");
+    Bench::silence_stdout();
+
+    // Opens both connections, and migrates the database, before anything is measured.
+    DatabaseWriter::the().flush();
+
+    measure("direct", options.write_count, [](size_t i) {
+        insert_command.run(1, i % 256, fmt::format("Direct {}", i), "-");
+    });
+
+    measure("queued", options.write_count, [](size_t i) {
+        DatabaseWriter::the().write(insert_command, 2, i % 256, fmt::format("Queued {}", i), "-");
+    });
+
+    measure("completed", options.write_count, [](size_t i) {
+        DatabaseWriter::the().write_with_completion(insert_command, 3, i % 256, fmt::format("Completed {}", i), "-").wait();
+    });
+
+    return 0;
+}
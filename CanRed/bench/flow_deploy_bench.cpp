@@ -0,0 +1,160 @@
+// How long CanRed takes to reconcile its database with a NodeRed deploy,
+// and how many times SQLite syncs to disk while doing it, which is what
+// makes a deploy slow on an SD card.
+
+// A parsed flows file with up to 255 flows (flow ids are a single byte,
+// and 0 means not stored) is written, and EventManager::read_changes()
+// is run against it three times:
+// - first:     every flow is new.
+// - unchanged: the same file again.
+// - changed:   every flow's commands are different.
+
+// unchanged should add and remove nothing, and changed should replace every
+// flow, removing the events of the old ones, and adding the new ones.
+
+// Syncs are counted by wrapping fsync() and fdatasync(), which is all SQLite
+// uses to sync. The benchmark runs in its own temporary directory, with its
+// own database, and everything CanRed prints is sent to /dev/null.
+
+// Usage: flow_deploy_bench [--flows <count>]
+
+#include "bench_environment.h"
+
+#include <EventManager.h>
+#include <ModuleRegistry.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fmt/format.h>
+#include <fstream>
+#include <json.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Where results go, since stdout is sent to /dev/null.
+FILE* output = stderr;
+
+std::atomic<uint64_t> syncs { 0 };
+
+} // namespace
+
+extern "C" int fsync(int fd)
+{
+    syncs += 1;
+    return syscall(SYS_fsync, fd);
+}
+
+extern "C" int fdatasync(int fd)
+{
+    syncs += 1;
+    return syscall(SYS_fdatasync, fd);
+}
+
+namespace {
+
+struct Options {
+    size_t flow_count { 200 };
+};
+
+// Every flow reads a sensor, and toggles a relay twice, the sensor's threshold
+// is different for every flow, so no two flows have the same main event.
+nlohmann::json create_flows(size_t flow_count, const char* command_name)
+{
+    auto flows = nlohmann::json::array();
+
+    for (size_t i = 0; i < flow_count; i += 1) {
+        auto flow = nlohmann::json::array();
+
+        flow.push_back({
+            { "flow_name", fmt::format("Flow {}", i) },
+            { "module_name", "Sensor" },
+            { "module_function", "Read" },
+            { "conditional", ">" },
+            { "value_to_check", std::to_string(i) },
+            { "interval", "5" },
+            { "interval_unit", "seconds" },
+            { "section_number", 0 },
+        });
+
+        for (uint8_t section = 1; section <= 2; section += 1) {
+            flow.push_back({
+                { "module_name", "Relay" },
+                { "module_function", command_name },
+                { "section_number", section },
+                { "next_section", section == 2 ? 0 : section + 1 },
+            });
+        }
+
+        flows.push_back(flow);
+    }
+
+    return flows;
+}
+
+void register_modules(ModuleRegistry& module_registry)
+{
+    module_registry.insert_or_update_module({ 1, "Sensor", "Reads things", ModuleType::Reader, true, true });
+    module_registry.insert_or_update_module({ 2, "Relay", "Toggles things", ModuleType::Writer, true, true });
+
+    module_registry.insert_or_update_module_command({ 1, 1, "Read", "int16" });
+    module_registry.insert_or_update_module_command({ 2, 1, "Toggle", "-" });
+    module_registry.insert_or_update_module_command({ 2, 2, "Flip", "-" });
+}
+
+void deploy(const char* name, const nlohmann::json& flows, const ModuleRegistry& module_registry)
+{
+    std::ofstream(EventManager::flows_file()) << flows.dump();
+
+    std::vector<EventUpdate> updates;
+
+    const uint64_t syncs_start = syncs.load();
+    const auto start = std::chrono::steady_clock::now();
+
+    EventManager::read_changes(updates, module_registry);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t adds = 0;
+    for (const auto& update : updates) {
+        adds += update.update_type == EventUpdateType::add;
+    }
+
+    fmt::print(output, "{:>9}: {} flows in {:>8.3f}s | {:>6} syncs | {:>5} events added, {:>5} removed\n",
+        name, flows.size(), seconds, syncs.load() - syncs_start, adds, updates.size() - adds);
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i += 1) {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--flows") == 0 && has_value) {
+            options.flow_count = std::min<size_t>(255, std::max<size_t>(1, std::stoul(argv[++i])));
+        } else {
+            fmt::print(output, "Usage: flow_deploy_bench [--flows <count>]\n");
+            return 1;
+        }
+    }
+
+    Bench::setup_working_directory("flow_deploy_bench");
+    Bench::silence_stdout();
+
+    ModuleRegistry module_registry;
+    register_modules(module_registry);
+
+    deploy("first", create_flows(options.flow_count, "Toggle"), module_registry);
+    deploy("unchanged", create_flows(options.flow_count, "Toggle"), module_registry);
+    deploy("changed", create_flows(options.flow_count, "Flip"), module_registry);
+
+    return 0;
+}
@@ -0,0 +1,241 @@
+// Stress test of long frame groups, with many modules sending at once.
+
+// Receiving: every module sends long frame groups back to back, with their
+// frames interleaved on the bus the way arbitration would, and every module
+// picking the same group uid at the same moment, which is the worst case.
+// Every group CanRed's LongFrameHandler hands back is checked against what
+// was sent, so we can see that none were mixed up with another module's.
+// By default there are as many modules as LongFrameHandler has buffers, any
+// more and groups start getting dropped, which shows up as missing and corrupted.
+
+// Sending: CanManager sends a stream of long frame groups to a few
+// modules, which never ACK them, and we check that no module ever has
+// two groups from us in flight with the same group uid.
+
+// The benchmark runs in its own temporary directory, with its own database,
+// and everything CanRed prints is sent to /dev/null.
+
+// Usage: long_frame_bench [--modules <count>] [--groups <count per module>]
+
+#include "bench_environment.h"
+
+#include <CanManager.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fmt/format.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Where results go, since stdout is sent to /dev/null.
+FILE* output = stderr;
+
+// Roughly how many 8 byte extended frames fit on a 1 Mbit/s bus every second.
+constexpr double BUS_FRAMES_PER_SECOND = 7800;
+
+struct Options {
+    size_t module_count { LongFrameHandler::MAX_GROUPS };
+    size_t group_count { 2000 };
+};
+
+uint16_t module_uid(size_t index)
+{
+    return 10 + index;
+}
+
+struct Sender {
+    uint16_t from_id { 0 };
+    uint8_t group_uid { 0 };
+    size_t groups_sent { 0 };
+    std::vector<uint8_t> payload;
+    size_t bytes_sent { 0 };
+};
+
+// Every group is a different length, and has different bytes, so any mix up shows.
+void start_group(Sender& sender, uint8_t group_uid)
+{
+    sender.group_uid = group_uid;
+    sender.bytes_sent = 0;
+
+    sender.payload.resize(9 + (sender.from_id * 31 + sender.groups_sent * 17) % 200);
+    for (size_t i = 0; i < sender.payload.size(); i += 1) {
+        sender.payload[i] = static_cast<uint8_t>(sender.from_id * 131 + sender.groups_sent * 7 + i);
+    }
+}
+
+// The sender's next frame, split up the same way modules do.
+CAN::Frame next_frame(Sender& sender)
+{
+    CAN::ID id(sender.from_id, CAN::UID::MCM, CAN::Priority::NORMAL, CAN::FrameFormat::Long);
+
+    // If the last frame was full, the group ends with one that has just the group uid.
+    const uint8_t bytes_in_frame = std::min<size_t>(7, sender.payload.size() - sender.bytes_sent);
+
+    CAN::Frame frame(id, nullptr, bytes_in_frame + 1);
+    frame.data[0] = sender.group_uid;
+    memcpy(&frame.data[1], &sender.payload[sender.bytes_sent], bytes_in_frame);
+
+    sender.bytes_sent += bytes_in_frame;
+    return frame;
+}
+
+void run_receiving(const Options& options)
+{
+    LongFrameHandler handler;
+
+    std::vector<Sender> senders(options.module_count);
+    std::vector<size_t> order(senders.size());
+
+    for (size_t i = 0; i < senders.size(); i += 1) {
+        senders[i].from_id = module_uid(i);
+        start_group(senders[i], 1);
+        order[i] = i;
+    }
+
+    std::mt19937 random(42);
+
+    size_t frames = 0;
+    size_t reassembled = 0;
+    size_t corrupted = 0;
+    size_t missing = 0;
+    size_t senders_done = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (senders_done < senders.size()) {
+        // Every module gets one frame onto the bus, in whatever order arbitration picks.
+        std::shuffle(order.begin(), order.end(), random);
+
+        for (const auto index : order) {
+            auto& sender = senders[index];
+            if (sender.groups_sent == options.group_count) {
+                continue;
+            }
+
+            const auto frame = next_frame(sender);
+            frames += 1;
+
+            handler.append(frame);
+            if (frame.can_dlc == 8) {
+                continue;
+            }
+
+            LongFrameHandler::FrameGroup group;
+            if (!handler.take_frame_group(frame.from_id, frame[0], &group)) {
+                missing += 1;
+            } else if (group.size != sender.payload.size() || memcmp(group.data, sender.payload.data(), group.size) != 0) {
+                corrupted += 1;
+            } else {
+                reassembled += 1;
+            }
+
+            sender.groups_sent += 1;
+            if (sender.groups_sent == options.group_count) {
+                senders_done += 1;
+                continue;
+            }
+
+            // Every module counts up its group uids the same way, so they're all the same at once.
+            start_group(sender, (sender.groups_sent % 255) + 1);
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const auto stats = handler.stats();
+
+    fmt::print(output, "receiving: {} modules, {} groups each, {} frames in {:.3f}s, {:.0f} frames/s ({:.0f}x a full 1 Mbit/s bus)\n",
+        senders.size(), options.group_count, frames, seconds, frames / seconds, frames / seconds / BUS_FRAMES_PER_SECOND);
+    fmt::print(output, "           {} reassembled, {} corrupted, {} missing, {} dropped (out of buffers), {} evicted\n",
+        reassembled, corrupted, missing, stats.pool_exhausted, stats.evicted);
+}
+
+// Records every frame it's asked to send.
+class CapturingInterface : public AutomatoInterface {
+public:
+    bool read_frame(CAN::Frame*) override { return false; }
+    bool send_frame(const CAN::Frame& frame) override
+    {
+        frames.push_back(frame);
+        return true;
+    }
+
+    std::vector<CAN::Frame> frames;
+};
+
+void run_sending()
+{
+    CapturingInterface interface;
+    std::vector<AutomatoInterface*> interfaces { &interface };
+
+    ModuleRegistry module_registry;
+    SocketRequestTable socket_requests;
+    CanManager manager(interfaces, module_registry, socket_requests);
+
+    // Nothing is ever ACKed, so every group stays in flight,
+    // there's just enough room in the outbox for all of them.
+    const size_t module_count = 4;
+    const size_t groups_per_module = Outbox::CAPACITY / module_count;
+
+    std::vector<std::array<bool, 256>> uids_in_flight(module_count);
+    size_t groups = 0;
+    size_t reused_uids = 0;
+
+    for (size_t i = 0; i < groups_per_module; i += 1) {
+        std::vector<EventUpdate> updates;
+        for (size_t module = 0; module < module_count; module += 1) {
+            // Just long enough to need a long frame group.
+            updates.push_back({ module_uid(module), EventUpdateType::add, std::vector<uint8_t>(Event::MAX_SIZE, i) });
+        }
+
+        interface.frames.clear();
+        manager.update_events(updates);
+
+        for (const auto& frame : interface.frames) {
+            // Only count a group once, by its last frame, which is never full.
+            if (!frame.is_long_frame || frame.can_dlc == 8) {
+                continue;
+            }
+
+            auto& in_flight = uids_in_flight[frame.to_id - module_uid(0)][frame[0]];
+            reused_uids += in_flight;
+            in_flight = true;
+            groups += 1;
+        }
+    }
+
+    fmt::print(output, "sending:   {} groups to {} modules that never ACK, {} group uids reused while in flight\n",
+        groups, module_count, reused_uids);
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i += 1) {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--modules") == 0 && has_value) {
+            options.module_count = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--groups") == 0 && has_value) {
+            options.group_count = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else {
+            fmt::print(output, "Usage: long_frame_bench [--modules <count>] [--groups <count per module>]\n");
+            return 1;
+        }
+    }
+
+    Bench::setup_working_directory("long_frame_bench");
+    Bench::silence_stdout();
+
+    run_receiving(options);
+    run_sending();
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Checks that no query CanRed, or NodeRed, runs against the database scans
+// a whole table, other than the ones that are meant to read every row.
+
+// Modules are registered, and flows deployed, like CanRed would, then every
+// query that was prepared along the way, on either connection, is run through
+// EXPLAIN QUERY PLAN, along with NodeRed's queries, which are listed below.
+// Exits with 1 if any query has a SCAN in its plan, so a new query, or a change
+// to one, that misses every index is caught.
+
+// Built whether or not the benchmarks are, and run by ctest.
+// It runs in its own temporary directory, with its own database,
+// and everything CanRed prints is sent to /dev/null.
+
+// Usage: query_plan_check [--verbose]
+
+#include "bench_environment.h"
+
+#include <Database.h>
+#include <DatabaseWriter.h>
+#include <EventManager.h>
+#include <ModuleRegistry.h>
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <json.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Where results go, since stdout is sent to /dev/null.
+FILE* output = stderr;
+
+// The queries in NodeRed/src/ModuleRouter/moduleRouter.ts.
+const char* const NODE_RED_QUERIES[] = {
+    "SELECT name FROM can_modules",
+    "SELECT name FROM can_module_commands WHERE module_uid = (SELECT uid FROM can_modules WHERE name = ?)",
+};
+
+// Queries that read every row, so a scan is what they're meant to do.
+const char* const FULL_SCAN_QUERIES[] = {
+    // ModuleRegistry loads everything at startup.
+    "SELECT uid, is_active = 'TRUE', type = 'WRITER', name, description FROM can_modules",
+    "SELECT module_uid, command_uid, name, return_format FROM can_module_commands",
+    "SELECT module_uid, descriptor_hash FROM can_module_descriptor_hashes",
+    // Every deploy starts by marking every flow inactive.
+    "UPDATE broadcast_flows SET is_active = \"FALSE\"",
+    // New flows get the lowest flow_id no flow has.
+    "SELECT flow_id FROM broadcast_flows",
+    "SELECT name FROM can_modules",
+};
+
+bool is_full_scan_query(const std::string& sql)
+{
+    return std::find(std::begin(FULL_SCAN_QUERIES), std::end(FULL_SCAN_QUERIES), sql) != std::end(FULL_SCAN_QUERIES);
+}
+
+void register_modules(ModuleRegistry& module_registry)
+{
+    module_registry.insert_or_update_module({ 1, "Sensor", "Reads things", ModuleType::Reader, true, true });
+    module_registry.insert_or_update_module({ 2, "Relay", "Toggles things", ModuleType::Writer, true, true });
+
+    module_registry.insert_or_update_module_command({ 1, 1, "Read", "int16" });
+    module_registry.insert_or_update_module_command({ 2, 1, "Toggle", "-" });
+
+    // Changed, so the updates are run too.
+    module_registry.insert_or_update_module({ 2, "Relay", "Toggles other things", ModuleType::Writer, true, true });
+    module_registry.insert_or_update_module_command({ 2, 1, "Flip", "-" });
+
+    module_registry.store_descriptor_hash(1, 1234);
+}
+
+nlohmann::json create_flows(const char* threshold)
+{
+    auto flow = nlohmann::json::array();
+
+    flow.push_back({
+        { "flow_name", "Flow" },
+        { "module_name", "Sensor" },
+        { "module_function", "Read" },
+        { "conditional", ">" },
+        { "value_to_check", threshold },
+        { "interval", "5" },
+        { "interval_unit", "seconds" },
+        { "section_number", 0 },
+    });
+
+    flow.push_back({
+        { "module_name", "Relay" },
+        { "module_function", "Flip" },
+        { "section_number", 1 },
+        { "next_section", 0 },
+    });
+
+    return nlohmann::json::array({ flow });
+}
+
+// New, unchanged, and then changed, so every query EventManager has is run.
+void deploy_flows(const ModuleRegistry& module_registry)
+{
+    const char* thresholds[] = { "1", "1", "2" };
+
+    for (const char* threshold : thresholds) {
+        std::ofstream(EventManager::flows_file()) << create_flows(threshold).dump();
+
+        std::vector<EventUpdate> updates;
+        EventManager::read_changes(updates, module_registry);
+    }
+}
+
+// Older versions of SQLite say SCAN TABLE, and newer ones only SCAN.
+// A SELECT with no FROM, like the outside of SELECT EXISTS (...), scans a single CONSTANT ROW.
+bool is_table_scan(const std::string& line)
+{
+    return line.compare(0, 5, "SCAN ") == 0 && line != "SCAN CONSTANT ROW";
+}
+
+// Returns the plan's table scans, every line of the plan, if verbose.
+std::vector<std::string> explain(const std::string& sql, bool verbose)
+{
+    std::vector<std::string> lines;
+
+    auto query = Database::the().prepare("EXPLAIN QUERY PLAN " + sql);
+    auto* statement = query.statement();
+    if (!statement) {
+        // Counted as a scan, since we can't tell, and the query's wrong anyway.
+        lines.push_back("SCAN, failed to prepare");
+        return lines;
+    }
+
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+        // id, parent, notused, detail
+        const auto* detail = reinterpret_cast<const char*>(sqlite3_column_text(statement, 3));
+        const std::string line = detail ? detail : "";
+
+        if (verbose || is_table_scan(line)) {
+            lines.push_back(line);
+        }
+    }
+
+    return lines;
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            fmt::print(output, "Usage: query_plan_check [--verbose]\n");
+            return 1;
+        }
+    }
+
+    Bench::setup_working_directory("query_plan_check");
+    Bench::silence_stdout();
+
+    ModuleRegistry module_registry;
+    register_modules(module_registry);
+    DatabaseWriter::the().flush();
+
+    deploy_flows(module_registry);
+
+    auto queries = Database::the().cached_queries();
+    const auto writer_queries = DatabaseWriter::the().cached_queries();
+    queries.insert(queries.end(), writer_queries.begin(), writer_queries.end());
+    queries.insert(queries.end(), std::begin(NODE_RED_QUERIES), std::end(NODE_RED_QUERIES));
+
+    std::sort(queries.begin(), queries.end());
+    queries.erase(std::unique(queries.begin(), queries.end()), queries.end());
+
+    size_t full_scans = 0;
+    for (const auto& sql : queries) {
+        const auto lines = explain(sql, verbose);
+
+        const bool is_scan = std::any_of(lines.begin(), lines.end(), is_table_scan);
+        const bool is_expected = is_full_scan_query(sql);
+        full_scans += is_scan && !is_expected;
+
+        const char* status = !is_scan ? "ok" : (is_expected ? "ok (reads every row)" : "FULL SCAN");
+        if (verbose || (is_scan && !is_expected)) {
+            fmt::print(output, "{}\n    {}\n", sql, status);
+            for (const auto& line : lines) {
+                fmt::print(output, "    | {}\n", line);
+            }
+        }
+    }
+
+    fmt::print(output, "{} queries checked, {} full scans\n", queries.size(), full_scans);
+    return full_scans == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// Measures how fast SerialInterface can turn a stream of serialized
+// frames into CAN::Frames, and how many read() calls it needs per frame.
+// The "legacy" run reads a single byte per syscall, which is what
+// SerialInterface did before it read in bulk.
+
+// Usage: serial_framing_bench [frame_count]
+
+#include <CanSerializer.h>
+#include <SerialCommon.h>
+#include <SerialInterface.h>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> create_serialized_stream(size_t frame_count)
+{
+    std::vector<uint8_t> stream;
+    stream.reserve(frame_count * (CAN::Frame::MAX_SERIALIZED_SIZE + 2));
+
+    uint8_t buffer[CAN::Frame::MAX_SERIALIZED_SIZE];
+    uint8_t data[8] = { CAN::Protocol::REPLY_COMMAND, 1, CAN::Primitive::BOOL_1_BYTES, 1, 2, 3, 4, 5 };
+
+    for (size_t i = 0; i < frame_count; i += 1) {
+        CAN::ID id(10 + (i % 50), CAN::UID::MCM);
+        CAN::Frame frame(id, data, 1 + (i % 8));
+
+        uint8_t bytes_used = CAN::serialize_frame(frame, buffer);
+
+        stream.push_back(SERIAL_MESSAGE_START_BYTE);
+        stream.insert(stream.end(), buffer, &buffer[bytes_used]);
+        stream.push_back(SERIAL_MESSAGE_STOP_BYTE);
+    }
+
+    return stream;
+}
+
+void run_benchmark(const char* name, size_t read_buffer_size, const std::vector<uint8_t>& stream, size_t frame_count)
+{
+    int32_t master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd == -1 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        fmt::print("Failed to create a pty pair!\n");
+        exit(1);
+    }
+
+    SerialInterface interface(ptsname(master_fd), read_buffer_size);
+
+    auto writer = std::thread([&]() {
+        const size_t CHUNK_SIZE = 4096;
+        for (size_t offset = 0; offset < stream.size(); offset += CHUNK_SIZE) {
+            size_t bytes_to_write = std::min(CHUNK_SIZE, stream.size() - offset);
+            if (write(master_fd, &stream[offset], bytes_to_write) == -1) {
+                fmt::print("Failed to write to the pty!\n");
+                return;
+            }
+        }
+    });
+
+    std::vector<CAN::Frame> frames;
+    frames.reserve(1024);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (interface.frames_read() < frame_count) {
+        frames.clear();
+        interface.read_frames(frames);
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    writer.join();
+    close(master_fd);
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    fmt::print("{:>8}: {:>10.0f} frames/s | {:>6.3f} read() calls/frame | {} frames in {:.3f}s\n",
+        name,
+        interface.frames_read() / seconds,
+        static_cast<double>(interface.read_calls()) / interface.frames_read(),
+        interface.frames_read(),
+        seconds);
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    const size_t frame_count = (argc > 1) ? std::stoul(argv[1]) : 100000;
+
+    const auto stream = create_serialized_stream(frame_count);
+
+    fmt::print("Parsing {} frames ({} bytes) from a pty\n", frame_count, stream.size());
+
+    run_benchmark("legacy", 1, stream, frame_count);
+    run_benchmark("bulk", SerialInterface::READ_BUFFER_SIZE, stream, frame_count);
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Compares moving frames through SerialInterface against SocketCanInterface.
+// The serial run streams serialized frames through a pty, like the
+// USB-serial bridge does. The SocketCAN run sends the same frames with
+// send_frames() and reads them back with read_frames().
+
+// Without an interface name, SocketCAN is measured over an AF_UNIX
+// socketpair(), which carries struct can_frame's the same way a CAN
+// socket does, so it runs anywhere. Given one (eg: vcan0), two real
+// CAN sockets are bound to it instead:
+//     ip link add dev vcan0 type vcan && ip link set up vcan0
+
+// Usage: socketcan_bench [frame_count] [can interface]
+
+#include <CanSerializer.h>
+#include <SerialCommon.h>
+#include <SerialInterface.h>
+#include <SocketCanInterface.h>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::vector<CAN::Frame> create_frames(size_t frame_count)
+{
+    std::vector<CAN::Frame> frames;
+    frames.reserve(frame_count);
+
+    uint8_t data[8] = { CAN::Protocol::REPLY_COMMAND, 1, CAN::Primitive::BOOL_1_BYTES, 1, 2, 3, 4, 5 };
+
+    for (size_t i = 0; i < frame_count; i += 1) {
+        CAN::ID id(10 + (i % 50), CAN::UID::MCM);
+        frames.push_back(CAN::Frame(id, data, 1 + (i % 8)));
+    }
+
+    return frames;
+}
+
+void print_result(const char* name, size_t frames_read, uint64_t read_calls, uint64_t write_calls, double seconds)
+{
+    fmt::print("{:>10}: {:>10.0f} frames/s | {:>6.3f} reads/frame | {:>6.3f} writes/frame | {} frames in {:.3f}s\n",
+        name,
+        frames_read / seconds,
+        static_cast<double>(read_calls) / frames_read,
+        static_cast<double>(write_calls) / frames_read,
+        frames_read,
+        seconds);
+}
+
+void run_serial(const std::vector<CAN::Frame>& frames)
+{
+    int32_t master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd == -1 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        fmt::print("Failed to create a pty pair!\n");
+        exit(1);
+    }
+
+    SerialInterface interface(ptsname(master_fd));
+
+    uint64_t write_calls = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    // The bridge module writes one frame at a time.
+    auto writer = std::thread([&]() {
+        uint8_t buffer[CAN::Frame::MAX_SERIALIZED_SIZE + 2];
+        buffer[0] = SERIAL_MESSAGE_START_BYTE;
+
+        for (const auto& frame : frames) {
+            const uint8_t bytes_used = CAN::serialize_frame(frame, &buffer[1]);
+            buffer[1 + bytes_used] = SERIAL_MESSAGE_STOP_BYTE;
+
+            if (write(master_fd, buffer, bytes_used + 2) == -1) {
+                fmt::print("Failed to write to the pty!\n");
+                return;
+            }
+            write_calls += 1;
+        }
+    });
+
+    std::vector<CAN::Frame> received;
+    received.reserve(1024);
+
+    while (interface.frames_read() < frames.size()) {
+        received.clear();
+        interface.read_frames(received);
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    writer.join();
+    close(master_fd);
+
+    print_result("serial", interface.frames_read(), interface.read_calls(), write_calls, std::chrono::duration<double>(end - start).count());
+}
+
+void run_socketcan(const char* name, SocketCanInterface& sender, SocketCanInterface& receiver, const std::vector<CAN::Frame>& frames)
+{
+    // A real CAN socket drops frames when its receive queue is full,
+    // so don't wait forever for frames that will never arrive.
+    timeval timeout { 1, 0 };
+    setsockopt(receiver.file_descriptor(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::atomic<bool> is_writer_done { false };
+    const auto start = std::chrono::steady_clock::now();
+
+    auto writer = std::thread([&]() {
+        sender.send_frames(frames.data(), frames.size());
+        is_writer_done = true;
+    });
+
+    std::vector<CAN::Frame> received;
+    received.reserve(SocketCanInterface::BATCH_SIZE);
+
+    while (receiver.frames_read() < frames.size()) {
+        received.clear();
+        if (receiver.read_frames(received) == 0 && is_writer_done) {
+            break;
+        }
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    writer.join();
+
+    print_result(name, receiver.frames_read(), receiver.read_calls(), sender.write_calls(), std::chrono::duration<double>(end - start).count());
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    const size_t frame_count = (argc > 1) ? std::stoul(argv[1]) : 100000;
+    const char* can_interface = (argc > 2) ? argv[2] : nullptr;
+
+    const auto frames = create_frames(frame_count);
+
+    fmt::print("Moving {} frames from one interface to another\n", frame_count);
+
+    run_serial(frames);
+
+    if (can_interface) {
+        SocketCanInterface sender(can_interface);
+        SocketCanInterface receiver(can_interface);
+        run_socketcan(can_interface, sender, receiver, frames);
+        return 0;
+    }
+
+    int32_t sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1) {
+        fmt::print("Failed to create a socketpair!\n");
+        return 1;
+    }
+
+    SocketCanInterface sender(sockets[0]);
+    SocketCanInterface receiver(sockets[1]);
+    run_socketcan("socketpair", sender, receiver, frames);
+
+    return 0;
+}
@@ -1,76 +1,188 @@
 #include "ACKHandler.h"
 
-#include <get_current_time_ms.h>
-#include <seconds_to_ms.h>
+#include <get_monotonic_time_ns.h>
 
-// TODO: We currently don't retain enough information
-//       to recreate dropped frames, and resend them.
+namespace {
+
+// Only one thread writes these, so there's no need for an atomic add.
+void increment(std::atomic<uint64_t>& counter, uint64_t amount = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void decrement(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+uint64_t ACKStats::rtt_percentile_ns(double percentile) const
+{
+    uint64_t total = 0;
+    for (const auto count : rtt_buckets) {
+        total += count;
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    const uint64_t wanted = static_cast<uint64_t>(total * percentile / 100.0);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < RTT_BUCKET_COUNT; i += 1) {
+        seen += rtt_buckets[i];
+        if (seen > wanted) {
+            return (1ull << i) * 1000;
+        }
+    }
+    return rtt_max_ns;
+}
+
+ACKHandler::ACKHandler()
+{
+    for (auto& bucket : m_rtt_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+ACKHandler::~ACKHandler() = default;
+
+ACKStats ACKHandler::stats() const
+{
+    ACKStats stats;
+    stats.waiting_on = m_waiting_on.load(std::memory_order_relaxed);
+    stats.acknowledged = m_acknowledged.load(std::memory_order_relaxed);
+    stats.expired = m_expired.load(std::memory_order_relaxed);
+    stats.unexpected = m_unexpected.load(std::memory_order_relaxed);
+    stats.pending = m_pending.load(std::memory_order_relaxed);
+    stats.rtt_total_ns = m_rtt_total_ns.load(std::memory_order_relaxed);
+    stats.rtt_max_ns = m_rtt_max_ns.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < ACKStats::RTT_BUCKET_COUNT; i += 1) {
+        stats.rtt_buckets[i] = m_rtt_buckets[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
 
 // For Development, where modules may go offline randomly
 #ifndef DISABLE_ACK_HANDLING
 
-void ACKHandler::add_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
+void ACKHandler::add_waiting_on_ack(uint16_t module_uid, uint8_t command_id, uint32_t tag /* ACK::NO_TAG */)
 {
-    auto ack = ACK(module_uid, command_id);
+    const uint32_t index = allocate_entry();
+
+    auto& entry = m_entries[index];
+    entry.module_uid = module_uid;
+    entry.command_id = command_id;
+    entry.tag = tag;
+    entry.sent_ns = get_monotonic_time_ns();
+    entry.next_for_key = NONE;
+
+    // Newest deadline, so it goes at the back.
+    entry.previous = m_newest;
+    entry.next = NONE;
+    if (m_newest != NONE) {
+        m_entries[m_newest].next = index;
+    } else {
+        m_oldest = index;
+    }
+    m_newest = index;
 
-    m_buffer.insert({ ack, get_current_time_ms() });
+    auto& key_list = m_key_lists[key_for(module_uid, command_id)];
+    if (key_list.newest != NONE) {
+        m_entries[key_list.newest].next_for_key = index;
+    } else {
+        key_list.oldest = index;
+    }
+    key_list.newest = index;
+
+    increment(m_waiting_on);
+    increment(m_pending);
+
+    if (m_timer.deadline_ns() == 0) {
+        arm_timer();
+    }
 }
 
-void ACKHandler::remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
+bool ACKHandler::remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id, uint32_t* tag /* nullptr */)
 {
-    // TODO: Think of a way to improve this.
-
     // Since the handling of CAN::Frames should be FIFO, when we get
-    // an ack back, where the WaitingOnAck struct is the same,
-    // we should delete the oldest occurrence we have
+    // an ack back, it's for the oldest frame we sent with that command_id.
 
-    auto ack = ACK { module_uid, command_id };
-    auto iter = m_buffer.equal_range(ack);
+    auto iter = m_key_lists.find(key_for(module_uid, command_id));
+    if (iter == m_key_lists.end() || iter->second.oldest == NONE) {
+        increment(m_unexpected);
+        return false;
+    }
 
-    std::unordered_map<ACK, uint64_t>::iterator last_added_iter;
+    auto& key_list = iter->second;
+    const uint32_t index = key_list.oldest;
 
-    uint64_t last_added = 0;
+    key_list.oldest = m_entries[index].next_for_key;
+    if (key_list.oldest == NONE) {
+        key_list.newest = NONE;
+    }
 
-    for (auto i = iter.first; i != iter.second; ++i) {
-        if (i->second < last_added) {
-            last_added = i->second;
-            last_added_iter = i;
-        }
+    record_rtt(get_monotonic_time_ns() - m_entries[index].sent_ns);
+
+    if (tag) {
+        *tag = m_entries[index].tag;
     }
-    m_buffer.erase(last_added_iter);
+
+    // If this was the oldest, the timer fires for nothing, and is
+    // re-armed then, which is cheaper than re-arming it on every ACK.
+    unlink_from_deadlines(index);
+    free_entry(index);
+
+    increment(m_acknowledged);
+    decrement(m_pending);
+    return true;
 }
 
 std::vector<ACK> ACKHandler::get_outdated_acks()
 {
-    uint64_t current_time = get_current_time_ms();
-
-    if (m_buffer.size() == 0) {
-        // Nothing to check.
-        return {};
-    }
+    const uint64_t current_time = get_monotonic_time_ns();
 
     std::vector<ACK> outdated_acks {};
-    for (const auto& ack : m_buffer) {
-        if (ack.second > (current_time + seconds_to_ms(3))) {
-            // ACK is outdated.
-            outdated_acks.push_back(ack.first);
-            remove_waiting_on_ack(ack.first.module_uid, ack.first.command_id);
+    while (m_oldest != NONE && m_entries[m_oldest].sent_ns + ACK_TIMEOUT_NS <= current_time) {
+        const uint32_t index = m_oldest;
+        const auto& entry = m_entries[index];
+
+        // The oldest of everything, is also the oldest for its command_id.
+        auto& key_list = m_key_lists[key_for(entry.module_uid, entry.command_id)];
+        key_list.oldest = entry.next_for_key;
+        if (key_list.oldest == NONE) {
+            key_list.newest = NONE;
         }
+
+        outdated_acks.push_back(ACK(entry.module_uid, entry.command_id, entry.tag));
+
+        unlink_from_deadlines(index);
+        free_entry(index);
+
+        increment(m_expired);
+        decrement(m_pending);
     }
+
+    arm_timer();
     return outdated_acks;
 }
 
 #else
-void ACKHandler::add_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
+void ACKHandler::add_waiting_on_ack(uint16_t module_uid, uint8_t command_id, uint32_t tag)
 {
     (void)module_uid;
     (void)command_id;
+    (void)tag;
 }
 
-void ACKHandler::remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
+bool ACKHandler::remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id, uint32_t* tag)
 {
     (void)module_uid;
     (void)command_id;
+    (void)tag;
+    return false;
 }
 
 std::vector<ACK> ACKHandler::get_outdated_acks()
@@ -78,3 +190,59 @@ std::vector<ACK> ACKHandler::get_outdated_acks()
     return {};
 }
 #endif
+
+uint32_t ACKHandler::allocate_entry()
+{
+    if (m_free == NONE) {
+        m_entries.push_back(WaitingACK());
+        return m_entries.size() - 1;
+    }
+
+    const uint32_t index = m_free;
+    m_free = m_entries[index].next;
+    return index;
+}
+
+void ACKHandler::free_entry(uint32_t index)
+{
+    m_entries[index].next = m_free;
+    m_free = index;
+}
+
+void ACKHandler::unlink_from_deadlines(uint32_t index)
+{
+    auto& entry = m_entries[index];
+
+    if (entry.previous != NONE) {
+        m_entries[entry.previous].next = entry.next;
+    } else {
+        m_oldest = entry.next;
+    }
+
+    if (entry.next != NONE) {
+        m_entries[entry.next].previous = entry.previous;
+    } else {
+        m_newest = entry.previous;
+    }
+}
+
+void ACKHandler::arm_timer()
+{
+    m_timer.arm((m_oldest == NONE) ? 0 : m_entries[m_oldest].sent_ns + ACK_TIMEOUT_NS);
+}
+
+void ACKHandler::record_rtt(uint64_t rtt_ns)
+{
+    increment(m_rtt_total_ns, rtt_ns);
+    if (rtt_ns > m_rtt_max_ns.load(std::memory_order_relaxed)) {
+        m_rtt_max_ns.store(rtt_ns, std::memory_order_relaxed);
+    }
+
+    size_t bucket = 0;
+    uint64_t rtt_us = rtt_ns / 1000;
+    while (rtt_us > 0 && bucket < ACKStats::RTT_BUCKET_COUNT - 1) {
+        rtt_us >>= 1;
+        bucket += 1;
+    }
+    increment(m_rtt_buckets[bucket]);
+}
@@ -1,45 +1,143 @@
 #pragma once
 
 #include <AutomatoInterface.h>
+#include <DeadlineTimer.h>
+#include <array>
+#include <atomic>
 #include <stdint.h>
 #include <unordered_map>
 #include <vector>
 
 class ACK {
 public:
-    ACK(uint16_t module_uid, uint8_t command_id)
+    // Whoever waits on an ACK can tag it, to know what it was for once it's answered, or expired.
+    static constexpr uint32_t NO_TAG = UINT32_MAX;
+
+    ACK(uint16_t module_uid, uint8_t command_id, uint32_t tag = NO_TAG)
         : module_uid(module_uid)
         , command_id(command_id)
+        , tag(tag)
     {
     }
 
     uint16_t module_uid;
     uint8_t command_id;
+    uint32_t tag;
 
     bool operator==(const ACK& other) const
     {
         return (module_uid == other.module_uid && command_id == other.command_id);
     }
+};
 
-    struct HashFunction {
-        size_t operator()(const ACK& ack) const
-        {
-            return ack.module_uid ^ ack.command_id;
-        }
-    };
+struct ACKStats {
+    // How many ACK round trip times land in each bucket, bucket i
+    // holds round trips under 2^i microseconds (the last one holds the rest).
+    static constexpr size_t RTT_BUCKET_COUNT = 24;
+
+    uint64_t waiting_on { 0 };
+    uint64_t acknowledged { 0 };
+    uint64_t expired { 0 };
+    // ACKs for something we weren't waiting on.
+    uint64_t unexpected { 0 };
+    uint64_t pending { 0 };
+
+    uint64_t rtt_total_ns { 0 };
+    uint64_t rtt_max_ns { 0 };
+    std::array<uint64_t, RTT_BUCKET_COUNT> rtt_buckets {};
+
+    // Estimated from the buckets, returns the upper bound of the
+    // bucket the percentile lands in, or 0 if there's nothing recorded.
+    uint64_t rtt_percentile_ns(double percentile) const;
 };
 
+// Keeps track of every frame we've sent, that we're waiting on an ACK for.
+
+// Every frame gets the same timeout, so deadlines come in the order frames
+// were sent, and waiting frames are kept in one intrusive list in that order,
+// the front always being the next to expire. Each (module_uid, command_id)
+// also keeps its own list, since an ACK always answers the oldest frame with
+// its command_id, so waiting on, acknowledging, and expiring are all O(1).
+// Entries live in a pool that's reused, so once it's warmed up, nothing allocates.
+
+// A timerfd is armed for the front's deadline, so expired frames are
+// noticed the moment they expire. Whoever owns the loop should read() it
+// when it's readable, and call get_outdated_acks(), which re-arms it.
+// Only the thread handling frames may use an ACKHandler, except
+// for stats() and file_descriptor().
+
 class ACKHandler {
 public:
-    ACKHandler() = default;
-    ~ACKHandler() = default;
+    static constexpr uint64_t ACK_TIMEOUT_NS = 3ull * 1000 * 1000 * 1000;
+
+    ACKHandler();
+    ~ACKHandler();
+
+    ACKHandler(const ACKHandler&) = delete;
+    ACKHandler& operator=(const ACKHandler&) = delete;
 
-    void add_waiting_on_ack(uint16_t module_uid, uint8_t command_id);
-    void remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id);
+    void add_waiting_on_ack(uint16_t module_uid, uint8_t command_id, uint32_t tag = ACK::NO_TAG);
 
+    // Returns false if we weren't waiting on it, otherwise
+    // copies the tag it was waited on with into tag.
+    bool remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id, uint32_t* tag = nullptr);
+
+    // Removes and returns every ACK whose deadline has passed.
     std::vector<ACK> get_outdated_acks();
 
+    // Readable once the oldest ACK we're waiting on has expired.
+    int32_t file_descriptor() const { return m_timer.file_descriptor(); }
+
+    ACKStats stats() const;
 
 private:
-    std::unordered_multimap<ACK, uint64_t, ACK::HashFunction> m_buffer;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct WaitingACK {
+        uint16_t module_uid { 0 };
+        uint8_t command_id { 0 };
+        uint32_t tag { ACK::NO_TAG };
+        uint64_t sent_ns { 0 };
+
+        // In the deadline list, also links the free list.
+        uint32_t previous { NONE };
+        uint32_t next { NONE };
+
+        // The next (newer) ACK with the same module_uid and command_id.
+        uint32_t next_for_key { NONE };
+    };
+
+    struct KeyList {
+        uint32_t oldest { NONE };
+        uint32_t newest { NONE };
+    };
+
+    static uint32_t key_for(uint16_t module_uid, uint8_t command_id) { return (static_cast<uint32_t>(module_uid) << 8) | command_id; }
+
+    uint32_t allocate_entry();
+    void free_entry(uint32_t index);
+    void unlink_from_deadlines(uint32_t index);
+
+    void arm_timer();
+    void record_rtt(uint64_t rtt_ns);
+
+    std::vector<WaitingACK> m_entries;
+    uint32_t m_free { NONE };
+
+    uint32_t m_oldest { NONE };
+    uint32_t m_newest { NONE };
+
+    std::unordered_map<uint32_t, KeyList> m_key_lists;
+
+    DeadlineTimer m_timer;
+
+    // Only written by the thread handling frames.
+    std::atomic<uint64_t> m_waiting_on { 0 };
+    std::atomic<uint64_t> m_acknowledged { 0 };
+    std::atomic<uint64_t> m_expired { 0 };
+    std::atomic<uint64_t> m_unexpected { 0 };
+    std::atomic<uint64_t> m_pending { 0 };
+    std::atomic<uint64_t> m_rtt_total_ns { 0 };
+    std::atomic<uint64_t> m_rtt_max_ns { 0 };
+    std::array<std::atomic<uint64_t>, ACKStats::RTT_BUCKET_COUNT> m_rtt_buckets;
 };
@@ -1,38 +1,23 @@
 #include "CanManager.h"
 
-#include <Database.h>
 #include <fmt/color.h>
 #include <fmt/format.h>
+#include <get_monotonic_time_ns.h>
 #include <iostream>
 #include <json.hpp>
 #include <memory>
 #include <print_u8_array.h>
 #include <seconds_to_ms.h>
+#include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 
-CanManager::CanManager(std::vector<AutomatoInterface*>& interfaces)
-    : m_interfaces(interfaces)
+CanManager::CanManager(std::vector<AutomatoInterface*>& interfaces, ModuleRegistry& module_registry, SocketRequestTable& socket_requests)
+    : m_module_registry(module_registry)
+    , m_interfaces(interfaces)
+    , m_socket_requests(socket_requests)
 {
-    const auto saved_modules = Database::the().prepare("SELECT uid, is_active, type, name, description FROM can_modules");
-    for (const auto& statement : saved_modules) {
-        Module mod;
-
-        mod.uid = statement.column(0);
-
-        std::string active = statement.column(1);
-        mod.active = (active == "TRUE");
-
-        std::string type = statement.column(2);
-        mod.type = (type == "WRITER") ? ModuleType::Writer : ModuleType::Reader;
-
-        std::string name = statement.column(3);
-        mod.name = name;
-
-        std::string description = statement.column(4);
-        mod.description = description;
-
-        m_saved_modules.emplace_back(mod);
-    }
+    register_default_protocol_handlers();
 }
 
 void CanManager::handle_incoming_frame(const CAN::Frame& frame)
@@ -43,9 +28,16 @@ void CanManager::handle_incoming_frame(const CAN::Frame& frame)
         return;
     }
 
-    if (frame.data[0] == CAN::Protocol::ACKNOWLEDGEMENT) {
-        // a Module we sent a command to, replied with ACK
-        m_ack_handler.remove_waiting_on_ack(frame.from_id, frame.data[1]);
+    // A long frame's first byte is its group uid, which can be anything, ACK's are never long frames.
+    if (!frame.is_long_frame && frame.data[0] == CAN::Protocol::ACKNOWLEDGEMENT) {
+        // a Module we sent a command to, replied with ACK,
+        // a single ACK frame can acknowledge up to 7 commands.
+        for (uint8_t i = 1; i < frame.can_dlc; i += 1) {
+            uint32_t tag = ACK::NO_TAG;
+            if (m_ack_handler.remove_waiting_on_ack(frame.from_id, frame.data[i], &tag)) {
+                m_outbox.acknowledged(tag);
+            }
+        }
         return;
     }
 
@@ -60,134 +52,295 @@ void CanManager::handle_incoming_frame(const CAN::Frame& frame)
         return;
     }
 
-    m_long_frame_handler.append(frame);
+    if (!m_long_frame_handler.append(frame)) {
+        return;
+    }
 
-    if (frame.can_dlc < 8) {
-        auto frame_buffer = m_long_frame_handler.steal_frame_group(frame[0]);
-        parse_frame_data(frame.from_id, frame_buffer.data(), frame_buffer.size());
+    // A group that's only its last frame, with just the group uid, is empty.
+    LongFrameHandler::FrameGroup group;
+    if (frame.can_dlc < 8 && m_long_frame_handler.take_frame_group(frame.from_id, frame[0], &group) && group.size > 0) {
+        parse_frame_data(frame.from_id, group.data, group.size);
     }
 }
 
-void CanManager::parse_frame_data(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
+void CanManager::handle_incoming_frames(const CAN::Frame frames[], size_t frame_count)
 {
+    if (frame_count == 0) {
+        return;
+    }
 
-    // CAN::Protocol::ACKNOWLEDGEMENT is handled by loop()
+    m_is_handling_batch = true;
 
-    switch (data[0]) {
+    for (size_t i = 0; i < frame_count; i += 1) {
+        handle_incoming_frame(frames[i]);
+    }
 
-    case CAN::Protocol::NEW_UID: {
-        uint16_t new_id = generate_module_uid();
-        uint8_t buffer[3];
-        buffer[0] = CAN::Protocol::REPLY_NEW_UID;
-        buffer[1] = new_id >> 8;
-        buffer[2] = new_id & 0xFF;
+    m_is_handling_batch = false;
 
-        send_buffer_to_every_interface(from_id, buffer, 3);
-        break;
+    flush_outgoing_frames();
+}
+
+void CanManager::flush_outgoing_frames()
+{
+    if (m_outgoing_acks.empty() && m_outgoing_frames.empty()) {
+        return;
     }
 
-    case CAN::Protocol::REPLY_UPDATE_INFO: {
-        handle_reply_update_info(from_id, data, can_dlc);
-        break;
+    auto& frames = m_flush_buffer;
+    frames.clear();
+
+    // ACKs go out first, just like they do outside of a batch.
+    // ACKs for the same module share a frame, in the order they were sent.
+    m_ack_generation += 1;
+    if (m_ack_generation == 0) {
+        // Wrapped around, forget every generation from the last time around.
+        std::fill(m_open_ack_frame_generations.begin(), m_open_ack_frame_generations.end(), 0);
+        m_ack_generation = 1;
     }
 
-    case CAN::Protocol::CHECK_IN: {
-        for (auto& mod : m_saved_modules) {
-            if (mod.uid == from_id) {
-                mod.did_come_online = true;
-                // fmt::print("Module {} just came online!\n", from_id);
-            }
+    for (const auto& ack : m_outgoing_acks) {
+        const size_t uid = ack.module_uid & (MODULE_UID_COUNT - 1);
+
+        if (m_open_ack_frame_generations[uid] != m_ack_generation || frames[m_open_ack_frames[uid]].can_dlc == 8) {
+            CAN::Frame frame(CAN::ID(CAN::UID::MCM, ack.module_uid), nullptr, 1);
+            frame.data[0] = CAN::Protocol::ACKNOWLEDGEMENT;
+
+            frames.push_back(frame);
+            m_open_ack_frames[uid] = frames.size() - 1;
+            m_open_ack_frame_generations[uid] = m_ack_generation;
         }
 
-        // TODO: This is for debug mode.
-        // Always ask modules to send their config
-        fmt::print(fmt::fg(fmt::terminal_color::green), "Module {} now online!\n", from_id);
-        uint8_t buffer[1];
+        auto& frame = frames[m_open_ack_frames[uid]];
+        frame.data[frame.can_dlc++] = ack.command_id;
+    }
 
-        buffer[0] = CAN::Protocol::UPDATE_INFO;
+    frames.insert(frames.end(), m_outgoing_frames.begin(), m_outgoing_frames.end());
 
-        send_buffer_to_every_interface(from_id, buffer, 1);
-        break;
+    m_outgoing_acks.clear();
+    m_outgoing_frames.clear();
+
+    for (const auto& interface : m_interfaces) {
+        interface->send_frames(frames.data(), frames.size());
     }
+}
 
-    case CAN::Protocol::INVALID: {
-        fmt::print(fmt::fg(fmt::terminal_color::red), "Invalid frame passed to parse_frame_data\n");
-        break;
+void CanManager::register_protocol_handler(uint8_t protocol_byte, const char* name, const ProtocolHandler& handler)
+{
+    auto& entry = m_protocol_handlers[protocol_byte];
+
+    entry.name = name;
+    entry.handler = handler;
+    entry.invocations.store(0, std::memory_order_relaxed);
+    entry.total_ns.store(0, std::memory_order_relaxed);
+    entry.max_ns.store(0, std::memory_order_relaxed);
+}
+
+void CanManager::register_default_protocol_handlers()
+{
+    // CAN::Protocol::ACKNOWLEDGEMENT is handled by handle_incoming_frame()
+
+    const auto handler = [this](void (CanManager::*function)(uint16_t, const uint8_t[], uint16_t)) {
+        return [this, function](uint16_t from_id, const uint8_t data[], uint16_t length) {
+            (this->*function)(from_id, data, length);
+        };
+    };
+
+    register_protocol_handler(CAN::Protocol::NEW_UID, "NEW_UID", handler(&CanManager::handle_new_uid));
+    register_protocol_handler(CAN::Protocol::REPLY_UPDATE_INFO, "REPLY_UPDATE_INFO", handler(&CanManager::handle_reply_update_info));
+    register_protocol_handler(CAN::Protocol::REPLY_UPDATE_INFO_BINARY, "REPLY_UPDATE_INFO_BINARY", handler(&CanManager::handle_reply_update_info_binary));
+    register_protocol_handler(CAN::Protocol::CHECK_IN, "CHECK_IN", handler(&CanManager::handle_check_in));
+    register_protocol_handler(CAN::Protocol::INVALID, "INVALID", handler(&CanManager::handle_invalid));
+    register_protocol_handler(CAN::Protocol::ERROR_GENERIC, "ERROR_GENERIC", handler(&CanManager::handle_error_generic));
+    register_protocol_handler(CAN::Protocol::REPLY_EVENT_SEND_STORED, "REPLY_EVENT_SEND_STORED", handler(&CanManager::handle_reply_event_send_stored));
+    register_protocol_handler(CAN::Protocol::REPLY_COMMAND, "REPLY_COMMAND", handler(&CanManager::handle_reply_command));
+    register_protocol_handler(CAN::Protocol::REPLY_COMMAND_SEQUENCED, "REPLY_COMMAND_SEQUENCED", handler(&CanManager::handle_reply_command_sequenced));
+}
+
+void CanManager::parse_frame_data(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
+{
+    auto& entry = m_protocol_handlers[data[0]];
+
+    if (!entry.handler) {
+        handle_unknown_protocol(from_id, data, can_dlc);
+        return;
     }
 
-    case CAN::Protocol::ERROR_GENERIC: {
-        fmt::print("Module {} reported a generic error: {}\n", from_id, data[1]);
-        break;
+    const uint64_t start = get_monotonic_time_ns();
+    entry.handler(from_id, data, can_dlc);
+    const uint64_t elapsed = get_monotonic_time_ns() - start;
+
+    // We're the only thread writing these, so there's no need for a fetch_add().
+    entry.invocations.store(entry.invocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    entry.total_ns.store(entry.total_ns.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+    if (elapsed > entry.max_ns.load(std::memory_order_relaxed)) {
+        entry.max_ns.store(elapsed, std::memory_order_relaxed);
     }
+}
 
-    case CAN::Protocol::REPLY_EVENT_SEND_STORED: {
+std::vector<ProtocolHandlerStats> CanManager::protocol_handler_stats() const
+{
+    std::vector<ProtocolHandlerStats> stats;
 
-        if (can_dlc == 1) {
-            fmt::print("Module {} does not have any stored events!\n", from_id);
-            break;
+    for (size_t i = 0; i < m_protocol_handlers.size(); i += 1) {
+        const auto& entry = m_protocol_handlers[i];
+        if (!entry.handler) {
+            continue;
         }
 
-        fmt::print("Module {}'s stored events:\n", from_id);
-        print_u8_array(&data[1], can_dlc - 1);
-        break;
+        ProtocolHandlerStats handler_stats;
+        handler_stats.protocol_byte = i;
+        handler_stats.name = entry.name;
+        handler_stats.invocations = entry.invocations.load(std::memory_order_relaxed);
+        handler_stats.total_ns = entry.total_ns.load(std::memory_order_relaxed);
+        handler_stats.max_ns = entry.max_ns.load(std::memory_order_relaxed);
+        stats.push_back(handler_stats);
     }
 
-    case CAN::Protocol::REPLY_COMMAND: {
+    return stats;
+}
 
-        // So why are we receiving this message?
-        // First, check if its for a socket.
+void CanManager::handle_new_uid(uint16_t from_id, const uint8_t[], uint16_t)
+{
+    uint16_t new_id = generate_module_uid();
+    uint8_t buffer[3];
+    buffer[0] = CAN::Protocol::REPLY_NEW_UID;
+    buffer[1] = new_id >> 8;
+    buffer[2] = new_id & 0xFF;
 
-        fmt::print("SocketRequests Array:\n");
-        for (const auto& req : m_socket_requests) {
-            fmt::print("uid: {}\ncommand_uid: {}\n", req.module_uid, req.command_uid);
-        };
+    send_buffer_to_every_interface(from_id, buffer, 3);
+}
 
-        for (auto iter = m_socket_requests.begin(); iter != m_socket_requests.end(); ++iter) {
-            if (iter->module_uid == from_id && iter->command_uid == data[1]) {
-                send_socket_reply(data, can_dlc, *iter);
-                m_socket_requests.erase(iter);
-                return;
-            }
-        }
+void CanManager::handle_check_in(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
+{
+    m_module_registry.mark_online(from_id);
 
-        fmt::print(fmt::fg(fmt::terminal_color::red), "Parsed REPLY_COMMAND But we're not sure why!\n");
-        // fmt::print(fmt::fg(fmt::terminal_color::red), "Frame Data: \n");
-        // print_u8_array(data, can_dlc, fmt::terminal_color::red);
-        // fmt::print("\n");
+    fmt::print(fmt::fg(fmt::terminal_color::green), "Module {} now online!\n", from_id);
 
-        // array[0]: 10001010 | 138 | 0x8a | � -> REPLY_COMMAND
-        // array[1]: 00000011 |   3 | 0x03 | -> 3? wtf
-        // array[2]: 11010010 | 210 | 0xd2 | �  -> BOOL_1_BYTES
-        // array[3]: 00000001 |   1 | 0x01 | -> bool
+    // Modules with a descriptor send its hash, if it's the one we already
+    // have there's no need to ask for it again, the ACK is all they need.
+    if (can_dlc >= 5 && m_module_registry.has_module(from_id)) {
+        const uint32_t hash = (static_cast<uint32_t>(data[1]) << 24) | (static_cast<uint32_t>(data[2]) << 16) | (data[3] << 8) | data[4];
 
-        break;
+        uint32_t stored_hash = 0;
+        if (m_module_registry.find_descriptor_hash(from_id, &stored_hash) && stored_hash == hash) {
+            fmt::print("Module {} configuration has not changed!\n", from_id);
+            return;
+        }
     }
 
-    default: {
+    uint8_t buffer[2];
+
+    // Modules that have a descriptor, in a version we understand,
+    // send it instead of their JSON configuration.
+    buffer[0] = CAN::Protocol::UPDATE_INFO;
+    buffer[1] = ModuleDescriptor::VERSION;
 
-        fmt::print(fmt::fg(fmt::terminal_color::red),
-            "Reached default in parse_frame_data! Unhandled byte: {}\nFrame at the time of parsing\n", data[0]);
-        print_u8_array(data, can_dlc, fmt::terminal_color::red);
-        fmt::print("\n");
+    send_buffer_to_every_interface(from_id, buffer, 2);
+}
 
-        // buffer[0] = CAN::Protocol::ERROR_GENERIC;
-        // buffer[1] = CAN::GENERIC_ERROR::UNKNOWN_ERROR;
+void CanManager::handle_invalid(uint16_t, const uint8_t[], uint16_t)
+{
+    fmt::print(fmt::fg(fmt::terminal_color::red), "Invalid frame passed to parse_frame_data\n");
+}
 
-        // send_buffer_to_every_interface(from_id, buffer, 2);
+void CanManager::handle_error_generic(uint16_t from_id, const uint8_t data[], uint16_t)
+{
+    fmt::print("Module {} reported a generic error: {}\n", from_id, data[1]);
+}
+
+void CanManager::handle_reply_event_send_stored(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
+{
+    if (can_dlc == 1) {
+        fmt::print("Module {} does not have any stored events!\n", from_id);
+        return;
     }
+
+    fmt::print("Module {}'s stored events:\n", from_id);
+    print_u8_array(&data[1], can_dlc - 1);
+}
+
+void CanManager::handle_reply_command(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
+{
+    // So why are we receiving this message?
+    // First, check if its for a socket.
+
+    SocketRequest request;
+    if (can_dlc >= 2 && m_socket_requests.take(from_id, data[1], &request)) {
+        send_socket_reply(&data[2], can_dlc - 2, request);
+        send_waiting_socket_requests(from_id);
+        return;
+    }
+
+    fmt::print(fmt::fg(fmt::terminal_color::red), "Parsed REPLY_COMMAND But we're not sure why!\n");
+    // fmt::print(fmt::fg(fmt::terminal_color::red), "Frame Data: \n");
+    // print_u8_array(data, can_dlc, fmt::terminal_color::red);
+    // fmt::print("\n");
+
+    // array[0]: 10001010 | 138 | 0x8a | � -> REPLY_COMMAND
+    // array[1]: 00000011 |   3 | 0x03 | -> 3? wtf
+    // array[2]: 11010010 | 210 | 0xd2 | �  -> BOOL_1_BYTES
+    // array[3]: 00000001 |   1 | 0x01 | -> bool
+}
+
+void CanManager::handle_reply_command_sequenced(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
+{
+    // data[1] is the command_uid, data[2] is the sequence, followed by the output.
+    SocketRequest request;
+    if (can_dlc >= 3 && m_socket_requests.take_sequenced(from_id, data[1], data[2], &request)) {
+        send_socket_reply(&data[3], can_dlc - 3, request);
+        send_waiting_socket_requests(from_id);
+        return;
     }
+
+    fmt::print(fmt::fg(fmt::terminal_color::red), "Parsed REPLY_COMMAND_SEQUENCED from {}, but nobody is waiting on it!\n", from_id);
+}
+
+void CanManager::handle_unknown_protocol(uint16_t, const uint8_t data[], uint16_t can_dlc)
+{
+    fmt::print(fmt::fg(fmt::terminal_color::red),
+        "Reached default in parse_frame_data! Unhandled byte: {}\nFrame at the time of parsing\n", data[0]);
+    print_u8_array(data, can_dlc, fmt::terminal_color::red);
+    fmt::print("\n");
+
+    // buffer[0] = CAN::Protocol::ERROR_GENERIC;
+    // buffer[1] = CAN::GENERIC_ERROR::UNKNOWN_ERROR;
+
+    // send_buffer_to_every_interface(from_id, buffer, 2);
 }
 
 void CanManager::send_frame_to_every_interface(const CAN::Frame& frame)
+{
+    send_frames_to_every_interface(&frame, 1);
+}
+
+void CanManager::send_frames_to_every_interface(const CAN::Frame frames[], size_t frame_count)
 {
     // Don't send ACKs for ACKs
     // Frames meant for anyone do not require ACKs.
-    if (frame[0] != CAN::Protocol::ACKNOWLEDGEMENT && !frame.is_for_everyone()) {
-        m_ack_handler.add_waiting_on_ack(frame.to_id, frame[frame.is_long_frame]);
+    const auto needs_ack = [](const CAN::Frame& frame) {
+        return (frame.is_long_frame || frame[0] != CAN::Protocol::ACKNOWLEDGEMENT) && !frame.is_for_everyone();
+    };
+
+    if (frame_count > 0 && frames[0].is_long_frame) {
+        // A long frame group is kept, and sent again, as a whole.
+        if (needs_ack(frames[0])) {
+            track_frames(frames, frame_count);
+        }
+    } else {
+        for (size_t i = 0; i < frame_count; i += 1) {
+            if (needs_ack(frames[i])) {
+                track_frames(&frames[i], 1);
+            }
+        }
+    }
+
+    if (m_is_handling_batch) {
+        m_outgoing_frames.insert(m_outgoing_frames.end(), frames, &frames[frame_count]);
+        return;
     }
 
     for (const auto& interface : m_interfaces) {
-        interface->send_frame(frame);
+        interface->send_frames(frames, frame_count);
     }
 }
 
@@ -210,26 +363,34 @@ void CanManager::send_buffer_to_every_interface(uint16_t to_id, uint8_t data[],
     }
 
     // Since we use 1 Byte for a group UID, we can only
-    // send 7 bytes at a time
+    // send 7 bytes at a time.
+    // The whole group is built on the stack, and sent at once.
+    CAN::Frame frames[MAX_LONG_FRAME_GROUP_SIZE];
+    size_t frame_count = 0;
 
     uint32_t bytes_to_send = data_size;
-    const bool need_extra_frame = (data_size % 7) == 0;
-    const uint8_t long_frame_uid = get_long_frame_uid();
+    const uint8_t long_frame_uid = allocate_long_frame_uid(to_id);
 
     while (bytes_to_send) {
-        uint8_t can_dlc = std::min(7u, bytes_to_send);
+        const uint8_t bytes_in_frame = std::min(7u, bytes_to_send);
 
-        CAN::Frame frame(id, &data[(data_size - bytes_to_send) + 1], can_dlc);
+        auto& frame = frames[frame_count++];
+        frame = CAN::Frame(id, nullptr, bytes_in_frame + 1);
         frame.data[0] = long_frame_uid;
+        memcpy(&frame.data[1], &data[data_size - bytes_to_send], bytes_in_frame);
 
-        bytes_to_send -= can_dlc;
-        send_frame_to_every_interface(frame);
+        bytes_to_send -= bytes_in_frame;
     }
 
-    if (need_extra_frame) {
-        // send an empty frame
-        send_frame_to_every_interface(CAN::Frame { id, nullptr, 0 });
+    // A group ends with a frame that isn't full, if the
+    // last frame was full, send one with just the group uid.
+    if (frames[frame_count - 1].can_dlc == 8) {
+        auto& frame = frames[frame_count++];
+        frame = CAN::Frame(id, nullptr, 1);
+        frame.data[0] = long_frame_uid;
     }
+
+    send_frames_to_every_interface(frames, frame_count);
 }
 
 void CanManager::update_events(std::vector<EventUpdate>& updates_needed)
@@ -242,6 +403,9 @@ void CanManager::update_events(std::vector<EventUpdate>& updates_needed)
     // + 1 For the CAN::Protocol Specifier
     uint8_t buffer[Event::MAX_SIZE + 1] = { 0 };
 
+    // Every update goes out with a single send_frames() per interface.
+    m_is_handling_batch = true;
+
     for (const auto& update : updates_needed) {
 
         buffer[0] = (update.update_type == EventUpdateType::add) ? CAN::Protocol::EVENT_ADD : CAN::Protocol::EVENT_REMOVE;
@@ -252,101 +416,91 @@ void CanManager::update_events(std::vector<EventUpdate>& updates_needed)
         send_buffer_to_every_interface(update.module_uid, buffer, update.event_blob.size() + 1);
     }
     updates_needed.clear();
+
+    m_is_handling_batch = false;
+    flush_outgoing_frames();
 }
 
-StoredModuleStatus CanManager::insert_or_update_module(uint16_t uid, const std::string& type, const std::string& name, const std::string& description) const
+void CanManager::handle_reply_update_info(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
 {
-    const auto is_module_uid_stored = [](uint8_t uid) {
-        return !!Database::the().prepare("SELECT EXISTS (SELECT 1 FROM can_modules WHERE uid = ? LIMIT 1)").get(uid).column(0);
-    };
+    // TODO: This function is rickety, it needs much better validation
+    //       for the incoming JSON, and error handing for all ::json calls.
 
-    if (is_module_uid_stored(uid)) {
-        // We're storing this module, check if anything has changed.
+    std::string json_string;
+    json_string.reserve(1024);
+
+    for (uint16_t i = 1; i < can_dlc; i += 1) {
+        if (data[i] != CAN::Protocol::REPLY_UPDATE_INFO) {
+            json_string.push_back(std::move(data[i]));
+        }
+    }
 
-        // Get the module from the DB and compare it
-        Module stored_module;
+    auto json = nlohmann::json::parse(json_string);
+    // TODO: These can fail!
+    Module module;
+    module.uid = from_id;
+    // Modules send their type in lowercase, see AutoStart_Config.h.
+    module.type = (strcasecmp(json.value("Type", std::string()).c_str(), "WRITER") == 0) ? ModuleType::Writer : ModuleType::Reader;
+    module.name = json.value("Name", std::string());
+    module.description = json.value("Description", std::string());
+    module.active = true;
+    module.did_come_online = true;
 
-        const auto statement = Database::the().prepare("SELECT uid, is_active, type, name, description FROM can_modules WHERE uid = ?").get();
-        stored_module.uid = statement.column(0);
-        stored_module.active = statement.column(1);
-        std::string stored_module_type = statement.column(2);
-        stored_module.type = (stored_module_type == "WRITER") ? ModuleType::Writer : ModuleType::Reader;
-        // TODO: The DB returns strings with extraneous quotes, we should
-        // be trimming them away
+    store_module_info(module);
 
-        // TODO:
-        // stored_module.name = statement.column(3);
-        // stored_module.description = statement.column(4);
+    for (auto const& value : json.at("Commands")) {
 
-        Module given_module;
-        given_module.uid = uid;
-        given_module.type = type == "WRITER" ? ModuleType::Writer : ModuleType::Reader;
-        given_module.name = name;               // TODO: These should be trimmed
-        given_module.description = description; // TODO: These should be trimmed
+        ModuleCommand command;
+        command.module_uid = from_id;
+        command.command_uid = value.at("CommandID").get<uint8_t>();
+        command.name = value.at("CommandName").get<std::string>();
+        command.return_format = value.at("ReturnFormat").get<std::string>();
 
-        if (stored_module == given_module) {
-            return StoredModuleStatus::NOT_MODIFIED;
-        }
-        return StoredModuleStatus::MODIFIED;
+        store_module_command(command);
     }
-
-    // We're not storing the module, store it!
-    Database::the().prepare("INSERT INTO can_modules (uid, type, name, description) VALUES (?, ?, ?, ?)").run(uid, type, name, description);
-    return StoredModuleStatus::NOT_STORED;
 }
 
-StoredModuleStatus CanManager::insert_or_update_module_command(uint16_t module_uid, uint16_t command_uid, const std::string& name, const std::string& return_format) const
+void CanManager::handle_reply_update_info_binary(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
 {
-    const auto is_module_command_id_stored = [](uint8_t module_uid, uint16_t command_uid) {
-        return !!Database::the().prepare("SELECT EXISTS (SELECT 1 FROM can_module_commands WHERE module_uid = ? AND command_uid = ? LIMIT 1)").get(module_uid, command_uid).column(0);
-    };
-
-    if (is_module_command_id_stored(module_uid, command_uid)) {
-        // We're storing this command, has it been modified?
-        ModuleCommand stored_command;
-
-        const auto statement = Database::the().prepare("SELECT name FROM can_module_commands WHERE module_uid = ? AND command_uid = ?").get(module_uid, command_uid);
-        // TODO: stored_command.name = statement.column(0);
-        stored_command.module_uid = module_uid;
-        stored_command.command_uid = command_uid;
-
-        ModuleCommand given_command;
-        given_command.name = name;
-        given_command.module_uid = module_uid;
-        given_command.command_uid = command_uid;
+    if (can_dlc < 2) {
+        return;
+    }
 
-        if (stored_command == given_command) {
-            return StoredModuleStatus::NOT_MODIFIED;
-        }
-        return StoredModuleStatus::MODIFIED;
+    // data[0] is the protocol byte, the descriptor follows it.
+    ModuleDescriptor::Reader descriptor;
+    if (!descriptor.parse(&data[1], can_dlc - 1)) {
+        fmt::print(fmt::fg(fmt::terminal_color::red), "Module {} sent a malformed descriptor!\n", from_id);
+        return;
     }
 
-    // We're not storing the command, store it!
-    Database::the().prepare("INSERT INTO can_module_commands (module_uid, command_uid, name, return_format) VALUES (?, ?, ?, ?)").run(module_uid, command_uid, name, return_format);
-    return StoredModuleStatus::NOT_STORED;
-}
+    Module module;
+    module.uid = from_id;
+    module.type = (descriptor.type_flags & ModuleDescriptor::TypeFlags::WRITER) ? ModuleType::Writer : ModuleType::Reader;
+    module.name.assign(descriptor.name.data, descriptor.name.size);
+    module.description.assign(descriptor.description.data, descriptor.description.size);
+    module.active = true;
+    module.did_come_online = true;
 
-void CanManager::handle_reply_update_info(uint16_t from_id, const uint8_t data[], uint16_t can_dlc)
-{
-    // TODO: This function is rickety, it needs much better validation
-    //       for the incoming JSON, and error handing for all ::json calls.
+    store_module_info(module);
 
-    std::string json_string;
-    json_string.reserve(1024);
+    ModuleDescriptor::Command descriptor_command;
+    while (descriptor.next_command(&descriptor_command)) {
+        ModuleCommand command;
+        command.module_uid = from_id;
+        command.command_uid = descriptor_command.command_id;
+        command.name.assign(descriptor_command.name.data, descriptor_command.name.size);
+        command.return_format = ModuleDescriptor::return_format_for(descriptor_command.return_primitive);
 
-    for (uint16_t i = 1; i < can_dlc; i += 1) {
-        if (data[i] != CAN::Protocol::REPLY_UPDATE_INFO) {
-            json_string.push_back(std::move(data[i]));
-        }
+        store_module_command(command);
     }
 
-    auto json = nlohmann::json::parse(json_string);
-    // TODO: These can fail!
-    auto type = json["Type"].dump();
-    auto name = json["Name"].dump();
-    auto description = json["Description"].dump();
+    // It's the same hash the module checks in with.
+    m_module_registry.store_descriptor_hash(from_id, ModuleDescriptor::hash(&data[1], can_dlc - 1));
+}
 
-    auto changes = insert_or_update_module(from_id, type, name, description);
+void CanManager::store_module_info(const Module& module)
+{
+    auto changes = m_module_registry.insert_or_update_module(module);
 
     switch (changes) {
     case StoredModuleStatus::NOT_STORED:
@@ -365,23 +519,24 @@ void CanManager::handle_reply_update_info(uint16_t from_id, const uint8_t data[]
         fmt::print("insert_or_update_module returned an error!\n");
         break;
     }
+}
 
-    for (auto const& value : json.at("Commands")) {
-
-        auto command_name = value.at("CommandName").dump();
-        auto command_id = std::stoi(value.at("CommandID").dump());
-        auto return_format = value.at("ReturnFormat").dump();
-
-        auto changes = insert_or_update_module_command(from_id, command_id, command_name, return_format);
-        if (changes != StoredModuleStatus::NOT_MODIFIED) {
-            // TODO: Print out a nice summary of the changes.
-            fmt::print("a Module command was changed, in some way.\n");
-        }
+void CanManager::store_module_command(const ModuleCommand& command)
+{
+    auto changes = m_module_registry.insert_or_update_module_command(command);
+    if (changes != StoredModuleStatus::NOT_MODIFIED) {
+        // TODO: Print out a nice summary of the changes.
+        fmt::print("a Module command was changed, in some way.\n");
     }
 }
 
 void CanManager::send_ack(uint16_t from_id, uint8_t command_id)
 {
+    if (m_is_handling_batch) {
+        m_outgoing_acks.emplace_back(from_id, command_id);
+        return;
+    }
+
     uint8_t buffer[2];
 
     buffer[0] = CAN::Protocol::ACKNOWLEDGEMENT;
@@ -390,15 +545,52 @@ void CanManager::send_ack(uint16_t from_id, uint8_t command_id)
     send_buffer_to_every_interface(from_id, buffer, 2);
 }
 
+void CanManager::track_frames(const CAN::Frame frames[], size_t frame_count)
+{
+    // If the outbox is full, we still wait on the ACKs, but can't resend.
+    const uint32_t tag = m_outbox.add(frames[0].to_id, frames, frame_count);
+
+    for (size_t i = 0; i < frame_count; i += 1) {
+        m_ack_handler.add_waiting_on_ack(frames[i].to_id, frames[i][frames[i].is_long_frame], tag);
+    }
+}
+
 void CanManager::check_for_old_acks()
 {
+    const uint64_t now = get_monotonic_time_ns();
     auto outdated_acks = m_ack_handler.get_outdated_acks();
 
     for (const auto& ack : outdated_acks) {
-        // we have outdated ACKs!
-        // TODO: In the future we should retain enough information
-        //       about frames that we can resent dropped frames.
-        fmt::print("Dropped ACK: module_uid: {} command_id: {}\n", ack.module_uid, ack.command_id);
+        if (ack.tag == ACK::NO_TAG) {
+            fmt::print("Dropped ACK: module_uid: {} command_id: {}, the outbox was full!\n", ack.module_uid, ack.command_id);
+            continue;
+        }
+
+        if (!m_outbox.expired(ack.tag, now)) {
+            fmt::print("Dropped ACK: module_uid: {} command_id: {}, gave up after {} attempts\n", ack.module_uid, ack.command_id, Outbox::MAX_ATTEMPTS + 0);
+        }
+    }
+
+    Outbox::Retransmission retransmission;
+    while (m_outbox.next_due(now, &retransmission)) {
+        // The module might still have the frames of the last attempt that got through.
+        if (retransmission.frames[0].is_long_frame) {
+            m_outbox.change_group_uid(retransmission.tag, allocate_long_frame_uid(retransmission.frames[0].to_id));
+        }
+
+        for (size_t i = 0; i < retransmission.frame_count; i += 1) {
+            const auto& frame = retransmission.frames[i];
+            m_ack_handler.add_waiting_on_ack(frame.to_id, frame[frame.is_long_frame], retransmission.tag);
+        }
+
+        if (m_is_handling_batch) {
+            m_outgoing_frames.insert(m_outgoing_frames.end(), retransmission.frames, &retransmission.frames[retransmission.frame_count]);
+            continue;
+        }
+
+        for (const auto& interface : m_interfaces) {
+            interface->send_frames(retransmission.frames, retransmission.frame_count);
+        }
     }
 }
 
@@ -407,13 +599,32 @@ void CanManager::inject_frame(const CAN::Frame& frame)
     send_frame_to_every_interface(frame);
 }
 
+uint8_t CanManager::allocate_long_frame_uid(uint16_t to_id)
+{
+    // Group uids count up per module, skipping any that are still in the
+    // outbox, so a module never sees two groups from us with the same uid at once.
+    // 0 is never used, since modules take it to mean an empty buffer.
+    auto& uid = m_last_long_frame_uids[to_id & (MODULE_UID_COUNT - 1)];
+
+    for (size_t tries = 0; tries < 255; tries += 1) {
+        uid = (uid % 255) + 1;
+        if (!m_outbox.is_group_in_flight(to_id, uid)) {
+            return uid;
+        }
+    }
+
+    // Every uid is in flight, which the outbox is just about big enough for.
+    uid = (uid % 255) + 1;
+    return uid;
+}
+
 uint16_t CanManager::generate_module_uid() const
 {
     // TODO: This can possibly go on forever
     // TODO: This should be much more intelligent
     for (;;) {
         auto random_id = rand() % 2000 + 5;
-        if (!!Database::the().prepare("SELECT EXISTS (SELECT 1 FROM can_modules WHERE uid = ? LIMIT 1").get(random_id).column(0)) {
+        if (!m_module_registry.has_module(random_id)) {
             return random_id;
         }
     }
@@ -421,32 +632,110 @@ uint16_t CanManager::generate_module_uid() const
 
 void CanManager::parse_socket_input(std::vector<SocketRequest>& socket_requests, std::mutex& socket_requests_lock)
 {
-    // Cache new socket data
+    std::vector<SocketRequest> new_requests;
     {
         std::unique_lock<std::mutex> lock(socket_requests_lock);
-        m_socket_requests.insert(m_socket_requests.begin(), socket_requests.begin(), socket_requests.end());
-        socket_requests.clear();
+        new_requests.swap(socket_requests);
     }
 
     // TODO: For now, our IPC socket system only works with
     //       one type of request, but it would be cool if
     //       we could handle multiple types.
-    for (auto& request : m_socket_requests) {
-        request.module_uid = Database::the().prepare("SELECT uid FROM can_modules where name = ?").get(request.module_name).column(0);
-        request.command_uid = Database::the().prepare("SELECT command_uid FROM can_module_commands WHERE name = ? AND module_uid = ?").get(request.module_uid, request.module_function).column(0);
+    m_is_handling_batch = true;
 
-        fmt::print("Socket Request Info:\nmodule_uid: {}\nmodule_function: {}\n", request.module_uid, request.command_uid);
-        fmt::print("module_name (str): {}\nmodule_function_name (str): {}\n", request.module_name, request.module_function);
+    for (auto& request : new_requests) {
+        if (resolve_socket_request(m_module_registry, request)) {
+            send_socket_request(request);
+        }
+    }
 
-        CAN::ID id(CAN::UID::MCM, request.module_uid);
+    m_is_handling_batch = false;
+    flush_outgoing_frames();
+}
 
-        uint8_t buffer[2];
-        buffer[0] = CAN::Protocol::COMMAND;
-        buffer[1] = request.command_uid;
+bool CanManager::resolve_socket_request(const ModuleRegistry& module_registry, SocketRequest& request)
+{
+    if (!module_registry.find_module_uid(request.module_name, &request.module_uid)) {
+        fmt::print("Socket Request for an unknown module: {}\n", request.module_name);
+        return false;
+    }
 
-        CAN::Frame frame(id, buffer, 2);
-        send_frame_to_every_interface(frame);
+    if (!module_registry.find_command_uid(request.module_uid, request.module_function, &request.command_uid)) {
+        fmt::print("Socket Request for an unknown command: {} on {}\n", request.module_function, request.module_name);
+        return false;
     }
+
+    fmt::print("Socket Request Info:\nmodule_uid: {}\nmodule_function: {}\n", request.module_uid, request.command_uid);
+    fmt::print("module_name (str): {}\nmodule_function_name (str): {}\n", request.module_name, request.module_function);
+    return true;
+}
+
+void CanManager::send_socket_request(const SocketRequest& request)
+{
+    auto waiting = m_waiting_socket_requests.find(request.module_uid);
+    const bool is_anything_waiting = waiting != m_waiting_socket_requests.end() && !waiting->second.empty();
+
+    if (is_anything_waiting || m_socket_requests.in_flight(request.module_uid) >= MAX_IN_FLIGHT_COMMANDS) {
+        m_waiting_socket_requests[request.module_uid].push_back(request);
+        return;
+    }
+
+    SocketRequest sent_request = request;
+    send_command(sent_request);
+}
+
+void CanManager::send_command(SocketRequest& request)
+{
+    request.sequence = m_command_sequences[request.module_uid & (MODULE_UID_COUNT - 1)]++;
+    m_socket_requests.add(request);
+
+    CAN::ID id(CAN::UID::MCM, request.module_uid);
+
+    uint8_t buffer[3];
+    buffer[0] = CAN::Protocol::COMMAND;
+    buffer[1] = request.command_uid;
+    buffer[2] = request.sequence;
+
+    CAN::Frame frame(id, buffer, 3);
+    send_frame_to_every_interface(frame);
+}
+
+void CanManager::send_waiting_socket_requests(uint16_t module_uid)
+{
+    auto waiting = m_waiting_socket_requests.find(module_uid);
+    if (waiting == m_waiting_socket_requests.end()) {
+        return;
+    }
+
+    auto& queue = waiting->second;
+    while (!queue.empty() && m_socket_requests.in_flight(module_uid) < MAX_IN_FLIGHT_COMMANDS) {
+        send_command(queue.front());
+        queue.pop_front();
+    }
+}
+
+void CanManager::expire_socket_requests()
+{
+    std::vector<SocketRequest> expired;
+    m_socket_requests.expire(get_monotonic_time_ns(), expired);
+
+    for (const auto& request : expired) {
+        fmt::print(fmt::fg(fmt::terminal_color::red), "Socket Request timed out: {} on {}\n", request.module_function, request.module_name);
+        send_socket_timeout_reply(request);
+    }
+
+    // With shards, whoever expired a request might not be the one holding
+    // the requests waiting on its module, so every shard checks its own.
+    for (const auto& waiting : m_waiting_socket_requests) {
+        send_waiting_socket_requests(waiting.first);
+    }
+}
+
+void CanManager::send_to_socket(int32_t file_descriptor, const std::string& buffer)
+{
+    // The client might have hung up while we were waiting, which
+    // shouldn't take us down with a SIGPIPE.
+    send(file_descriptor, buffer.data(), buffer.size(), MSG_NOSIGNAL);
 }
 
 // Expected Output Format:
@@ -456,22 +745,34 @@ void CanManager::parse_socket_input(std::vector<SocketRequest>& socket_requests,
 //     "output": "<output as string>",
 //     "output_type": <number defining output type>
 // }
+// When the module never replied, there's no output, and "error" is "timeout".
 
-bool CanManager::send_socket_reply(const uint8_t data[], uint16_t can_dlc, const SocketRequest& socket_request)
+void CanManager::send_socket_timeout_reply(const SocketRequest& socket_request)
 {
     nlohmann::json json;
 
     json["module_function"] = socket_request.module_function;
     json["module_name"] = socket_request.module_name;
+    json["output"] = "";
+    json["output_type"] = 0;
+    json["error"] = "timeout";
 
-    if (can_dlc == 1) {
+    send_to_socket(socket_request.file_descriptor, json.dump());
+}
+
+bool CanManager::send_socket_reply(const uint8_t output[], uint16_t output_length, const SocketRequest& socket_request)
+{
+    nlohmann::json json;
+
+    json["module_function"] = socket_request.module_function;
+    json["module_name"] = socket_request.module_name;
+
+    if (output_length == 0) {
         // We don't have any data to send back!
         json["output"] = "";
         json["output_type"] = 0;
 
-        std::string buffer = json.dump();
-
-        send(socket_request.file_descriptor, buffer.data(), buffer.size(), 0);
+        send_to_socket(socket_request.file_descriptor, json.dump());
         return true;
     }
 
@@ -510,102 +811,106 @@ bool CanManager::send_socket_reply(const uint8_t data[], uint16_t can_dlc, const
         };
     };
 
-    auto size = CAN::primitive_size(data[2]);
-    auto type = primitive_to_socket_output(data[2]);
-    std::string output;
+    auto size = CAN::primitive_size(output[0]);
+    auto type = primitive_to_socket_output(output[0]);
+    std::string output_string;
+
+    if (output_length < size + 1) {
+        fmt::print(fmt::fg(fmt::terminal_color::red), "REPLY_COMMAND from {} is too short for its output!\n", socket_request.module_name);
+        return false;
+    }
 
     // TODO: This can definitely be improved
-    switch (data[2]) {
+    switch (output[0]) {
 
     case CAN::Primitive::UNSIGNED_1_BYTES: {
-        uint8_t value = data[3];
-        output = std::to_string(value);
+        uint8_t value = output[1];
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::SIGNED_1_BYTES: {
-        int8_t value = data[3];
-        output = std::to_string(value);
+        int8_t value = output[1];
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::UNSIGNED_2_BYTES: {
         uint16_t value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::SIGNED_2_BYTES: {
         int16_t value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::UNSIGNED_4_BYTES: {
         uint32_t value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::SIGNED_4_BYTES: {
         int32_t value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::FLOAT_4_BYTES: {
         float value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::UNSIGNED_8_BYTES: {
         uint64_t value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::SIGNED_8_BYTES: {
         int64_t value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::DOUBLE_8_BYTES: {
         double value = 0;
-        memcpy(&value, &data[3], size);
-        output = std::to_string(value);
+        memcpy(&value, &output[1], size);
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::BOOL_1_BYTES: {
-        bool value = data[3];
-        output = std::to_string(value);
+        bool value = output[1];
+        output_string = std::to_string(value);
         break;
     }
 
     case CAN::Primitive::VOID: {
-        output = "";
+        output_string = "";
         break;
     }
 
     default:
-        output = "";
+        output_string = "";
         break;
     }
 
-    json["output"] = output;
+    json["output"] = output_string;
     json["output_type"] = type;
 
-    std::string buffer = json.dump();
-    send(socket_request.file_descriptor, buffer.data(), buffer.size(), 0);
+    send_to_socket(socket_request.file_descriptor, json.dump());
 
     return true;
 }
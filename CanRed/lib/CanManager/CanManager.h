@@ -3,21 +3,56 @@
 #include <ACKHandler.h>
 #include <AutomatoInterface.h>
 #include <CanFrame.h>
-#include <Database.h>
 #include <EventManager.h>
 #include <LongFrameHandler.h>
 #include <Module.h>
+#include <ModuleDescriptor.h>
+#include <ModuleRegistry.h>
+#include <Outbox.h>
+#include <SocketRequestTable.h>
 #include <SocketWatcher.h>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+// How often a protocol handler ran, and how long it took.
+struct ProtocolHandlerStats {
+    uint8_t protocol_byte { 0 };
+    const char* name { nullptr };
+    uint64_t invocations { 0 };
+    uint64_t total_ns { 0 };
+    uint64_t max_ns { 0 };
+};
 
 class CanManager {
 public:
+    // Called with the from_id, and the data of a (reassembled) frame, where data[0] is the protocol byte.
+    using ProtocolHandler = std::function<void(uint16_t from_id, const uint8_t data[], uint16_t length)>;
+
     CanManager() = delete;
-    CanManager(std::vector<AutomatoInterface*>& interfaces);
+    CanManager(std::vector<AutomatoInterface*>& interfaces, ModuleRegistry& module_registry, SocketRequestTable& socket_requests);
     ~CanManager() = default;
 
     void handle_incoming_frame(const CAN::Frame& frame);
 
+    // Handles a batch of frames at once. Every frame we send because of
+    // the batch is held back and sent together at the end, with ACKs going
+    // to the same module packed into as few frames as possible.
+    // Database writes are queued on the DatabaseWriter, which groups them itself.
+    void handle_incoming_frames(const CAN::Frame frames[], size_t frame_count);
+
+    // Handles every frame whose ACK never came, and sends again whatever
+    // is due to be retransmitted. Call it whenever one of
+    // ack_timer_file_descriptors() is readable, after reading it.
     void check_for_old_acks();
+    std::vector<int32_t> ack_timer_file_descriptors() const { return { m_ack_handler.file_descriptor(), m_outbox.file_descriptor() }; }
+
+    // Safe to call from any thread.
+    ACKStats ack_stats() const { return m_ack_handler.stats(); }
+    std::vector<ModuleLinkStats> module_link_stats() const { return m_outbox.module_stats(); }
+    LongFrameStats long_frame_stats() const { return m_long_frame_handler.stats(); }
     void update_events(std::vector<EventUpdate>& updates_needed);
 
     // Injects a CAN::Frame into the CANBUS, meant only to be used for development
@@ -25,39 +60,135 @@ public:
     
     void parse_socket_input(std::vector<SocketRequest>& socket_requests, std::mutex& socket_requests_lock);
 
-private:
-    // Modules
-    // TODO: These are some long names...
-    StoredModuleStatus insert_or_update_module(uint16_t uid, const std::string& type, const std::string& name, const std::string& description) const;
-    StoredModuleStatus insert_or_update_module_command(uint16_t module_uid, uint16_t command_uid, const std::string& name, const std::string& return_format) const;
+    // Looks up the module_uid and command_uid a socket request is asking for.
+    // Returns false if we don't know the module, or the command.
+    static bool resolve_socket_request(const ModuleRegistry& module_registry, SocketRequest& request);
+
+    // Asks the module to run the requested command, and waits on its reply.
+    // A module only gets MAX_IN_FLIGHT_COMMANDS at a time, anything past
+    // that waits here until an earlier command is answered, or times out.
+    void send_socket_request(const SocketRequest& request);
+
+    // Tells every socket client whose request was never answered,
+    // that it timed out. Expected to be called about once a second.
+    void expire_socket_requests();
 
+    // Frames are dispatched through a table indexed by their protocol byte (data[0]),
+    // registering a handler for a byte replaces whatever handled it before.
+    // Every handler's invocations and run time are recorded.
+    // Handlers must be registered before frames start arriving.
+    void register_protocol_handler(uint8_t protocol_byte, const char* name, const ProtocolHandler& handler);
+
+    // Stats for every registered handler, safe to call from any thread.
+    std::vector<ProtocolHandlerStats> protocol_handler_stats() const;
+
+private:
     // CAN
     void send_frame_to_every_interface(const CAN::Frame& frame);
+    // Frames sent together (eg: a long frame group) go out with a single send_frames() per interface.
+    void send_frames_to_every_interface(const CAN::Frame frames[], size_t frame_count);
     void send_buffer_to_every_interface(uint16_t to_id, uint8_t data[], uint8_t data_size, uint8_t priority = CAN::Priority::NORMAL);
 
+    // The most frames a buffer of up to 255 bytes is split into,
+    // 7 bytes per frame, and an extra frame to end the group.
+    static constexpr size_t MAX_LONG_FRAME_GROUP_SIZE = (255 + 6) / 7 + 1;
+
     void parse_frame_data(uint16_t from_id, const uint8_t data[], uint16_t length);
 
+    // Protocol Handlers
+    struct ProtocolHandlerEntry {
+        const char* name { nullptr };
+        ProtocolHandler handler;
+
+        // Only written by the thread dispatching frames.
+        std::atomic<uint64_t> invocations { 0 };
+        std::atomic<uint64_t> total_ns { 0 };
+        std::atomic<uint64_t> max_ns { 0 };
+    };
+
+    void register_default_protocol_handlers();
+
+    void handle_new_uid(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
     void handle_reply_update_info(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_reply_update_info_binary(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_check_in(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_invalid(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_error_generic(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_reply_event_send_stored(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_reply_command(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_reply_command_sequenced(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
+    void handle_unknown_protocol(uint16_t from_id, const uint8_t data[], uint16_t can_dlc);
 
-    std::vector<Module> m_saved_modules;
+    std::array<ProtocolHandlerEntry, 256> m_protocol_handlers;
+
+    ModuleRegistry& m_module_registry;
+
+    // Shared by both kinds of REPLY_UPDATE_INFO.
+    void store_module_info(const Module& module);
+    void store_module_command(const ModuleCommand& command);
+
+    // Sends everything held back while handling a batch.
+    void flush_outgoing_frames();
+
+    bool m_is_handling_batch { false };
+    std::vector<CAN::Frame> m_outgoing_frames;
+    std::vector<CAN::Frame> m_flush_buffer;
 
     // ACK
     void send_ack(uint16_t from_id, uint8_t command_id);
 
+    // Keeps the frames in the outbox, and waits on their ACKs.
+    void track_frames(const CAN::Frame frames[], size_t frame_count);
+
     ACKHandler m_ack_handler;
+    Outbox m_outbox;
+
+    // ACKs waiting for the end of a batch.
+    std::vector<ACK> m_outgoing_acks;
+
+    // module_uid -> index of the ACK frame being filled for it, only valid if
+    // its generation matches m_ack_generation, which changes every flush.
+    // Indexed directly by module_uid, so a flush never allocates.
+    static constexpr size_t MODULE_UID_COUNT = 1 << 11;
+    std::array<uint32_t, MODULE_UID_COUNT> m_open_ack_frames {};
+    std::array<uint32_t, MODULE_UID_COUNT> m_open_ack_frame_generations {};
+    uint32_t m_ack_generation { 0 };
 
     // Long Frames
     LongFrameHandler m_long_frame_handler;
 
+    uint8_t allocate_long_frame_uid(uint16_t to_id);
+
+    // Indexed by module_uid, the last group uid we sent it.
+    std::array<uint8_t, MODULE_UID_COUNT> m_last_long_frame_uids {};
+
     // Interfaces
     std::vector<AutomatoInterface*>& m_interfaces;
 
     // Sockets
-    bool send_socket_reply(const uint8_t data[], uint16_t can_dlc, const SocketRequest& socket_request);
 
-    std::vector<SocketRequest> m_socket_requests;
+    // Every COMMAND carries a sequence number, which modules that understand
+    // it send back with their reply, so identical commands can be in flight
+    // together. Older modules ignore it, and their replies are matched
+    // to the oldest request for the command, like before.
+    static constexpr size_t MAX_IN_FLIGHT_COMMANDS = 8;
+
+    void send_command(SocketRequest& request);
+    void send_waiting_socket_requests(uint16_t module_uid);
+
+    // output[0] is the primitive, followed by the value, output_length is 0 if there's no output.
+    bool send_socket_reply(const uint8_t output[], uint16_t output_length, const SocketRequest& socket_request);
+    void send_socket_timeout_reply(const SocketRequest& socket_request);
+    static void send_to_socket(int32_t file_descriptor, const std::string& buffer);
+
+    SocketRequestTable& m_socket_requests;
+
+    // module_uid -> requests waiting for a free spot in its window
+    std::unordered_map<uint16_t, std::deque<SocketRequest>> m_waiting_socket_requests;
+
+    // Indexed by module_uid, the sequence number its next COMMAND gets.
+    std::array<uint8_t, MODULE_UID_COUNT> m_command_sequences {};
 
     // Helpers
     uint16_t generate_module_uid() const;
-    uint8_t get_long_frame_uid() const { return rand() % 255; };
 };
@@ -1,54 +1,182 @@
 #include "LongFrameHandler.h"
 
+#include <cstring>
 #include <fmt/format.h>
+#include <get_monotonic_time_ns.h>
+
+namespace {
+
+// Only one thread writes these, so there's no need for an atomic add.
+void increment(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void decrement(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+} // namespace
 
 LongFrameHandler::LongFrameHandler()
+    : m_bytes(MAX_GROUPS * BUFFER_SIZE)
 {
-    m_buffers.reserve(10);
+    m_first_for_module.fill(NO_SLOT + 0);
+
+    m_free_slots.reserve(MAX_GROUPS);
+    for (size_t slot = MAX_GROUPS; slot > 0; slot -= 1) {
+        m_free_slots.push_back(slot - 1);
+    }
 }
 
-void LongFrameHandler::append(const CAN::Frame& frame)
+bool LongFrameHandler::append(const CAN::Frame& frame)
 {
+    if (frame.can_dlc == 0) {
+        return false;
+    }
+
     // frame[0] = long frame group uid
-    auto element = m_buffers.find(frame[0]);
+    const uint8_t group_id = frame[0];
+    const uint64_t now = get_monotonic_time_ns();
 
-    if (element == m_buffers.end()) {
+    uint8_t slot = find_group(frame.from_id, group_id);
+    if (slot == NO_SLOT) {
         // we're not currently storing this group.
+        slot = start_group(frame.from_id, group_id, now);
+        if (slot == NO_SLOT) {
+            return false;
+        }
+    }
 
-        std::vector<uint8_t> bytes;
-        bytes.reserve(1024); // 1KB
+    auto& group = m_groups[slot];
+    const uint8_t byte_count = frame.can_dlc - 1;
+    const bool is_last_frame = frame.can_dlc < 8;
 
-        auto did_insert = m_buffers.insert({ frame[0], std::move(bytes) });
+    if (!group.is_dropped && group.size + byte_count > BUFFER_SIZE) {
+        fmt::print("Dropped long frame group {} from {}, it's longer than {} bytes\n", group_id, frame.from_id, BUFFER_SIZE + 0);
+        increment(m_overflowed);
+        group.is_dropped = true;
+    }
 
-        if (did_insert.second) {
-            // insert was successful
-            element = did_insert.first;
-        } else {
-            fmt::print("failed to insert element into map in LongFrameHandler\n");
-            return;
+    if (group.is_dropped) {
+        // Its buffer is only given back with its last frame, so the frames
+        // after the one that overflowed aren't taken for a new group.
+        group.last_frame_ns = now;
+        if (is_last_frame) {
+            release(slot);
         }
+        return false;
     }
 
     // Store bytes 1-7
-    for (uint8_t i = 1; i < frame.can_dlc; i += 1) {
-        element->second.push_back(frame[i]);
+    memcpy(&buffer_for(slot)[group.size], &frame.data[1], byte_count);
+    group.size += byte_count;
+    group.last_frame_ns = now;
+    return true;
+}
+
+bool LongFrameHandler::take_frame_group(uint16_t from_id, uint8_t group_id, FrameGroup* group)
+{
+    const uint8_t slot = find_group(from_id, group_id);
+    if (slot == NO_SLOT) {
+        return false;
+    }
+
+    // The bytes stay where they are, nothing can reuse
+    // the buffer until the next group is started.
+    group->data = buffer_for(slot);
+    group->size = m_groups[slot].size;
+
+    release(slot);
+    increment(m_completed);
+    return true;
+}
+
+LongFrameStats LongFrameHandler::stats() const
+{
+    LongFrameStats stats;
+    stats.in_flight = m_in_flight.load(std::memory_order_relaxed);
+    stats.completed = m_completed.load(std::memory_order_relaxed);
+    stats.evicted = m_evicted.load(std::memory_order_relaxed);
+    stats.pool_exhausted = m_pool_exhausted.load(std::memory_order_relaxed);
+    stats.overflowed = m_overflowed.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint8_t LongFrameHandler::find_group(uint16_t from_id, uint8_t group_id) const
+{
+    uint8_t slot = m_first_for_module[from_id & (MODULE_UID_COUNT - 1)];
+    while (slot != NO_SLOT) {
+        const auto& group = m_groups[slot];
+        if (group.from_id == from_id && group.group_id == group_id) {
+            return slot;
+        }
+        slot = group.next_for_module;
     }
+    return NO_SLOT;
 }
 
-std::vector<uint8_t> LongFrameHandler::steal_frame_group(uint8_t group_id)
+uint8_t LongFrameHandler::start_group(uint16_t from_id, uint8_t group_id, uint64_t now_ns)
 {
-    // Return the underlying vector of bytes
-    // that we have for the group.
+    // Groups are only evicted once they've been idle for IDLE_TIMEOUT_NS,
+    // so there's no need to look for them more often than that, unless we're out of buffers.
+    if (m_free_slots.empty() || now_ns >= m_last_eviction_ns + IDLE_TIMEOUT_NS) {
+        evict_idle_groups(now_ns);
+    }
+
+    if (m_free_slots.empty()) {
+        increment(m_pool_exhausted);
+        return NO_SLOT;
+    }
+
+    const uint8_t slot = m_free_slots.back();
+    m_free_slots.pop_back();
 
-    auto element = m_buffers.find(group_id);
+    auto& first = m_first_for_module[from_id & (MODULE_UID_COUNT - 1)];
 
-    if (element == m_buffers.end()) {
-        return {};
+    auto& group = m_groups[slot];
+    group.is_used = true;
+    group.from_id = from_id;
+    group.group_id = group_id;
+    group.size = 0;
+    group.last_frame_ns = now_ns;
+    group.is_dropped = false;
+    group.next_for_module = first;
+
+    first = slot;
+    increment(m_in_flight);
+    return slot;
+}
+
+void LongFrameHandler::release(uint8_t slot)
+{
+    auto& group = m_groups[slot];
+    group.is_used = false;
+
+    // Unlink it from its module's groups.
+    auto* link = &m_first_for_module[group.from_id & (MODULE_UID_COUNT - 1)];
+    while (*link != slot) {
+        link = &m_groups[*link].next_for_module;
     }
+    *link = group.next_for_module;
 
-    auto data_buffer = std::move(element->second);
+    m_free_slots.push_back(slot);
+    decrement(m_in_flight);
+}
 
-    m_buffers.erase(element);
+void LongFrameHandler::evict_idle_groups(uint64_t now_ns)
+{
+    m_last_eviction_ns = now_ns;
 
-    return data_buffer;
+    for (size_t slot = 0; slot < MAX_GROUPS; slot += 1) {
+        const auto& group = m_groups[slot];
+        if (!group.is_used || group.last_frame_ns + IDLE_TIMEOUT_NS > now_ns) {
+            continue;
+        }
+
+        fmt::print("Evicted long frame group {} from {}, after {} bytes, its last frame never came\n", group.group_id, group.from_id, group.size);
+        release(slot);
+        increment(m_evicted);
+    }
 }
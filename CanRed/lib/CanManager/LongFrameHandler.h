@@ -1,20 +1,104 @@
 #pragma once
 
 #include <CanFrame.h>
-#include <memory>
-#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <stdint.h>
 #include <vector>
 
+struct LongFrameStats {
+    // Groups we've started, but haven't seen the end of yet.
+    uint64_t in_flight { 0 };
+    uint64_t completed { 0 };
+    // Groups that went quiet for IDLE_TIMEOUT_NS, most likely their last frame was lost.
+    uint64_t evicted { 0 };
+    // Frames starting a group that were dropped, since every buffer was in use.
+    uint64_t pool_exhausted { 0 };
+    // Groups dropped for being longer than a buffer, the rest of their frames are discarded.
+    uint64_t overflowed { 0 };
+};
+
+// Reassembles long frame groups, in a fixed pool of buffers.
+
+// A group is known by who sent it, and its group uid, since
+// every module picks its group uids without knowing about the others.
+
+// Every buffer is allocated once, up front, and handed back to the pool
+// as soon as its group is taken, so reassembling never allocates.
+// A group that goes quiet for IDLE_TIMEOUT_NS is evicted, the next time
+// a group is started, so a lost last frame can't hold onto a buffer forever.
+// A group that's too long for its buffer keeps it until its last frame, so the
+// rest of its frames are discarded, rather than starting a group of their own.
+// Only the thread handling frames may use a LongFrameHandler, except for stats().
+
 class LongFrameHandler {
 public:
+    static constexpr size_t MAX_GROUPS = 64;
+    static constexpr size_t BUFFER_SIZE = 1024;
+    static constexpr uint64_t IDLE_TIMEOUT_NS = 1ull * 1000 * 1000 * 1000;
+    static constexpr size_t MODULE_UID_COUNT = 1 << 11;
+
+    // A view of a finished group's bytes, it stays
+    // valid until the next call to append().
+    struct FrameGroup {
+        const uint8_t* data { nullptr };
+        uint16_t size { 0 };
+    };
+
     LongFrameHandler();
     ~LongFrameHandler() = default;
 
-    static uint8_t get_long_frame_uid() { return rand() % 255; }
+    LongFrameHandler(const LongFrameHandler&) = delete;
+    LongFrameHandler& operator=(const LongFrameHandler&) = delete;
+
+    // Returns false if the frame was dropped, or its group was.
+    bool append(const CAN::Frame& frame);
+
+    // Returns false if we're not storing the group, otherwise
+    // fills in group, and gives its buffer back to the pool.
+    bool take_frame_group(uint16_t from_id, uint8_t group_id, FrameGroup* group);
 
-    void append(const CAN::Frame& frame);
-    std::vector<uint8_t> steal_frame_group(uint8_t group_id);
+    LongFrameStats stats() const;
 
 private:
-    std::unordered_map<uint8_t, std::vector<uint8_t>> m_buffers;
+    static constexpr uint8_t NO_SLOT = UINT8_MAX;
+
+    struct Group {
+        bool is_used { false };
+        uint16_t from_id { 0 };
+        uint8_t group_id { 0 };
+        uint16_t size { 0 };
+        uint64_t last_frame_ns { 0 };
+        // It overflowed, and we're waiting for its last frame.
+        bool is_dropped { false };
+
+        // The next group from the same module.
+        uint8_t next_for_module { NO_SLOT };
+    };
+
+    uint8_t* buffer_for(uint8_t slot) { return &m_bytes[slot * BUFFER_SIZE]; }
+
+    uint8_t find_group(uint16_t from_id, uint8_t group_id) const;
+    uint8_t start_group(uint16_t from_id, uint8_t group_id, uint64_t now_ns);
+    void release(uint8_t slot);
+    void evict_idle_groups(uint64_t now_ns);
+
+    // Every buffer, back to back.
+    std::vector<uint8_t> m_bytes;
+
+    std::array<Group, MAX_GROUPS> m_groups {};
+    std::vector<uint8_t> m_free_slots;
+
+    // Indexed by from_id, the slot of the newest group from
+    // that module, or NO_SLOT. A module rarely has more than one.
+    std::array<uint8_t, MODULE_UID_COUNT> m_first_for_module;
+
+    uint64_t m_last_eviction_ns { 0 };
+
+    // Only written by the thread handling frames.
+    std::atomic<uint64_t> m_in_flight { 0 };
+    std::atomic<uint64_t> m_completed { 0 };
+    std::atomic<uint64_t> m_evicted { 0 };
+    std::atomic<uint64_t> m_pool_exhausted { 0 };
+    std::atomic<uint64_t> m_overflowed { 0 };
 };
@@ -0,0 +1,215 @@
+#include "Outbox.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint64_t NS_PER_RETRANSMITTED_FRAME = 1000000000ull / Outbox::RETRANSMIT_FRAMES_PER_SECOND;
+constexpr uint64_t PACING_BURST_NS = Outbox::RETRANSMIT_BURST_FRAMES * NS_PER_RETRANSMITTED_FRAME;
+
+} // namespace
+
+Outbox::Outbox()
+    : m_messages(CAPACITY)
+{
+    m_free_slots.reserve(CAPACITY);
+    for (size_t slot = CAPACITY; slot > 0; slot -= 1) {
+        m_free_slots.push_back(slot - 1);
+    }
+}
+
+uint32_t Outbox::add(uint16_t module_uid, const CAN::Frame frames[], size_t frame_count)
+{
+    if (m_free_slots.empty()) {
+        return ACK::NO_TAG;
+    }
+
+    const uint16_t slot = m_free_slots.back();
+    m_free_slots.pop_back();
+
+    auto& message = m_messages[slot];
+    message.is_used = true;
+    message.is_waiting_to_retry = false;
+    message.generation += 1;
+    message.attempt = 0;
+    message.module_uid = module_uid;
+    message.unacknowledged = frame_count;
+    message.group_uid = frames[0].is_long_frame ? frames[0][0] : 0;
+    message.frames.assign(frames, &frames[frame_count]);
+
+    {
+        std::unique_lock<std::mutex> lock(m_stats_lock);
+        auto& module = module_state(module_uid);
+        module.stats.module_uid = module_uid;
+        module.stats.transmissions += 1;
+    }
+
+    return tag_for(slot, message);
+}
+
+Outbox::Message* Outbox::find_current(uint32_t tag, uint16_t* slot)
+{
+    *slot = tag >> 16;
+    if (tag == ACK::NO_TAG || *slot >= m_messages.size()) {
+        return nullptr;
+    }
+
+    auto& message = m_messages[*slot];
+
+    // Once a message is waiting to be sent again, only its next attempt counts.
+    if (!message.is_used || message.is_waiting_to_retry || tag_for(*slot, message) != tag) {
+        return nullptr;
+    }
+    return &message;
+}
+
+void Outbox::release(uint16_t slot)
+{
+    m_messages[slot].is_used = false;
+    m_free_slots.push_back(slot);
+}
+
+void Outbox::acknowledged(uint32_t tag)
+{
+    uint16_t slot = 0;
+    auto* message = find_current(tag, &slot);
+    if (!message) {
+        return;
+    }
+
+    message->unacknowledged -= 1;
+    if (message->unacknowledged > 0) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_stats_lock);
+        auto& module = module_state(message->module_uid);
+        module.stats.delivered += 1;
+        module.failures_in_a_row = 0;
+    }
+
+    release(slot);
+}
+
+bool Outbox::expired(uint32_t tag, uint64_t now_ns)
+{
+    uint16_t slot = 0;
+    auto* message = find_current(tag, &slot);
+    if (!message) {
+        // Another frame of the message already expired, or it's an old attempt.
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(m_stats_lock);
+    auto& module = module_state(message->module_uid);
+
+    module.stats.failed_transmissions += 1;
+    module.failures_in_a_row += 1;
+
+    if (message->attempt + 1 >= MAX_ATTEMPTS) {
+        module.stats.lost += 1;
+        release(slot);
+        return false;
+    }
+
+    // Doubles with every failure in a row, up to MAX_BACKOFF_NS.
+    const uint32_t doublings = module.failures_in_a_row - 1;
+    uint64_t backoff_ns = MAX_BACKOFF_NS;
+    if (doublings < 32 && (BASE_BACKOFF_NS << doublings) < MAX_BACKOFF_NS) {
+        backoff_ns = BASE_BACKOFF_NS << doublings;
+    }
+
+    const uint64_t ready_ns = std::max(now_ns + backoff_ns, module.next_retry_ns);
+    module.next_retry_ns = ready_ns + RETRY_SPACING_NS;
+
+    message->is_waiting_to_retry = true;
+    m_retries.push({ ready_ns, slot });
+
+    const uint64_t armed_ns = m_timer.deadline_ns();
+    if (armed_ns == 0 || armed_ns <= now_ns || ready_ns < armed_ns) {
+        m_timer.arm(ready_ns);
+    }
+    return true;
+}
+
+bool Outbox::next_due(uint64_t now_ns, Retransmission* retransmission)
+{
+    if (m_retries.empty()) {
+        m_timer.arm(0);
+        return false;
+    }
+
+    const auto retry = m_retries.top();
+    if (retry.ready_ns > now_ns) {
+        m_timer.arm(retry.ready_ns);
+        return false;
+    }
+
+    auto& message = m_messages[retry.slot];
+    const uint64_t frame_count = message.frames.size();
+
+    // The bucket may run up to a burst ahead of now, anything
+    // more waits until enough of it has drained.
+    const uint64_t pacing_ns = std::max(m_pacing_ns, now_ns);
+    if (pacing_ns + frame_count * NS_PER_RETRANSMITTED_FRAME > now_ns + PACING_BURST_NS) {
+        m_timer.arm(pacing_ns + frame_count * NS_PER_RETRANSMITTED_FRAME - PACING_BURST_NS);
+        return false;
+    }
+    m_pacing_ns = pacing_ns + frame_count * NS_PER_RETRANSMITTED_FRAME;
+
+    m_retries.pop();
+
+    message.is_waiting_to_retry = false;
+    message.attempt += 1;
+    message.unacknowledged = frame_count;
+
+    {
+        std::unique_lock<std::mutex> lock(m_stats_lock);
+        auto& module = module_state(message.module_uid);
+        module.stats.transmissions += 1;
+        module.stats.retransmitted_frames += frame_count;
+    }
+
+    retransmission->tag = tag_for(retry.slot, message);
+    retransmission->frames = message.frames.data();
+    retransmission->frame_count = frame_count;
+    return true;
+}
+
+bool Outbox::is_group_in_flight(uint16_t module_uid, uint8_t group_uid) const
+{
+    // Only asked when a long frame group is sent, which is rare enough to just look.
+    for (const auto& message : m_messages) {
+        if (message.is_used && message.group_uid == group_uid && message.module_uid == module_uid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Outbox::change_group_uid(uint32_t tag, uint8_t group_uid)
+{
+    uint16_t slot = 0;
+    auto* message = find_current(tag, &slot);
+    if (!message || message->group_uid == 0) {
+        return;
+    }
+
+    message->group_uid = group_uid;
+    for (auto& frame : message->frames) {
+        frame.data[0] = group_uid;
+    }
+}
+
+std::vector<ModuleLinkStats> Outbox::module_stats() const
+{
+    std::unique_lock<std::mutex> lock(m_stats_lock);
+
+    std::vector<ModuleLinkStats> stats;
+    stats.reserve(m_modules.size());
+    for (const auto& module : m_modules) {
+        stats.push_back(module.second.stats);
+    }
+    return stats;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <ACKHandler.h>
+#include <CanFrame.h>
+#include <DeadlineTimer.h>
+#include <mutex>
+#include <queue>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// How well we're getting through to a module.
+struct ModuleLinkStats {
+    uint16_t module_uid { 0 };
+    // Every time a message was sent, first tries and retries.
+    uint64_t transmissions { 0 };
+    // Transmissions where an ACK never came.
+    uint64_t failed_transmissions { 0 };
+    uint64_t retransmitted_frames { 0 };
+    uint64_t delivered { 0 };
+    // Messages we gave up on, after MAX_ATTEMPTS.
+    uint64_t lost { 0 };
+
+    double loss_rate() const { return transmissions ? static_cast<double>(failed_transmissions) / transmissions : 0.0; }
+};
+
+// Keeps a copy of every message (a single frame, or a whole long frame group)
+// we've sent and are waiting on ACKs for, so it can be sent again if they never come.
+
+// Every frame's ACK is waited on with the message's tag, once every frame of
+// a message is acknowledged it's forgotten. If any frame's ACK expires, the
+// whole message is sent again (a module can't rebuild half a long frame group),
+// after a backoff that doubles with every failure in a row to the same module.
+// After MAX_ATTEMPTS, we give up on the message.
+
+// Retries are paced twice, so a dead module can't flood the bus:
+// - A module's retries are atleast RETRY_SPACING_NS apart.
+// - Every retry shares RETRANSMIT_FRAMES_PER_SECOND, with a burst of one long frame group.
+
+// Only the thread handling frames may use an Outbox, except for module_stats().
+
+class Outbox {
+public:
+    static constexpr size_t CAPACITY = 256;
+    static constexpr uint8_t MAX_ATTEMPTS = 4;
+
+    static constexpr uint64_t BASE_BACKOFF_NS = 100ull * 1000 * 1000;
+    static constexpr uint64_t MAX_BACKOFF_NS = 10ull * 1000 * 1000 * 1000;
+    static constexpr uint64_t RETRY_SPACING_NS = 20ull * 1000 * 1000;
+
+    static constexpr uint64_t RETRANSMIT_FRAMES_PER_SECOND = 200;
+    static constexpr uint64_t RETRANSMIT_BURST_FRAMES = 38;
+
+    struct Retransmission {
+        uint32_t tag { ACK::NO_TAG };
+        const CAN::Frame* frames { nullptr };
+        size_t frame_count { 0 };
+    };
+
+    Outbox();
+    ~Outbox() = default;
+
+    Outbox(const Outbox&) = delete;
+    Outbox& operator=(const Outbox&) = delete;
+
+    // Keeps a copy of the frames, which all go to module_uid. Returns the tag
+    // every frame's ACK should be waited on with, or ACK::NO_TAG if we're full.
+    uint32_t add(uint16_t module_uid, const CAN::Frame frames[], size_t frame_count);
+
+    // Called for every ACK that came back, or expired, with a tag.
+    void acknowledged(uint32_t tag);
+    // Returns false if this was the last attempt, and the message is gone.
+    bool expired(uint32_t tag, uint64_t now_ns);
+
+    // Returns true, and fills in retransmission with the next message due to be sent
+    // again, every frame's ACK should be waited on with its new tag. Returns false
+    // once nothing is due (or pacing holds it back), and arms the timer for when something is.
+    bool next_due(uint64_t now_ns, Retransmission* retransmission);
+
+    // Readable once a retransmission is due, whoever owns the loop
+    // should read() it, and call next_due() until it returns false.
+    int32_t file_descriptor() const { return m_timer.file_descriptor(); }
+
+    // If a long frame group we sent module_uid with group_uid hasn't been acknowledged, or given up on.
+    bool is_group_in_flight(uint16_t module_uid, uint8_t group_uid) const;
+
+    // Gives the long frame group next_due() just handed out with tag a new group uid,
+    // in every one of its frames. A module appends frames to the group with the same
+    // uid, so if an attempt lost a frame, the next one can't reuse its uid.
+    void change_group_uid(uint32_t tag, uint8_t group_uid);
+
+    // Safe to call from any thread.
+    std::vector<ModuleLinkStats> module_stats() const;
+
+private:
+    struct Message {
+        bool is_used { false };
+        bool is_waiting_to_retry { false };
+        uint8_t generation { 0 };
+        uint8_t attempt { 0 };
+        uint16_t module_uid { 0 };
+        uint16_t unacknowledged { 0 };
+        // 0 if it's not a long frame group.
+        uint8_t group_uid { 0 };
+        std::vector<CAN::Frame> frames;
+    };
+
+    struct Retry {
+        uint64_t ready_ns;
+        uint16_t slot;
+
+        bool operator>(const Retry& other) const { return ready_ns > other.ready_ns; }
+    };
+
+    struct ModuleState {
+        ModuleLinkStats stats;
+        uint32_t failures_in_a_row { 0 };
+        uint64_t next_retry_ns { 0 };
+    };
+
+    // slot | generation | attempt, so ACKs for a message we've
+    // forgotten, or for an earlier attempt are ignored.
+    static uint32_t tag_for(uint16_t slot, const Message& message) { return (static_cast<uint32_t>(slot) << 16) | (message.generation << 8) | message.attempt; }
+    Message* find_current(uint32_t tag, uint16_t* slot);
+    void release(uint16_t slot);
+
+    // Caller holds m_stats_lock.
+    ModuleState& module_state(uint16_t module_uid) { return m_modules[module_uid]; }
+
+    std::vector<Message> m_messages;
+    std::vector<uint16_t> m_free_slots;
+
+    std::priority_queue<Retry, std::vector<Retry>, std::greater<Retry>> m_retries;
+
+    // Retries are paced like a leaky bucket, this is when it next runs
+    // dry, it may run up to a burst ahead of now.
+    uint64_t m_pacing_ns { 0 };
+
+    DeadlineTimer m_timer;
+
+    mutable std::mutex m_stats_lock;
+    std::unordered_map<uint16_t, ModuleState> m_modules;
+};
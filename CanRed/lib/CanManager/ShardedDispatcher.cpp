@@ -0,0 +1,237 @@
+#include "ShardedDispatcher.h"
+
+#include <algorithm>
+
+ShardedDispatcher::Shard::Shard(std::vector<AutomatoInterface*>& interfaces, ModuleRegistry& module_registry, SocketRequestTable& socket_requests)
+    : frames(SHARD_RING_CAPACITY, OverflowPolicy::Block, notifier)
+    , manager(interfaces, module_registry, socket_requests)
+{
+}
+
+bool ShardedDispatcher::Shard::has_work() const
+{
+    return !frames.is_empty() || has_jobs || should_stop;
+}
+
+void ShardedDispatcher::Shard::run()
+{
+    std::vector<CAN::Frame> batch;
+    batch.reserve(SHARD_RING_CAPACITY);
+
+    std::vector<Job> jobs_to_run;
+
+    for (;;) {
+        notifier.wait([this]() { return has_work(); });
+
+        if (should_stop) {
+            return;
+        }
+
+        CAN::Frame frame;
+        while (frames.pop(&frame)) {
+            batch.push_back(frame);
+        }
+
+        if (!batch.empty()) {
+            manager.handle_incoming_frames(batch.data(), batch.size());
+            batch.clear();
+        }
+
+        if (has_jobs) {
+            {
+                std::unique_lock<std::mutex> lock(jobs_lock);
+                jobs_to_run.swap(jobs);
+                has_jobs = false;
+            }
+
+            for (const auto& job : jobs_to_run) {
+                job(manager);
+            }
+            jobs_to_run.clear();
+        }
+    }
+}
+
+ShardedDispatcher::ShardedDispatcher(size_t shard_count, std::vector<AutomatoInterface*>& interfaces, ModuleRegistry& module_registry, SocketRequestTable& socket_requests)
+    : m_module_registry(module_registry)
+{
+    for (auto* interface : interfaces) {
+        m_locked_interfaces.emplace_back(new LockedInterface(*interface));
+        m_shared_interfaces.push_back(m_locked_interfaces.back().get());
+    }
+
+    for (size_t i = 0; i < (shard_count > 0 ? shard_count : 1); i += 1) {
+        m_shards.emplace_back(new Shard(m_shared_interfaces, module_registry, socket_requests));
+    }
+
+    // Only start the threads once every shard exists.
+    for (auto& shard : m_shards) {
+        auto* shard_pointer = shard.get();
+        shard->thread = std::thread([shard_pointer]() { shard_pointer->run(); });
+    }
+}
+
+ShardedDispatcher::~ShardedDispatcher()
+{
+    for (auto& shard : m_shards) {
+        shard->should_stop = true;
+        shard->notifier.notify();
+    }
+
+    for (auto& shard : m_shards) {
+        shard->thread.join();
+    }
+}
+
+void ShardedDispatcher::handle_incoming_frames(const CAN::Frame frames[], size_t frame_count)
+{
+    for (size_t i = 0; i < frame_count; i += 1) {
+        shard_for(frames[i].from_id).frames.push(frames[i]);
+    }
+}
+
+void ShardedDispatcher::post(uint16_t module_uid, const Job& job)
+{
+    auto& shard = shard_for(module_uid);
+
+    {
+        std::unique_lock<std::mutex> lock(shard.jobs_lock);
+        shard.jobs.push_back(job);
+        shard.has_jobs = true;
+    }
+
+    shard.notifier.notify();
+}
+
+std::vector<ProtocolHandlerStats> ShardedDispatcher::protocol_handler_stats() const
+{
+    // Every shard registers the same handlers, in the same order.
+    auto stats = m_shards.front()->manager.protocol_handler_stats();
+
+    for (size_t i = 1; i < m_shards.size(); i += 1) {
+        const auto shard_stats = m_shards[i]->manager.protocol_handler_stats();
+
+        for (size_t j = 0; j < stats.size() && j < shard_stats.size(); j += 1) {
+            stats[j].invocations += shard_stats[j].invocations;
+            stats[j].total_ns += shard_stats[j].total_ns;
+            stats[j].max_ns = std::max(stats[j].max_ns, shard_stats[j].max_ns);
+        }
+    }
+
+    return stats;
+}
+
+ACKStats ShardedDispatcher::ack_stats() const
+{
+    ACKStats stats;
+
+    for (const auto& shard : m_shards) {
+        const auto shard_stats = shard->manager.ack_stats();
+
+        stats.waiting_on += shard_stats.waiting_on;
+        stats.acknowledged += shard_stats.acknowledged;
+        stats.expired += shard_stats.expired;
+        stats.unexpected += shard_stats.unexpected;
+        stats.pending += shard_stats.pending;
+        stats.rtt_total_ns += shard_stats.rtt_total_ns;
+        stats.rtt_max_ns = std::max(stats.rtt_max_ns, shard_stats.rtt_max_ns);
+
+        for (size_t i = 0; i < ACKStats::RTT_BUCKET_COUNT; i += 1) {
+            stats.rtt_buckets[i] += shard_stats.rtt_buckets[i];
+        }
+    }
+
+    return stats;
+}
+
+std::vector<ModuleLinkStats> ShardedDispatcher::module_link_stats() const
+{
+    // Every module belongs to one shard, so there's nothing to add together.
+    std::vector<ModuleLinkStats> stats;
+
+    for (const auto& shard : m_shards) {
+        const auto shard_stats = shard->manager.module_link_stats();
+        stats.insert(stats.end(), shard_stats.begin(), shard_stats.end());
+    }
+
+    return stats;
+}
+
+LongFrameStats ShardedDispatcher::long_frame_stats() const
+{
+    LongFrameStats stats;
+
+    for (const auto& shard : m_shards) {
+        const auto shard_stats = shard->manager.long_frame_stats();
+
+        stats.in_flight += shard_stats.in_flight;
+        stats.completed += shard_stats.completed;
+        stats.evicted += shard_stats.evicted;
+        stats.pool_exhausted += shard_stats.pool_exhausted;
+        stats.overflowed += shard_stats.overflowed;
+    }
+
+    return stats;
+}
+
+std::vector<int32_t> ShardedDispatcher::ack_timer_file_descriptors() const
+{
+    std::vector<int32_t> file_descriptors;
+    for (const auto& shard : m_shards) {
+        const auto shard_file_descriptors = shard->manager.ack_timer_file_descriptors();
+        file_descriptors.insert(file_descriptors.end(), shard_file_descriptors.begin(), shard_file_descriptors.end());
+    }
+    return file_descriptors;
+}
+
+void ShardedDispatcher::check_for_old_acks()
+{
+    // Every shard is waiting on its own ACKs.
+    for (size_t i = 0; i < m_shards.size(); i += 1) {
+        post(i, [](CanManager& manager) { manager.check_for_old_acks(); });
+    }
+}
+
+void ShardedDispatcher::expire_socket_requests()
+{
+    // Every shard shares the same SocketRequestTable, so the first one
+    // expires everything, but each one holds its own waiting requests.
+    for (size_t i = 0; i < m_shards.size(); i += 1) {
+        post(i, [](CanManager& manager) { manager.expire_socket_requests(); });
+    }
+}
+
+void ShardedDispatcher::update_events(std::vector<EventUpdate>& updates_needed)
+{
+    for (const auto& update : updates_needed) {
+        post(update.module_uid, [update](CanManager& manager) {
+            std::vector<EventUpdate> updates { update };
+            manager.update_events(updates);
+        });
+    }
+    updates_needed.clear();
+}
+
+void ShardedDispatcher::inject_frame(const CAN::Frame& frame)
+{
+    post(frame.to_id, [frame](CanManager& manager) { manager.inject_frame(frame); });
+}
+
+void ShardedDispatcher::parse_socket_input(std::vector<SocketRequest>& socket_requests, std::mutex& socket_requests_lock)
+{
+    std::vector<SocketRequest> new_requests;
+    {
+        std::unique_lock<std::mutex> lock(socket_requests_lock);
+        new_requests.swap(socket_requests);
+    }
+
+    for (auto& request : new_requests) {
+        // We need to know which module it's for, before
+        // we know which shard to give it to.
+        if (!CanManager::resolve_socket_request(m_module_registry, request)) {
+            continue;
+        }
+
+        post(request.module_uid, [request](CanManager& manager) { manager.send_socket_request(request); });
+    }
+}
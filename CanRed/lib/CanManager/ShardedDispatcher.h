@@ -0,0 +1,97 @@
+#pragma once
+
+#include <CanManager.h>
+#include <EventNotifier.h>
+#include <FrameRing.h>
+#include <LockedInterface.h>
+#include <ModuleRegistry.h>
+#include <SocketRequestTable.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Spreads frame handling across several worker threads (shards).
+// Every module is owned by exactly one shard, picked by its uid, and every
+// frame from a module is handled by that shard, in the order it arrived.
+// Each shard has its own CanManager, so long frame reassembly and
+// ACK tracking never leave the shard.
+
+// Anything that sends frames to a module (events, socket requests, injected
+// frames) runs on the shard that owns the module, so the ACK it gets back
+// lands in the same ACKHandler that is waiting on it.
+
+// State every shard needs is shared through the ModuleRegistry,
+// the SocketRequestTable, and the (locked) Database.
+
+// Offers the same functions as CanManager, so the main loops can use either.
+// They must all be called from the same thread.
+
+class ShardedDispatcher {
+public:
+    using Job = std::function<void(CanManager&)>;
+
+    ShardedDispatcher(size_t shard_count, std::vector<AutomatoInterface*>& interfaces, ModuleRegistry& module_registry, SocketRequestTable& socket_requests);
+    ~ShardedDispatcher();
+
+    ShardedDispatcher(const ShardedDispatcher&) = delete;
+    ShardedDispatcher& operator=(const ShardedDispatcher&) = delete;
+
+    void handle_incoming_frames(const CAN::Frame frames[], size_t frame_count);
+
+    void check_for_old_acks();
+    // One per shard.
+    std::vector<int32_t> ack_timer_file_descriptors() const;
+    void update_events(std::vector<EventUpdate>& updates_needed);
+    void inject_frame(const CAN::Frame& frame);
+    void parse_socket_input(std::vector<SocketRequest>& socket_requests, std::mutex& socket_requests_lock);
+    void expire_socket_requests();
+
+    // Runs job on the thread of the shard that owns module_uid.
+    void post(uint16_t module_uid, const Job& job);
+
+    // Every shard's protocol handler stats, added together.
+    std::vector<ProtocolHandlerStats> protocol_handler_stats() const;
+    ACKStats ack_stats() const;
+    std::vector<ModuleLinkStats> module_link_stats() const;
+    LongFrameStats long_frame_stats() const;
+
+    size_t shard_count() const { return m_shards.size(); }
+
+private:
+    // Frames waiting on a shard is bounded, when it's full
+    // we wait, since dropping a frame would break ordering.
+    static constexpr size_t SHARD_RING_CAPACITY = 4096;
+
+    struct Shard {
+        Shard(std::vector<AutomatoInterface*>& interfaces, ModuleRegistry& module_registry, SocketRequestTable& socket_requests);
+
+        void run();
+        bool has_work() const;
+
+        EventNotifier notifier;
+        FrameRing frames;
+
+        std::mutex jobs_lock;
+        std::vector<Job> jobs;
+        std::atomic<bool> has_jobs { false };
+
+        std::atomic<bool> should_stop { false };
+
+        CanManager manager;
+        std::thread thread;
+    };
+
+    Shard& shard_for(uint16_t module_uid) { return *m_shards[module_uid % m_shards.size()]; }
+
+    // Socket requests are resolved before we know which shard they go to.
+    ModuleRegistry& m_module_registry;
+
+    // Every shard sends through the same interfaces.
+    std::vector<std::unique_ptr<LockedInterface>> m_locked_interfaces;
+    std::vector<AutomatoInterface*> m_shared_interfaces;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
@@ -0,0 +1,194 @@
+#include "CaptureLog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <get_monotonic_time_ns.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Capture {
+
+namespace {
+
+const char MAGIC[8] = { 'C', 'A', 'N', 'R', 'C', 'A', 'P', '\0' };
+
+bool write_all(int32_t file_descriptor, const uint8_t bytes[], size_t size)
+{
+    size_t bytes_written = 0;
+    while (bytes_written < size) {
+        auto rc = write(file_descriptor, &bytes[bytes_written], size - bytes_written);
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes_written += rc;
+    }
+    return true;
+}
+
+} // namespace
+
+Writer::~Writer()
+{
+    if (m_file_descriptor == -1) {
+        return;
+    }
+
+    flush();
+    close(m_file_descriptor);
+}
+
+bool Writer::open(const std::string& filename)
+{
+    m_file_descriptor = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (m_file_descriptor == -1) {
+        fmt::print("Capture: Could not open {}: {}\n", filename, strerror(errno));
+        return false;
+    }
+
+    struct stat file_info;
+    fstat(m_file_descriptor, &file_info);
+
+    if (file_info.st_size == 0) {
+        uint8_t header[HEADER_SIZE] = { 0 };
+        const uint16_t version = VERSION;
+        const uint16_t record_size = RECORD_SIZE;
+
+        memcpy(&header[0], MAGIC, sizeof(MAGIC));
+        memcpy(&header[8], &version, 2);
+        memcpy(&header[10], &record_size, 2);
+
+        if (!write_all(m_file_descriptor, header, HEADER_SIZE)) {
+            fmt::print("Capture: Could not write to {}: {}\n", filename, strerror(errno));
+            return false;
+        }
+    }
+
+    m_buffer.reserve(RECORDS_PER_WRITE * RECORD_SIZE);
+    return true;
+}
+
+void Writer::record(Direction direction, uint8_t interface_id, const CAN::Frame& frame)
+{
+    uint8_t record[RECORD_SIZE] = { 0 };
+
+    const uint64_t timestamp_ns = get_monotonic_time_ns();
+    const uint32_t can_id = frame.formatted_can_id();
+
+    memcpy(&record[0], &timestamp_ns, 8);
+    memcpy(&record[8], &can_id, 4);
+    record[12] = frame.can_dlc;
+    record[13] = static_cast<uint8_t>(direction);
+    record[14] = interface_id;
+    memcpy(&record[16], frame.data, frame.can_dlc <= 8 ? frame.can_dlc : 8);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    m_buffer.insert(m_buffer.end(), record, &record[RECORD_SIZE]);
+
+    if (m_buffer.size() >= RECORDS_PER_WRITE * RECORD_SIZE) {
+        flush_locked();
+    }
+}
+
+void Writer::flush()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    flush_locked();
+}
+
+void Writer::flush_locked()
+{
+    if (m_buffer.empty() || m_file_descriptor == -1) {
+        return;
+    }
+
+    if (!write_all(m_file_descriptor, m_buffer.data(), m_buffer.size())) {
+        fmt::print("Capture: Failed to write {} records: {}\n", m_buffer.size() / RECORD_SIZE, strerror(errno));
+    } else {
+        m_records_written.store(m_records_written.load(std::memory_order_relaxed) + m_buffer.size() / RECORD_SIZE, std::memory_order_relaxed);
+    }
+
+    m_buffer.clear();
+}
+
+Reader::~Reader()
+{
+    if (m_mapping) {
+        munmap(const_cast<uint8_t*>(m_mapping), m_mapping_size);
+    }
+}
+
+bool Reader::open(const std::string& filename)
+{
+    int32_t file_descriptor = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (file_descriptor == -1) {
+        fmt::print("Capture: Could not open {}: {}\n", filename, strerror(errno));
+        return false;
+    }
+
+    struct stat file_info;
+    fstat(file_descriptor, &file_info);
+
+    if (static_cast<size_t>(file_info.st_size) < HEADER_SIZE) {
+        fmt::print("Capture: {} is too small to be a capture log\n", filename);
+        close(file_descriptor);
+        return false;
+    }
+
+    m_mapping_size = file_info.st_size;
+    void* mapping = mmap(nullptr, m_mapping_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+
+    if (mapping == MAP_FAILED) {
+        fmt::print("Capture: Could not mmap {}: {}\n", filename, strerror(errno));
+        return false;
+    }
+
+    m_mapping = static_cast<const uint8_t*>(mapping);
+
+    uint16_t version = 0;
+    uint16_t record_size = 0;
+    memcpy(&version, &m_mapping[8], 2);
+    memcpy(&record_size, &m_mapping[10], 2);
+
+    if (memcmp(m_mapping, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || record_size != RECORD_SIZE) {
+        fmt::print("Capture: {} is not a version {} capture log\n", filename, VERSION);
+        return false;
+    }
+
+    // A partially written record at the end (eg: we crashed) is ignored.
+    m_record_count = (m_mapping_size - HEADER_SIZE) / RECORD_SIZE;
+
+    // We read the file front to back.
+    madvise(mapping, m_mapping_size, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+Record Reader::at(size_t index) const
+{
+    const uint8_t* bytes = &m_mapping[HEADER_SIZE + index * RECORD_SIZE];
+
+    Record record;
+
+    uint32_t can_id = 0;
+    memcpy(&record.timestamp_ns, &bytes[0], 8);
+    memcpy(&can_id, &bytes[8], 4);
+    record.direction = static_cast<Direction>(bytes[13]);
+    record.interface_id = bytes[14];
+
+    const uint8_t can_dlc = bytes[12] <= 8 ? bytes[12] : 8;
+    record.frame = CAN::Frame(CAN::ID(can_id), &bytes[16], can_dlc);
+
+    return record;
+}
+
+} // namespace Capture
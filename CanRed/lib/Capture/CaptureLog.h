@@ -0,0 +1,105 @@
+#pragma once
+
+#include <CanFrame.h>
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Capture Log Format:
+// A 16 byte header, followed by fixed size 24 byte records, so the
+// file can be mmap()'d and any record found without reading the others.
+// Everything is little endian.
+
+// Header:
+// byte[0..7]: "CANRCAP\0"
+// byte[8..9]: format version
+// byte[10..11]: record size
+// byte[12..15]: reserved
+
+// Record:
+// byte[0..7]: CLOCK_MONOTONIC timestamp, in nanoseconds
+// byte[8..11]: can_id, as given by CAN::ID::formatted_can_id()
+// byte[12]: can_dlc
+// byte[13]: CaptureDirection
+// byte[14]: interface id, the interface's index in CanRed
+// byte[15]: reserved
+// byte[16..23]: frame data, zero padded
+
+namespace Capture {
+
+constexpr uint16_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t RECORD_SIZE = 24;
+
+enum class Direction : uint8_t {
+    Received = 0,
+    Sent = 1,
+};
+
+struct Record {
+    uint64_t timestamp_ns { 0 };
+    Direction direction { Direction::Received };
+    uint8_t interface_id { 0 };
+    CAN::Frame frame;
+};
+
+// Appends records to a capture log, safe to use from any thread.
+// Records are buffered, and written out once enough have piled up.
+class Writer {
+public:
+    Writer() = default;
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Opens (or creates) filename, appending to it if it already
+    // holds a capture. Returns false on error.
+    bool open(const std::string& filename);
+
+    void record(Direction direction, uint8_t interface_id, const CAN::Frame& frame);
+
+    // Writes every buffered record to the file.
+    void flush();
+
+    // Safe to call from any thread.
+    uint64_t records_written() const { return m_records_written.load(std::memory_order_relaxed); }
+
+private:
+    // Records buffered before we write() them out.
+    static constexpr size_t RECORDS_PER_WRITE = 256;
+
+    void flush_locked();
+
+    std::mutex m_lock;
+    std::vector<uint8_t> m_buffer;
+    // Only written while holding m_lock.
+    std::atomic<uint64_t> m_records_written { 0 };
+    int32_t m_file_descriptor { -1 };
+};
+
+// Reads a capture log, by mmap()'ing the entire file.
+class Reader {
+public:
+    Reader() = default;
+    ~Reader();
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // Returns false if the file can't be read, or isn't a capture log.
+    bool open(const std::string& filename);
+
+    size_t size() const { return m_record_count; }
+    Record at(size_t index) const;
+
+private:
+    const uint8_t* m_mapping { nullptr };
+    size_t m_mapping_size { 0 };
+    size_t m_record_count { 0 };
+};
+
+} // namespace Capture
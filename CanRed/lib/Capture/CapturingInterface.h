@@ -0,0 +1,61 @@
+#pragma once
+
+#include "CaptureLog.h"
+
+#include <AutomatoInterface.h>
+
+// Records every frame read from, or sent through, an interface
+// into a capture log, and otherwise acts exactly like it.
+
+class CapturingInterface : public AutomatoInterface {
+public:
+    CapturingInterface(AutomatoInterface& interface, uint8_t interface_id, Capture::Writer& writer)
+        : m_interface(interface)
+        , m_interface_id(interface_id)
+        , m_writer(writer)
+    {
+    }
+    ~CapturingInterface() = default;
+
+    bool read_frame(CAN::Frame* frame) override
+    {
+        if (!m_interface.read_frame(frame)) {
+            return false;
+        }
+
+        m_writer.record(Capture::Direction::Received, m_interface_id, *frame);
+        return true;
+    }
+
+    size_t read_frames(std::vector<CAN::Frame>& frames) override
+    {
+        const size_t starting_size = frames.size();
+        const size_t frames_read = m_interface.read_frames(frames);
+
+        for (size_t i = starting_size; i < frames.size(); i += 1) {
+            m_writer.record(Capture::Direction::Received, m_interface_id, frames[i]);
+        }
+        return frames_read;
+    }
+
+    bool send_frame(const CAN::Frame& frame) override
+    {
+        m_writer.record(Capture::Direction::Sent, m_interface_id, frame);
+        return m_interface.send_frame(frame);
+    }
+
+    size_t send_frames(const CAN::Frame frames[], size_t frame_count) override
+    {
+        for (size_t i = 0; i < frame_count; i += 1) {
+            m_writer.record(Capture::Direction::Sent, m_interface_id, frames[i]);
+        }
+        return m_interface.send_frames(frames, frame_count);
+    }
+
+    int32_t file_descriptor() const override { return m_interface.file_descriptor(); }
+
+private:
+    AutomatoInterface& m_interface;
+    uint8_t m_interface_id;
+    Capture::Writer& m_writer;
+};
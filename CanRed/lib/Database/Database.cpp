@@ -1,37 +1,137 @@
 #include "Database.h"
 
+#include <Migrations.h>
 #include <get_env_var.h>
 
+namespace {
+
+// Only written while holding the database lock, so there's no need for an atomic add.
+void increment(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
 Database::~Database()
 {
+    for (auto& entry : m_statement_cache) {
+        for (auto* statement : entry.second) {
+            sqlite3_finalize(statement);
+        }
+    }
+
     sqlite3_close_v2(m_sqlite_instance);
 }
 
 Database& Database::the()
 {
-    static Database m_the;
+    static Database m_the(true);
     return m_the;
 }
 
 SqliteQuery Database::prepare(const std::string& query) const
 {
-    return SqliteQuery(m_sqlite_instance, query);
+    std::unique_lock<std::recursive_mutex> lock(m_lock);
+
+    auto& free_statements = m_statement_cache[query];
+    if (!free_statements.empty()) {
+        auto* statement = free_statements.back();
+        free_statements.pop_back();
+
+        increment(m_statement_cache_hits);
+        return SqliteQuery(statement, &free_statements, std::move(lock));
+    }
+
+    increment(m_statement_cache_misses);
+
+    sqlite3_stmt* statement = nullptr;
+    if (sqlite3_prepare_v2(m_sqlite_instance, query.c_str(), query.size(), &statement, nullptr) != SQLITE_OK) {
+        fmt::print(fmt::fg(fmt::terminal_color::red), "Database: Failed to prepare \"{}\": {}\n", query, sqlite3_errmsg(m_sqlite_instance));
+        // Not worth caching, it'll fail again.
+        return SqliteQuery(statement, nullptr, std::move(lock));
+    }
+
+    increment(m_statements_cached);
+    return SqliteQuery(statement, &free_statements, std::move(lock));
+}
+
+std::vector<std::string> Database::cached_queries() const
+{
+    std::unique_lock<std::recursive_mutex> lock(m_lock);
+
+    std::vector<std::string> queries;
+    for (const auto& entry : m_statement_cache) {
+        queries.push_back(entry.first);
+    }
+    return queries;
+}
+
+StatementCacheStats Database::statement_cache_stats() const
+{
+    StatementCacheStats stats;
+    stats.hits = m_statement_cache_hits.load(std::memory_order_relaxed);
+    stats.misses = m_statement_cache_misses.load(std::memory_order_relaxed);
+    stats.cached = m_statements_cached.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool Database::begin_transaction()
+{
+    // Held until the matching commit_transaction().
+    m_lock.lock();
+
+    if (m_transaction_depth++ > 0) {
+        return true;
+    }
+
+    // IMMEDIATE takes the write lock now, rather than at our first write, where
+    // if another connection had written since we started, we'd fail with SQLITE_BUSY.
+    if (sqlite3_exec(m_sqlite_instance, "BEGIN IMMEDIATE", nullptr, 0, nullptr) != SQLITE_OK) {
+        fmt::print("Database: BEGIN failed: {}\n", sqlite3_errmsg(m_sqlite_instance));
+        m_transaction_depth -= 1;
+        m_lock.unlock();
+        return false;
+    }
+    return true;
 }
 
-Database::Database()
+bool Database::commit_transaction()
+{
+    assert(m_transaction_depth > 0);
+
+    bool did_commit = true;
+    if (--m_transaction_depth == 0 && sqlite3_exec(m_sqlite_instance, "COMMIT", nullptr, 0, nullptr) != SQLITE_OK) {
+        fmt::print("Database: COMMIT failed: {}\n", sqlite3_errmsg(m_sqlite_instance));
+        // Otherwise the transaction stays open, and every later query joins it.
+        sqlite3_exec(m_sqlite_instance, "ROLLBACK", nullptr, 0, nullptr);
+        did_commit = false;
+    }
+
+    m_lock.unlock();
+    return did_commit;
+}
+
+Database::Database(bool should_migrate)
 {
     m_database_file = get_env_var(ENV::DB_FILE);
-    
-    // TODO: Not hardcode this, and compile it into the program.
-    m_schema_file = "./schema.sql";
 
     sqlite3_open(m_database_file.c_str(), &m_sqlite_instance);
 
-    std::fstream file(m_schema_file, std::fstream::in);
-    assert(file.is_open());
+    // Only one connection can write at a time, wait for the others, rather than failing.
+    sqlite3_busy_timeout(m_sqlite_instance, BUSY_TIMEOUT_MS);
+
+    if (!should_migrate) {
+        return;
+    }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
+    // This can't be a migration, since it can't be changed inside of a transaction.
+    // It's stored in the database, so it only does anything the first time.
+    // https://sqlite.org/wal.html
+    sqlite3_exec(m_sqlite_instance, "PRAGMA journal_mode=WAL", nullptr, 0, nullptr);
 
-    sqlite3_exec(m_sqlite_instance, buffer.str().c_str(), nullptr, 0, nullptr);
-}
\ No newline at end of file
+    if (!Migrations::run(m_sqlite_instance)) {
+        // Nothing we run would work against a schema we don't know.
+        exit(1);
+    }
+}
@@ -1,25 +1,83 @@
 #pragma once
 
 #include <SqliteQuery.h>
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sqlite3.h>
 #include <string>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
+
+struct StatementCacheStats {
+    uint64_t hits { 0 };
+    uint64_t misses { 0 };
+    // Statements the cache owns, whether they're in use or not.
+    uint64_t cached { 0 };
+};
+
+class DatabaseWriter;
+
+// A connection to the database. The database is in WAL mode, so
+// every connection reads without waiting on the one that's writing.
 
 class Database {
 public:
+    static constexpr int32_t BUSY_TIMEOUT_MS = 5000;
+
     ~Database();
 
+    // The connection every thread reads through, see DatabaseWriter for writes.
     static Database& the();
 
+    // The returned query keeps the database locked until it's destroyed,
+    // so it's safe to use from any thread, but don't hold onto it.
+    // Statements are cached by their SQL, so only the first prepare() of a query
+    // compiles it, afterwards it's handed out again, reset with its bindings cleared.
+    // Every query should be a constant string, or the cache grows without bound.
     SqliteQuery prepare(const std::string& query) const;
 
+    // Safe to call from any thread.
+    StatementCacheStats statement_cache_stats() const;
+
+    // The SQL of every query that's been prepared, for query_plan_check.
+    std::vector<std::string> cached_queries() const;
+
+    // Groups every query until the matching commit_transaction()
+    // into a single transaction, so we only hit the disk once.
+    // Transactions can be nested, only the outermost one is real.
+    // Other threads can't use the database until it's committed,
+    // and it has to be committed from the thread that began it.
+    // Returns false if BEGIN failed, most likely with SQLITE_BUSY, since another
+    // connection was writing for longer than BUSY_TIMEOUT_MS, in which case
+    // there's no transaction, and commit_transaction() mustn't be called.
+    bool begin_transaction();
+    // Returns false if the transaction failed to commit.
+    bool commit_transaction();
+
 private:
-    Database();
+    friend class DatabaseWriter;
+
+    // Only the() migrates the database, every other connection is opened after it.
+    explicit Database(bool should_migrate);
 
     sqlite3* m_sqlite_instance;
 
+    // Recursive, so a thread inside of a transaction can still prepare().
+    mutable std::recursive_mutex m_lock;
+    uint32_t m_transaction_depth { 0 };
+
+    // SQL -> statements for it that aren't in use. There's usually just one,
+    // more if a thread prepares the same query while it still has one.
+    // Only touched while holding m_lock.
+    mutable std::unordered_map<std::string, std::vector<sqlite3_stmt*>> m_statement_cache;
+
+    // Only written while holding m_lock.
+    mutable std::atomic<uint64_t> m_statement_cache_hits { 0 };
+    mutable std::atomic<uint64_t> m_statement_cache_misses { 0 };
+    mutable std::atomic<uint64_t> m_statements_cached { 0 };
+
     std::string m_database_file;
-    std::string m_schema_file;
 };
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "DatabaseWriter.h"
+
+#include <chrono>
+
+namespace {
+
+// Only one thread writes these, so there's no need for an atomic add.
+void add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+} // namespace
+
+DatabaseWriter& DatabaseWriter::the()
+{
+    // The database has to be migrated before we open our connection,
+    // this also makes sure we're destroyed before Database::the().
+    Database::the();
+
+    static DatabaseWriter m_the;
+    return m_the;
+}
+
+DatabaseWriter::DatabaseWriter()
+    : m_database(false)
+{
+    m_thread = std::thread([this]() { run(); });
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_should_stop = true;
+    }
+    m_queue_changed.notify_all();
+
+    // Everything still queued is written before the thread returns.
+    m_thread.join();
+}
+
+void DatabaseWriter::enqueue(Run run, std::unique_ptr<std::promise<bool>> completion)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_waiters += completion != nullptr;
+        m_queue.push_back(Write { std::move(run), std::move(completion) });
+        m_queued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Anyone in flush() waits on this too, so everyone has to be woken.
+    m_queue_changed.notify_all();
+}
+
+void DatabaseWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_queue.empty() && m_in_progress == 0) {
+        return;
+    }
+
+    // Ends the group window, there's no point in waiting for more writes.
+    m_waiters += 1;
+    m_queue_changed.notify_all();
+
+    m_queue_changed.wait(lock, [this]() { return m_queue.empty() && m_in_progress == 0; });
+    m_waiters -= 1;
+}
+
+DatabaseWriterStats DatabaseWriter::stats() const
+{
+    DatabaseWriterStats stats;
+    stats.queued = m_queued.load(std::memory_order_relaxed);
+    stats.written = m_written.load(std::memory_order_relaxed);
+    stats.failed = m_failed.load(std::memory_order_relaxed);
+    stats.groups = m_groups.load(std::memory_order_relaxed);
+    stats.largest_group = m_largest_group.load(std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    stats.pending = m_queue.size() + m_in_progress;
+    return stats;
+}
+
+void DatabaseWriter::run()
+{
+    std::deque<Write> group;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_queue_changed.wait(lock, [this]() { return !m_queue.empty() || m_should_stop; });
+
+            if (m_queue.empty()) {
+                // We're stopping, and everything has been written.
+                return;
+            }
+
+            // Give the writes right behind the first one a chance to join its group.
+            const auto window_end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(GROUP_WINDOW_NS + 0);
+            m_queue_changed.wait_until(lock, window_end, [this]() { return m_queue.size() >= MAX_GROUP_SIZE || m_waiters > 0 || m_should_stop; });
+
+            while (!m_queue.empty() && group.size() < MAX_GROUP_SIZE) {
+                m_waiters -= m_queue.front().completion != nullptr;
+                group.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+            m_in_progress = group.size();
+        }
+
+        commit_group(group);
+        group.clear();
+
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_in_progress = 0;
+        }
+        m_queue_changed.notify_all();
+    }
+}
+
+void DatabaseWriter::fail_group(std::deque<Write>& group)
+{
+    for (auto& write : group) {
+        if (write.completion) {
+            write.completion->set_value(false);
+        }
+    }
+
+    add(m_failed, group.size());
+}
+
+void DatabaseWriter::commit_group(std::deque<Write>& group)
+{
+    // Which writes failed, a failed write doesn't stop the rest of its group.
+    std::vector<bool> succeeded(group.size(), false);
+
+    // BEGIN is only busy if another connection has been writing for longer than
+    // BUSY_TIMEOUT_MS, like read_changes() during a big deploy. Nothing in the group
+    // has run yet, so it's tried again, rather than running every write on its own.
+    while (!m_database.begin_transaction()) {
+        if (sqlite3_errcode(m_database.m_sqlite_instance) != SQLITE_BUSY) {
+            fail_group(group);
+            return;
+        }
+    }
+
+    size_t written = 0;
+    for (size_t i = 0; i < group.size(); i += 1) {
+        succeeded[i] = group[i].run(m_database);
+        written += succeeded[i];
+    }
+
+    const bool did_commit = m_database.commit_transaction();
+
+    for (size_t i = 0; i < group.size(); i += 1) {
+        if (group[i].completion) {
+            group[i].completion->set_value(did_commit && succeeded[i]);
+        }
+    }
+
+    if (!did_commit) {
+        written = 0;
+    }
+
+    add(m_written, written);
+    add(m_failed, group.size() - written);
+    add(m_groups, 1);
+
+    if (group.size() > m_largest_group.load(std::memory_order_relaxed)) {
+        m_largest_group.store(group.size(), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <Database.h>
+#include <TypedQuery.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+
+struct DatabaseWriterStats {
+    uint64_t queued { 0 };
+    uint64_t written { 0 };
+    uint64_t failed { 0 };
+    // Transactions committed, every one is a single sync to disk.
+    uint64_t groups { 0 };
+    uint64_t largest_group { 0 };
+    // Writes waiting to be run.
+    uint64_t pending { 0 };
+};
+
+// Runs writes on its own thread, with its own connection, so a slow disk
+// never holds up whoever asked for the write, like the thread handling frames.
+
+// Writes are committed in groups, a group starts with the first write
+// that's queued, and takes every write queued within GROUP_WINDOW_NS,
+// up to MAX_GROUP_SIZE, and is committed as a single transaction.
+// Nobody waits out the window, it ends as soon as there's someone
+// waiting on a write, or in flush(), with whatever's queued by then.
+
+// Reads don't go through us, they stay on the caller, through Database::the(),
+// which can read while we write, since the database is in WAL mode.
+// A read only sees a write once its group is committed, callers that
+// need to know when that is can wait on the future write_with_completion() returns.
+
+// Safe to use from any thread.
+
+class DatabaseWriter {
+public:
+    static constexpr size_t MAX_GROUP_SIZE = 256;
+    static constexpr uint64_t GROUP_WINDOW_NS = 5ull * 1000 * 1000;
+
+    static DatabaseWriter& the();
+
+    ~DatabaseWriter();
+
+    DatabaseWriter(const DatabaseWriter&) = delete;
+    DatabaseWriter& operator=(const DatabaseWriter&) = delete;
+
+    // Queues query to be run with params. The query has to outlive
+    // the write, which they do, since they're all declared once.
+    // Params only come from the query, so arguments convert to them, like with TypedQuery::run().
+    template<typename... Params>
+    void write(const TypedQuery<void, Params...>& query, const typename std::decay<Params>::type&... params)
+    {
+        enqueue(bind(query, params...), nullptr);
+    }
+
+    // Like write(), the future is true once the write's group is committed,
+    // or false if the write, or its group failed.
+    template<typename... Params>
+    std::future<bool> write_with_completion(const TypedQuery<void, Params...>& query, const typename std::decay<Params>::type&... params)
+    {
+        std::unique_ptr<std::promise<bool>> completion(new std::promise<bool>());
+        auto future = completion->get_future();
+
+        enqueue(bind(query, params...), std::move(completion));
+        return future;
+    }
+
+    // Blocks until everything queued so far is committed.
+    void flush();
+
+    DatabaseWriterStats stats() const;
+
+    // Like Database::cached_queries(), for our connection.
+    std::vector<std::string> cached_queries() const { return m_database.cached_queries(); }
+
+private:
+    using Run = std::function<bool(const Database&)>;
+
+    struct Write {
+        Run run;
+        // nullptr if nobody is waiting on it.
+        std::unique_ptr<std::promise<bool>> completion;
+    };
+
+    DatabaseWriter();
+
+    template<typename... Params>
+    static Run bind(const TypedQuery<void, Params...>& query, const typename std::decay<Params>::type&... params)
+    {
+        const auto* query_pointer = &query;
+        return [query_pointer, params...](const Database& database) {
+            return query_pointer->run_on(database, params...);
+        };
+    }
+
+    void enqueue(Run run, std::unique_ptr<std::promise<bool>> completion);
+    void run();
+    void commit_group(std::deque<Write>& group);
+    // Completes every write in the group as failed.
+    void fail_group(std::deque<Write>& group);
+
+    // Our own connection, only used by m_thread.
+    Database m_database;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_queue_changed;
+    std::deque<Write> m_queue;
+    // Writes taken off the queue, that aren't committed yet.
+    size_t m_in_progress { 0 };
+    // Queued writes with a completion, and threads in flush().
+    size_t m_waiters { 0 };
+    bool m_should_stop { false };
+
+    // Only written by m_thread, except for m_queued.
+    std::atomic<uint64_t> m_queued { 0 };
+    std::atomic<uint64_t> m_written { 0 };
+    std::atomic<uint64_t> m_failed { 0 };
+    std::atomic<uint64_t> m_groups { 0 };
+    std::atomic<uint64_t> m_largest_group { 0 };
+
+    std::thread m_thread;
+};
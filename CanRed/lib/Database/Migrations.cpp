@@ -0,0 +1,190 @@
+#include "Migrations.h"
+
+#include <fmt/color.h>
+#include <fmt/format.h>
+
+namespace Migrations {
+
+namespace {
+
+// In order, every version is one more than the one before it.
+const Migration MIGRATIONS[] = {
+    // What schema.sql was, which was run on every start, so a database made with it is
+    // at user_version 0, and already has these tables, which is why they're IF NOT EXISTS.
+    { 1, "Initial schema", R"(
+-- Table to store all current can modules
+CREATE TABLE IF NOT EXISTS can_modules (
+    rowid INTEGER PRIMARY KEY AUTOINCREMENT,
+    uid INTEGER NOT NULL UNIQUE,
+    -- uuid TEXT | Not Currently Implemented
+    is_active TEXT DEFAULT "TRUE" CHECK(is_active IN ("TRUE", "FALSE")),
+    type TEXT CHECK(type IN ("READER", "WRITER")),
+    name TEXT NOT NULL,
+    description TEXT
+);
+
+-- Table to store commands on modules
+CREATE TABLE IF NOT EXISTS can_module_commands (
+    rowid INTEGER PRIMARY KEY AUTOINCREMENT,
+    module_uid INTEGER NOT NULL,
+    command_uid INTEGER NOT NULL,
+    -- action TEXT CHECK(action IN ("READ", "WRITE")) NOT NULL,
+    name TEXT NOT NULL,
+    return_format TEXT NOT NULL,
+
+    FOREIGN KEY(module_uid) REFERENCES can_modules(uid)
+);
+
+-- The hash of the last descriptor each module sent us, if it
+-- checks in with the same hash, we don't ask for its descriptor again.
+CREATE TABLE IF NOT EXISTS can_module_descriptor_hashes (
+    module_uid INTEGER PRIMARY KEY,
+    descriptor_hash INTEGER NOT NULL,
+
+    FOREIGN KEY(module_uid) REFERENCES can_modules(uid)
+);
+
+-- Maybe convert this to a WITHOUT ROWID table
+CREATE TABLE IF NOT EXISTS broadcast_flows (
+    rowid INTEGER PRIMARY KEY AUTOINCREMENT,
+    flow_name TEXT NOT NULL,
+    flow_id INTEGER NOT NULL,
+    is_active TEXT DEFAULT "TRUE" CHECK(is_active IN ("TRUE", "FALSE"))
+);
+
+CREATE TABLE IF NOT EXISTS broadcast_events (
+    rowid INTEGER PRIMARY KEY AUTOINCREMENT,
+    flow_id INTEGER NOT NULL,
+    flow_name TEXT NOT NULL,
+    module_uid INTEGER NOT NULL,
+    event_blob BLOB NOT NULL,
+    section_number INTEGER NOT NULL,
+    is_on_module TEXT DEFAULT "FALSE" CHECK(is_on_module IN ("TRUE", "FALSE")),
+
+    FOREIGN KEY(module_uid) REFERENCES can_modules(uid),
+    FOREIGN KEY(flow_name) REFERENCES broadcast_flows(flow_name),
+    FOREIGN KEY(flow_id) REFERENCES broadcast_flows(flow_id)
+);
+)" },
+
+    // Every lookup we, and NodeRed, make by something other than a primary key was a full scan.
+    // Indexes for lookups that only read have every column they read, so they never touch the table itself.
+    // bench/query_plan_check fails if any of these queries goes back to being a full scan.
+    { 2, "Indexes for every lookup", R"(
+-- NodeRed: SELECT uid FROM can_modules WHERE name = ?
+CREATE INDEX IF NOT EXISTS can_modules_by_name ON can_modules (name, uid);
+
+-- NodeRed: SELECT name FROM can_module_commands WHERE module_uid = ?
+-- ModuleRegistry: UPDATE can_module_commands ... WHERE module_uid = ? AND command_uid = ?
+CREATE INDEX IF NOT EXISTS can_module_commands_by_command ON can_module_commands (module_uid, command_uid, name);
+
+-- EventManager: is the event stored, and which flow, and module, has an event.
+CREATE INDEX IF NOT EXISTS broadcast_events_by_blob ON broadcast_events (event_blob, flow_id, module_uid);
+
+-- EventManager: the events of inactive flows, and the next flow_id.
+CREATE INDEX IF NOT EXISTS broadcast_events_by_flow ON broadcast_events (flow_id, event_blob);
+
+-- EventManager: activating a flow.
+CREATE INDEX IF NOT EXISTS broadcast_flows_by_flow_id ON broadcast_flows (flow_id);
+
+-- EventManager: the inactive flows, which are removed after every deploy.
+CREATE INDEX IF NOT EXISTS broadcast_flows_by_active ON broadcast_flows (is_active, flow_id);
+)" },
+
+    // A flow read from disk doesn't have a flow_id, and every event we store has its flow_id in its blob,
+    // so a deployed flow was never matched to the one we're storing. Flows stored before this
+    // have no main_event_blob, so they're replaced once, on the first deploy after it.
+    { 3, "Match flows by their main event", R"(
+-- The flow's main event, serialized with a flow_id of 0.
+ALTER TABLE broadcast_flows ADD COLUMN main_event_blob BLOB;
+
+-- EventManager: the stored flows a deployed one could be.
+CREATE INDEX IF NOT EXISTS broadcast_flows_by_main_event ON broadcast_flows (main_event_blob, is_active, flow_id);
+)" },
+};
+
+const size_t MIGRATION_COUNT = sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]);
+
+bool exec(sqlite3* database, const char* sql)
+{
+    char* error = nullptr;
+    if (sqlite3_exec(database, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+        fmt::print(fmt::fg(fmt::terminal_color::red), "Migrations: {}\n", error ? error : sqlite3_errmsg(database));
+        sqlite3_free(error);
+        return false;
+    }
+    return true;
+}
+
+int32_t user_version(sqlite3* database)
+{
+    sqlite3_stmt* statement = nullptr;
+    if (sqlite3_prepare_v2(database, "PRAGMA user_version", -1, &statement, nullptr) != SQLITE_OK) {
+        return -1;
+    }
+
+    const int32_t version = (sqlite3_step(statement) == SQLITE_ROW) ? sqlite3_column_int(statement, 0) : -1;
+    sqlite3_finalize(statement);
+    return version;
+}
+
+bool apply(sqlite3* database, const Migration& migration)
+{
+    // IMMEDIATE, so if another CanRed is migrating the same database, we wait
+    // for it, and then see the version it left the database at.
+    if (!exec(database, "BEGIN IMMEDIATE")) {
+        return false;
+    }
+
+    if (user_version(database) >= migration.version) {
+        return exec(database, "COMMIT");
+    }
+
+    // PRAGMA can't take a bound parameter.
+    const auto set_version = fmt::format("PRAGMA user_version = {}", migration.version);
+
+    if (!exec(database, migration.sql) || !exec(database, set_version.c_str()) || !exec(database, "COMMIT")) {
+        sqlite3_exec(database, "ROLLBACK", nullptr, nullptr, nullptr);
+        return false;
+    }
+
+    fmt::print("Migrations: Applied {} ({})\n", migration.version, migration.description);
+    return true;
+}
+
+} // namespace
+
+int32_t latest_version()
+{
+    return MIGRATIONS[MIGRATION_COUNT - 1].version;
+}
+
+bool run(sqlite3* database)
+{
+    const int32_t version = user_version(database);
+    if (version < 0) {
+        fmt::print(fmt::fg(fmt::terminal_color::red), "Migrations: Failed to read user_version: {}\n", sqlite3_errmsg(database));
+        return false;
+    }
+
+    if (version > latest_version()) {
+        // A newer CanRed has used this database, all we can do is hope it's compatible.
+        fmt::print(fmt::fg(fmt::terminal_color::yellow), "Migrations: Database is at version {}, newer than ours ({})\n", version, latest_version());
+        return true;
+    }
+
+    for (size_t i = 0; i < MIGRATION_COUNT; i += 1) {
+        if (MIGRATIONS[i].version <= version) {
+            continue;
+        }
+
+        if (!apply(database, MIGRATIONS[i])) {
+            fmt::print(fmt::fg(fmt::terminal_color::red), "Migrations: Failed to apply {} ({})\n", MIGRATIONS[i].version, MIGRATIONS[i].description);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace Migrations
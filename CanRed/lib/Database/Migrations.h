@@ -0,0 +1,32 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <stdint.h>
+
+// The database's schema, as numbered steps compiled into CanRed,
+// so there's no schema.sql to ship, or to get out of sync with the binary.
+
+// The database's user_version is the last step it's had applied, so on start
+// only the steps after it are run, each one in its own transaction along with
+// bumping user_version, so a step is either fully applied, or not at all.
+
+// Never change a step that's been released, add a new one to the end of
+// MIGRATIONS in Migrations.cpp instead, that's the only way a database
+// that already has it applied will see the change.
+
+namespace Migrations {
+
+struct Migration {
+    int32_t version;
+    const char* description;
+    const char* sql;
+};
+
+// The version a database is at, once every step has been applied.
+int32_t latest_version();
+
+// Brings the database up to latest_version(). Returns false, having reported why,
+// if a step failed, in which case the database is left at the step before it.
+bool run(sqlite3* database);
+
+} // namespace Migrations
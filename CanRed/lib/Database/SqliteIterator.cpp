@@ -15,6 +15,11 @@ SqliteIterator::SqliteIterator(sqlite3_stmt* statement, SqliteIteratorState stat
         if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
             sqlite_print_error(rc, __PRETTY_FUNCTION__);
         }
+
+        // No rows, so we're already at the end.
+        if (rc != SQLITE_ROW) {
+            m_state = SqliteIteratorState::End;
+        }
     }
 }
 
@@ -25,7 +30,7 @@ SqliteIterator& SqliteIterator::operator++()
     }
 
     auto rc = sqlite3_step(m_statement);
-    if (rc == SQLITE_DONE) {
+    if (rc != SQLITE_ROW) {
         m_state = SqliteIteratorState::End;
     }
 
@@ -2,14 +2,38 @@
 
 #include "sqlite_helpers.h"
 
-SqliteQuery::SqliteQuery(sqlite3* instance, const std::string& query)
+SqliteQuery::SqliteQuery(sqlite3_stmt* statement, std::vector<sqlite3_stmt*>* free_statements, std::unique_lock<std::recursive_mutex> database_lock)
+    : m_database_lock(std::move(database_lock))
+    , m_statement(statement)
+    , m_free_statements(free_statements)
 {
-    sqlite3_prepare_v2(instance, query.c_str(), query.size(), &m_statement, nullptr);
+}
+
+SqliteQuery::SqliteQuery(SqliteQuery&& other)
+    : m_database_lock(std::move(other.m_database_lock))
+    , m_statement(other.m_statement)
+    , m_free_statements(other.m_free_statements)
+    , m_is_statement_finished(other.m_is_statement_finished)
+    , m_current_column(other.m_current_column)
+{
+    other.m_statement = nullptr;
 }
 
 SqliteQuery::~SqliteQuery()
 {
-    sqlite3_finalize(m_statement);
+    if (!m_statement) {
+        return;
+    }
+
+    if (!m_free_statements) {
+        sqlite3_finalize(m_statement);
+        return;
+    }
+
+    // We still hold the database lock, so nobody else is touching the cache.
+    sqlite3_reset(m_statement);
+    sqlite3_clear_bindings(m_statement);
+    m_free_statements->push_back(m_statement);
 }
 
 void SqliteQuery::bind(int32_t column, const std::string& value) const
@@ -30,6 +54,18 @@ void SqliteQuery::bind(int32_t column, int32_t value) const
     sqlite3_bind_int(m_statement, column, value);
 }
 
+void SqliteQuery::bind(int32_t column, uint16_t value) const
+{
+    assert(column > 0);
+    sqlite3_bind_int(m_statement, column, value);
+}
+
+void SqliteQuery::bind(int32_t column, uint8_t value) const
+{
+    assert(column > 0);
+    sqlite3_bind_int(m_statement, column, value);
+}
+
 void SqliteQuery::bind(int32_t column, size_t value) const
 {
     assert(column > 0);
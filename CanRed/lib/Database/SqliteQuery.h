@@ -3,18 +3,28 @@
 #include <assert.h>
 #include <fmt/color.h>
 #include <fmt/format.h>
+#include <mutex>
 #include <sqlite3.h>
 #include <string>
+#include <vector>
 
 #include "SqliteIterator.h"
 #include "SqliteResult.h"
 #include "SqliteValue.h"
 
+// A statement borrowed from Database's statement cache, see Database::prepare().
+// When it's destroyed the statement is reset, its bindings cleared, and it's
+// handed back to free_statements, or finalized if it isn't cached.
+
 class SqliteQuery {
 public:
-    SqliteQuery(sqlite3* instance, const std::string& query);
+    SqliteQuery(sqlite3_stmt* statement, std::vector<sqlite3_stmt*>* free_statements, std::unique_lock<std::recursive_mutex> database_lock);
+    SqliteQuery(SqliteQuery&& other);
     ~SqliteQuery();
 
+    SqliteQuery(const SqliteQuery&) = delete;
+    SqliteQuery& operator=(const SqliteQuery&) = delete;
+
     // get() Variadic Template
     template<typename T, typename... Args>
     SqliteResult get(const T& value, const Args&... args)
@@ -54,6 +64,9 @@ public:
     SqliteIterator begin() const;
     SqliteIterator end() const;
 
+    // For TypedQuery, which binds and reads the statement itself.
+    sqlite3_stmt* statement() const { return m_statement; }
+
 private:
     template<typename T>
     void bind(const T& value)
@@ -65,11 +78,18 @@ private:
     void bind(int32_t column, const std::string& value) const;
     void bind(int32_t column, ssize_t value) const;
     void bind(int32_t column, int32_t value) const;
+    void bind(int32_t column, uint16_t value) const;
+    void bind(int32_t column, uint8_t value) const;
     void bind(int32_t column, size_t value) const;
     void bind(int32_t column, uint32_t value) const;
     void bind(int32_t column, const std::vector<uint8_t>& blob) const;
 
+    // Held for as long as we're alive, see Database::prepare().
+    std::unique_lock<std::recursive_mutex> m_database_lock;
+
     sqlite3_stmt* m_statement;
+    // Where m_statement goes back to, nullptr if it's not cached.
+    std::vector<sqlite3_stmt*>* m_free_statements;
     bool m_is_statement_finished { false };
 
     int32_t m_current_column { 0 };
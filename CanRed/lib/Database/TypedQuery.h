@@ -0,0 +1,185 @@
+#pragma once
+
+#include <Database.h>
+#include <assert.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "sqlite_helpers.h"
+
+// Reading a column, and binding a parameter, for every type a TypedQuery
+// can use. Each one is picked at compile time, and is a single call into sqlite.
+
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, bool& value) { value = sqlite3_column_int(statement, column) != 0; }
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, uint8_t& value) { value = sqlite3_column_int(statement, column); }
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, uint16_t& value) { value = sqlite3_column_int(statement, column); }
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, int32_t& value) { value = sqlite3_column_int(statement, column); }
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, uint32_t& value) { value = sqlite3_column_int64(statement, column); }
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, ssize_t& value) { value = sqlite3_column_int64(statement, column); }
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, size_t& value) { value = sqlite3_column_int64(statement, column); }
+
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, std::string& value)
+{
+    // sqlite3_column_bytes() has to come after sqlite3_column_text(), which might convert the value.
+    const auto* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+    value.assign(text ? text : "", sqlite3_column_bytes(statement, column));
+}
+
+inline void sqlite_read_column(sqlite3_stmt* statement, int32_t column, std::vector<uint8_t>& value)
+{
+    const auto* blob = static_cast<const uint8_t*>(sqlite3_column_blob(statement, column));
+    value.assign(blob, blob + sqlite3_column_bytes(statement, column));
+}
+
+inline void sqlite_read_columns(sqlite3_stmt*, int32_t) { }
+
+// Reads one column into every value, starting at column.
+template<typename T, typename... Rest>
+void sqlite_read_columns(sqlite3_stmt* statement, int32_t column, T& value, Rest&... rest)
+{
+    sqlite_read_column(statement, column, value);
+    sqlite_read_columns(statement, column + 1, rest...);
+}
+
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, bool value) { sqlite3_bind_int(statement, parameter, value); }
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, uint8_t value) { sqlite3_bind_int(statement, parameter, value); }
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, uint16_t value) { sqlite3_bind_int(statement, parameter, value); }
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, int32_t value) { sqlite3_bind_int(statement, parameter, value); }
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, uint32_t value) { sqlite3_bind_int64(statement, parameter, value); }
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, ssize_t value) { sqlite3_bind_int64(statement, parameter, value); }
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, size_t value) { sqlite3_bind_int64(statement, parameter, value); }
+
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, const std::string& value)
+{
+    sqlite3_bind_text(statement, parameter, value.c_str(), value.size(), SQLITE_TRANSIENT);
+}
+
+inline void sqlite_bind_parameter(sqlite3_stmt* statement, int32_t parameter, const std::vector<uint8_t>& value)
+{
+    sqlite3_bind_blob(statement, parameter, value.data(), value.size(), SQLITE_TRANSIENT);
+}
+
+inline void sqlite_bind_parameters(sqlite3_stmt*, int32_t) { }
+
+template<typename T, typename... Rest>
+void sqlite_bind_parameters(sqlite3_stmt* statement, int32_t parameter, const T& value, const Rest&... rest)
+{
+    sqlite_bind_parameter(statement, parameter, value);
+    sqlite_bind_parameters(statement, parameter + 1, rest...);
+}
+
+// How a row is read into a Row, by default it's a single column.
+// Structs specialize this, and read every column with sqlite_read_columns().
+template<typename Row>
+struct QueryRow {
+    static constexpr int32_t COLUMN_COUNT = 1;
+
+    static void read(sqlite3_stmt* statement, Row& row) { sqlite_read_column(statement, 0, row); }
+};
+
+// A query with its parameter types, and the type every row is read into, in its type.
+// Rows are read straight from the statement, and parameters are bound straight
+// to it, so there's no SqliteValue in between, and a type we can't read or
+// bind doesn't compile. Queries that don't return rows have a Row of void.
+
+// Declare them once, they go through Database's statement cache like every other query:
+// static const TypedQuery<Module> all_modules("SELECT ...");
+// static const TypedQuery<void, uint16_t, uint32_t> store_hash("INSERT ... VALUES (?, ?)");
+
+template<typename Row, typename... Params>
+class TypedQuery {
+public:
+    explicit TypedQuery(std::string sql)
+        : m_sql(std::move(sql))
+    {
+    }
+
+    // Calls callback(const Row&) with every row.
+    template<typename Callback>
+    void for_each(Callback callback, const Params&... params) const
+    {
+        auto query = prepare(Database::the(), params...);
+        auto* statement = query.statement();
+
+        assert(!statement || sqlite3_column_count(statement) == QueryRow<Row>::COLUMN_COUNT);
+
+        // Reused for every row, so strings keep their buffers.
+        Row row {};
+        while (step(statement)) {
+            QueryRow<Row>::read(statement, row);
+            callback(row);
+        }
+    }
+
+    // Returns false if there were no rows, otherwise fills in row with the first one.
+    bool get(Row* row, const Params&... params) const
+    {
+        auto query = prepare(Database::the(), params...);
+        auto* statement = query.statement();
+
+        if (!step(statement)) {
+            return false;
+        }
+
+        QueryRow<Row>::read(statement, *row);
+        return true;
+    }
+
+    // Returns false if it failed.
+    bool run(const Params&... params) const
+    {
+        return run_on(Database::the(), params...);
+    }
+
+    // Runs it on a connection other than Database::the(), see DatabaseWriter.
+    bool run_on(const Database& database, const Params&... params) const
+    {
+        auto query = prepare(database, params...);
+        auto* statement = query.statement();
+        if (!statement) {
+            return false;
+        }
+
+        const auto rc = sqlite3_step(statement);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            sqlite_print_error(rc, __PRETTY_FUNCTION__);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    SqliteQuery prepare(const Database& database, const Params&... params) const
+    {
+        auto query = database.prepare(m_sql);
+        auto* statement = query.statement();
+
+        if (statement) {
+            assert(sqlite3_bind_parameter_count(statement) == sizeof...(Params));
+            sqlite_bind_parameters(statement, 1, params...);
+            sqlite_print_query(statement);
+        }
+
+        return query;
+    }
+
+    // Returns true if there's a row to read.
+    static bool step(sqlite3_stmt* statement)
+    {
+        // Failing to prepare was already reported.
+        if (!statement) {
+            return false;
+        }
+
+        const auto rc = sqlite3_step(statement);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            sqlite_print_error(rc, __PRETTY_FUNCTION__);
+        }
+        return rc == SQLITE_ROW;
+    }
+
+    std::string m_sql;
+};
@@ -2,13 +2,16 @@
 
 #include <Event.h>
 #include <FileWatcher.h>
+#include <TypedQuery.h>
 #include <algorithm>
+#include <bitset>
 #include <fmt/color.h>
 #include <fmt/format.h>
 #include <fstream>
 #include <get_env_var.h>
 #include <iostream>
 #include <json.hpp>
+#include <unistd.h>
 
 // TODO:
 // Currently, the system cannot detect when a user has
@@ -25,32 +28,54 @@
 
 namespace {
 
-const static std::string PARSED_FLOWS_FILE = get_env_var(ENV::NODE_RED_DIR) + "/automato.parsed.flows.json";
+const TypedQuery<void, uint8_t, std::string, std::vector<uint8_t>> insert_flow("INSERT INTO broadcast_flows (flow_id, flow_name, main_event_blob) VALUES (?, ?, ?)");
+const TypedQuery<void, uint8_t, std::string, uint16_t, std::vector<uint8_t>, uint8_t> insert_event("INSERT INTO broadcast_events (flow_id, flow_name, module_uid, event_blob, section_number) VALUES (?, ?, ?, ?, ?)");
+const TypedQuery<bool, uint8_t, uint16_t, std::vector<uint8_t>> is_event_stored("SELECT EXISTS (SELECT 1 FROM broadcast_events WHERE flow_id = ? AND module_uid = ? AND event_blob = ? LIMIT 1)");
+const TypedQuery<size_t, uint8_t> count_flow_events("SELECT COUNT(*) FROM broadcast_events WHERE flow_id = ?");
+const TypedQuery<uint8_t, std::vector<uint8_t>> select_unmatched_flow_ids("SELECT flow_id FROM broadcast_flows WHERE main_event_blob = ? AND is_active = \"FALSE\"");
+const TypedQuery<void, uint8_t> activate_flow("UPDATE broadcast_flows SET is_active = \"TRUE\" WHERE flow_id = ?");
+const TypedQuery<uint8_t> select_flow_ids("SELECT flow_id FROM broadcast_flows");
+const TypedQuery<uint16_t, std::vector<uint8_t>> select_module_uid("SELECT module_uid FROM broadcast_events WHERE event_blob = ?");
+
+// What a flow read from disk is matched to a stored one by, its main event without a flow_id,
+// since a flow from disk doesn't have one yet, and a stored flow's blobs have theirs.
+std::vector<uint8_t> main_event_key(Event main_event)
+{
+    main_event.flow_id = 0;
+    return main_event.serialize();
+}
 
-void store_new_flow(uint8_t flow_id, const std::string& flow_name, const std::vector<Event>& flow)
+// Only called from read_changes(), inside of its transaction.
+void store_new_flow(uint8_t flow_id, const Event& main_event, const std::vector<Event>& flow)
 {
-    Database::the().prepare("INSERT INTO broadcast_flows (flow_id, flow_name) VALUES (?, ?)").run(flow_id, flow_name);
+    const auto& flow_name = main_event.flow_name;
+    insert_flow.run(flow_id, flow_name, main_event_key(main_event));
 
     // Flows we have read from disk, do not have a proper flow_id set
     // So set the events flow_id using the one we're given.
-    auto insert_new_event = Database::the().prepare("INSERT INTO broadcast_events (flow_id, flow_name, module_uid, event_blob, section_number) VALUES (?, ?, ?, ?, ?)");
     for (auto event : flow) {
         event.flow_id = flow_id;
-        auto serialized_event = event.serialize();
-        insert_new_event.run(flow_id, flow_name, event.module_uid, serialized_event, event.section_number);
+        insert_event.run(flow_id, flow_name, event.module_uid, event.serialize(), event.section_number);
     }
 }
 
 bool has_flow_changed(uint8_t flow_id, const std::vector<Event>& flows)
 {
-    for (const auto& block : flows) {
+    // A block that was removed from the flow is still stored.
+    size_t stored_count = 0;
+    count_flow_events.get(&stored_count, flow_id);
+    if (stored_count != flows.size()) {
+        return true;
+    }
 
-        auto serialized_event = block.serialize();
+    for (auto block : flows) {
+        // Stored events were serialized with their flow_id, see store_new_flow().
+        block.flow_id = flow_id;
 
-        auto query = Database::the().prepare("SELECT EXISTS (SELECT 1 FROM broadcast_events WHERE flow_id = ? AND module_uid = ? AND event_blob = ? LIMIT 1)");
-        bool is_event_stored = query.get(flow_id, block.module_uid, serialized_event).column(0);
+        bool is_stored = false;
+        is_event_stored.get(&is_stored, flow_id, block.module_uid, block.serialize());
 
-        if (is_event_stored) {
+        if (!is_stored) {
             return true;
         }
     }
@@ -58,9 +83,26 @@ bool has_flow_changed(uint8_t flow_id, const std::vector<Event>& flows)
     return false;
 }
 
+// Returns the stored flow that's the same as this one, and that no other flow
+// in this deploy has already matched, or 0 if there isn't one.
+uint8_t find_unchanged_flow(const Event& main_event, const std::vector<Event>& flow)
+{
+    // More than one stored flow can have the same main event, with different children.
+    std::vector<uint8_t> flow_ids;
+    select_unmatched_flow_ids.for_each([&](uint8_t flow_id) { flow_ids.push_back(flow_id); }, main_event_key(main_event));
+
+    for (const auto flow_id : flow_ids) {
+        if (!has_flow_changed(flow_id, flow)) {
+            return flow_id;
+        }
+    }
+
+    return 0;
+}
+
 nlohmann::json read_events_file()
 {
-    std::ifstream json_file(PARSED_FLOWS_FILE);
+    std::ifstream json_file(EventManager::flows_file());
     std::stringstream json_file_stream;
     nlohmann::json json;
 
@@ -90,7 +132,7 @@ nlohmann::json read_events_file()
     return json;
 }
 
-std::vector<std::vector<Event>> get_events_from_json(const nlohmann::json& json)
+std::vector<std::vector<Event>> get_events_from_json(const nlohmann::json& json, const ModuleRegistry& module_registry)
 {
     std::vector<std::vector<Event>> all_loaded_events;
 
@@ -98,7 +140,7 @@ std::vector<std::vector<Event>> get_events_from_json(const nlohmann::json& json)
         std::vector<Event> flow_events;
 
         for (const auto& event_block : automato_flow) {
-            const auto created_event = Event::from_json(event_block);
+            const auto created_event = Event::from_json(event_block, module_registry);
             flow_events.push_back(created_event);
         }
         all_loaded_events.push_back(std::move(flow_events));
@@ -107,26 +149,32 @@ std::vector<std::vector<Event>> get_events_from_json(const nlohmann::json& json)
     return all_loaded_events;
 }
 
-uint8_t get_flow_id_from_event(const Event& event)
+// Every flow_id that a stored flow has, flow ids are a single byte.
+std::bitset<256> get_used_flow_ids()
 {
-    auto serialized_event = event.serialize();
+    std::bitset<256> used_flow_ids;
+    select_flow_ids.for_each([&](uint8_t flow_id) { used_flow_ids.set(flow_id); });
+    return used_flow_ids;
+}
 
-    auto query = Database::the().prepare("SELECT flow_id FROM broadcast_events WHERE event_blob = ?");
-    auto statement = query.get(serialized_event);
-    uint8_t flow_id = statement.column(0);
+// Takes the lowest flow_id in 1..255 that isn't used, or returns 0 if every one is,
+// since 0 means an event isn't part of a stored flow.
+uint8_t get_new_flow_id(std::bitset<256>& used_flow_ids)
+{
+    for (uint16_t flow_id = 1; flow_id < used_flow_ids.size(); flow_id += 1) {
+        if (!used_flow_ids.test(flow_id)) {
+            used_flow_ids.set(flow_id);
+            return flow_id;
+        }
+    }
 
-    return flow_id;
+    return 0;
 }
 
 } // namespace
 
 namespace EventManager {
 
-uint8_t get_new_flow_id()
-{
-    return Database::the().prepare("SELECT MAX(flow_id) FROM broadcast_events").get().column(0);
-}
-
 void print_event_update(const EventUpdate& update)
 {
     const std::string update_string = (update.update_type == EventUpdateType::add) ? "add" : "remove";
@@ -151,34 +199,64 @@ void append_event_updates(EventUpdateType type, uint8_t flow_id, std::vector<Eve
     }
 }
 
-bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock)
+const std::string& flows_file()
 {
+    // Read from .env the first time it's needed, rather than at startup.
+    static const std::string parsed_flows_file = get_env_var(ENV::NODE_RED_DIR) + "/automato.parsed.flows.json";
+    return parsed_flows_file;
+}
+
+bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock, const ModuleRegistry& module_registry)
+{
+    // NodeRed only creates the flows file on its first deploy, until
+    // then wait_for_file_change() checks for it every second.
+    static bool has_reported_missing_flows_file = false;
+    if (!has_reported_missing_flows_file && access(flows_file().c_str(), F_OK) != 0) {
+        fmt::print("{} doesn't exist yet, it'll be read once NodeRed creates it\n", flows_file());
+        has_reported_missing_flows_file = true;
+    }
+
     // Wait indefinitely until the flows file is modified.
-    wait_for_file_change(PARSED_FLOWS_FILE);
+    if (!wait_for_file_change(flows_file())) {
+        return false;
+    }
 
     std::unique_lock<std::mutex> updates_needed_lock(lock);
 
+    return read_changes(updates_needed, module_registry);
+}
+
+bool read_changes(std::vector<EventUpdate>& updates_needed, const ModuleRegistry& module_registry)
+{
     // TODO: This function needs proper error handling
     const auto json = read_events_file();
-    const auto all_flows_from_disk = get_events_from_json(json);
+    const auto all_flows_from_disk = get_events_from_json(json, module_registry);
 
     bool do_modules_need_updating = false;
 
     // Steps:
     // 1. Blanket all flows as is_active = FALSE
     // 2. Get the main event from the flow
-    // 3. Check to see if we're storing the main event
-    // 4. if so, check if all of its child nodes are the same
-    // 5. if they are, do nothing else.
-    // 6. if they are not, get which events have been modified
-    //    and update only them
-    // 7. if we're not storing this main event,
-    //    store this flow as new.
-    // 8. any Events that are still marked as old, delete them
-    //    if they're storing on a module
+    // 3. Look for a stored flow with the same main event, and the
+    //    same child events, that no other flow has matched yet
+    // 4. if there is one, mark it as is_active = TRUE, and do nothing else.
+    // 5. if there isn't, this flow is new, or it has changed,
+    //    either way it's stored as if it were brand new, in step 7.
+    // 6. any flows that are still marked as inactive, delete them,
+    //    and their events from the modules
+    // 7. store the new flows, now that the ids of the deleted ones are free.
+
+    // Everything below is one transaction, so the whole deploy only
+    // syncs to disk once, instead of once for every statement.
+    if (!Database::the().begin_transaction()) {
+        fmt::print(fmt::fg(fmt::color::red), "Failed to start reading the flows, they'll be read on the next deploy!\n");
+        return false;
+    }
 
     Database::the().prepare("UPDATE broadcast_flows SET is_active = \"FALSE\"").run();
 
+    std::vector<const std::vector<Event>*> new_flows;
+
     for (const auto& disk_flow : all_flows_from_disk) {
 
         const auto main_event_iter = std::find_if(disk_flow.begin(), disk_flow.end(), [](const Event& event) { return event.event_type == EventType::Main; });
@@ -191,45 +269,16 @@ bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock
             continue;
         }
 
-        const auto& main_event = *main_event_iter;
-
-        // Events from disk don't have event.flow_id set, since
-        // that is not stored in NodeRed, and therefore not stored in
-        // the resulting parsed JSON.
-
-        uint8_t flow_id = get_flow_id_from_event(main_event);
+        const uint8_t flow_id = find_unchanged_flow(*main_event_iter, disk_flow);
 
-        // Either the main event changed, or we have seen
-        // this event before. Either way, store this flow
-        // as if it was brand new.
         if (flow_id == 0) {
             fmt::print("Found a flow we're not storing!\n");
-
-            flow_id = get_new_flow_id();
-            store_new_flow(flow_id, main_event.flow_name, disk_flow);
-            append_event_updates(EventUpdateType::add, flow_id, updates_needed, disk_flow);
-
-            do_modules_need_updating = true;
-            continue;
-        }
-
-        // We've seen this main event before, and need
-        // to check if any of it's children have changed.
-        if (has_flow_changed(flow_id, disk_flow)) {
-            fmt::print("Found a flow that diverges from what we're storing\n");
-            // TODO: can't we just reuse flow_id here?
-            uint8_t new_flow_id = get_new_flow_id();
-
-            // Store this flow as if it were brand new.
-            store_new_flow(new_flow_id, main_event.flow_name, disk_flow);
-            append_event_updates(EventUpdateType::add, flow_id, updates_needed, disk_flow);
-
-            do_modules_need_updating = true;
+            new_flows.push_back(&disk_flow);
             continue;
         }
 
         fmt::print("Found a flow we're storing!\n");
-        Database::the().prepare("UPDATE broadcast_flows SET is_active = \"TRUE\" WHERE flow_id = ?").run(flow_id);
+        activate_flow.run(flow_id);
     }
 
     // TODO: Check if the event has been stored on a module or not.
@@ -252,7 +301,8 @@ bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock
 
     for (const auto& blob : inactive_event_blobs) {
         do_modules_need_updating = true;
-        const uint8_t module_uid = Database::the().prepare("SELECT module_uid FROM broadcast_events WHERE event_blob = ?").get(blob).column(0);
+        uint16_t module_uid = 0;
+        select_module_uid.get(&module_uid, blob);
 
         updates_needed.emplace_back(
             EventUpdate {
@@ -265,6 +315,27 @@ bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock
     Database::the().prepare("DELETE FROM broadcast_events WHERE flow_id IN (SELECT flow_id FROM broadcast_flows WHERE is_active = \"FALSE\")").run();
     Database::the().prepare("DELETE FROM broadcast_flows WHERE is_active = \"FALSE\"").run();
 
+    // New flows are only stored once every flow that's no longer deployed has been removed,
+    // so their ids are free again, and a deploy can have up to 255 flows, no matter how many it replaces.
+    auto used_flow_ids = get_used_flow_ids();
+
+    for (const auto* disk_flow : new_flows) {
+        const auto& main_event = *std::find_if(disk_flow->begin(), disk_flow->end(), [](const Event& event) { return event.event_type == EventType::Main; });
+
+        const uint8_t flow_id = get_new_flow_id(used_flow_ids);
+        if (flow_id == 0) {
+            fmt::print(fmt::fg(fmt::color::red), "Can't store flow \"{}\", every flow id is taken, there can only be 255 flows!\n", main_event.flow_name);
+            continue;
+        }
+
+        store_new_flow(flow_id, main_event, *disk_flow);
+        append_event_updates(EventUpdateType::add, flow_id, updates_needed, *disk_flow);
+
+        do_modules_need_updating = true;
+    }
+
+    Database::the().commit_transaction();
+
     if (do_modules_need_updating) {
         fmt::print(fmt::fg(fmt::color::green), "Event Updates to be sent to modules:\n");
         std::for_each(updates_needed.begin(), updates_needed.end(), [](const EventUpdate& update) {
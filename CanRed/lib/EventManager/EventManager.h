@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Event.h>
+#include <ModuleRegistry.h>
 #include <mutex>
 #include <stdint.h>
 #include <string>
@@ -21,6 +22,15 @@ namespace EventManager {
 
 void print_event_update(const EventUpdate& update);
 
-bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock);
+// The parsed flows file that NodeRed writes to.
+const std::string& flows_file();
+
+// Blocks until the flows file changes, then calls read_changes()
+bool wait_for_changes(std::vector<EventUpdate>& updates_needed, std::mutex& lock, const ModuleRegistry& module_registry);
+
+// Compares the flows file against the DB, and appends the updates
+// the modules need. Returns true if any modules need updating.
+// Module and command names in the flows are looked up in module_registry.
+bool read_changes(std::vector<EventUpdate>& updates_needed, const ModuleRegistry& module_registry);
 
 } // namespace EventManager
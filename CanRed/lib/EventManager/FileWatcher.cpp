@@ -0,0 +1,60 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+FileWatcher::FileWatcher()
+{
+    m_inotify_file_descriptor = inotify_init1(IN_CLOEXEC);
+
+    if (m_inotify_file_descriptor == -1) {
+        fmt::print("Inotify Error, Inotify returned an invalid file descriptor\n");
+    }
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (m_inotify_file_descriptor != -1) {
+        close(m_inotify_file_descriptor);
+    }
+}
+
+int32_t FileWatcher::watch(const std::string& filename)
+{
+    auto watch_descriptor = inotify_add_watch(m_inotify_file_descriptor, filename.c_str(), IN_MODIFY);
+
+    if (watch_descriptor == -1) {
+        fmt::print("Inotify Error, Could not watch {}: {}\n", filename, strerror(errno));
+    }
+
+    return watch_descriptor;
+}
+
+std::vector<int32_t> FileWatcher::read_changes()
+{
+    // inotify events must be read with a buffer aligned for inotify_event
+    alignas(inotify_event) char buffer[64 * (sizeof(inotify_event) + 16)];
+
+    auto length = read(m_inotify_file_descriptor, buffer, sizeof(buffer));
+
+    if (length <= 0) {
+        return {};
+    }
+
+    std::vector<int32_t> changed_watch_descriptors;
+
+    for (ssize_t offset = 0; offset < length;) {
+        const auto* event = reinterpret_cast<const inotify_event*>(&buffer[offset]);
+
+        // A file written in multiple chunks creates an event per chunk,
+        // we only care that it changed.
+        if (std::find(changed_watch_descriptors.begin(), changed_watch_descriptors.end(), event->wd) == changed_watch_descriptors.end()) {
+            changed_watch_descriptors.push_back(event->wd);
+        }
+
+        offset += sizeof(inotify_event) + event->len;
+    }
+
+    return changed_watch_descriptors;
+}
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <chrono>
 #include <fmt/format.h>
 #include <stdio.h>
 #include <string>
 #include <sys/inotify.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 // Sleeps the current thread until the given filename is modified.
-// Returns: True: The file was modified
+// If it can't be watched, most likely since it doesn't exist yet, this sleeps
+// for a second instead, so it can be called in a loop until the file is created.
+// Returns: True: The file was modified, or created while we slept
 //          False: The file was not modified, but inotify timed out.
 //                 This should not happen often, but should be checked for.
 inline bool wait_for_file_change(const std::string& filename)
@@ -19,13 +24,43 @@ inline bool wait_for_file_change(const std::string& filename)
         return false;
     }
 
-    inotify_add_watch(inotify_file_descriptor, filename.c_str(), IN_MODIFY);
+    if (inotify_add_watch(inotify_file_descriptor, filename.c_str(), IN_MODIFY) == -1) {
+        close(inotify_file_descriptor);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        return access(filename.c_str(), F_OK) == 0;
+    }
 
     const uint32_t inotify_event_size = sizeof(inotify_event);
     const uint32_t read_buffer_size = 1024 * (inotify_event_size + 16);
 
     char buffer[read_buffer_size];
 
-    uint32_t length = read(inotify_file_descriptor, buffer, read_buffer_size);
+    const auto length = read(inotify_file_descriptor, buffer, read_buffer_size);
+    close(inotify_file_descriptor);
     return (length > 0);
-}
\ No newline at end of file
+}
+
+// Unlike wait_for_file_change(), a FileWatcher keeps a single inotify
+// instance alive for every file it watches, so it can be polled,
+// and never misses a change that happens in between two reads.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Returns a watch descriptor for filename, or -1 on error, like
+    // if it doesn't exist yet, in which case it can be watched again later.
+    int32_t watch(const std::string& filename);
+
+    // Reads every pending inotify event, and returns the watch
+    // descriptors of the modified files. Blocks if nothing has changed.
+    std::vector<int32_t> read_changes();
+
+    int32_t file_descriptor() const { return m_inotify_file_descriptor; }
+
+private:
+    int32_t m_inotify_file_descriptor { -1 };
+};
@@ -0,0 +1,56 @@
+#include "EventNotifier.h"
+
+#include <errno.h>
+#include <fmt/format.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+EventNotifier::EventNotifier()
+{
+    m_file_descriptor = eventfd(0, EFD_CLOEXEC);
+
+    if (m_file_descriptor == -1) {
+        fmt::print("EventNotifier: Could not create an eventfd!\n");
+        exit(1);
+    }
+}
+
+EventNotifier::~EventNotifier()
+{
+    close(m_file_descriptor);
+}
+
+void EventNotifier::notify()
+{
+    uint64_t value = 1;
+    if (write(m_file_descriptor, &value, sizeof(value)) == -1) {
+        fmt::print("EventNotifier: write() to eventfd failed, errno={}\n", errno);
+    }
+}
+
+void EventNotifier::notify_if_waiting()
+{
+    // Pairs with the fence in wait(), either we see the consumer
+    // is waiting, or the consumer sees whatever we just published.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (m_is_consumer_waiting.load(std::memory_order_relaxed)) {
+        notify();
+    }
+}
+
+void EventNotifier::block()
+{
+    uint64_t value = 0;
+
+    // Blocks until the counter is non-zero, and resets it to zero.
+    if (read(m_file_descriptor, &value, sizeof(value)) == -1) {
+        if (errno != EINTR) {
+            fmt::print("EventNotifier: read() from eventfd failed, errno={}\n", errno);
+        }
+        return;
+    }
+
+    m_wakeups += 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Wakes up a single consumer thread, backed by an eventfd.
+// Since an eventfd is a counter, a notify() that happens while the
+// consumer is busy is never lost, the next wait() returns right away.
+
+// Producers that push a lot (like interface threads) should use
+// notify_if_waiting(), which only does a syscall when the consumer
+// is actually parked inside of wait().
+
+class EventNotifier {
+public:
+    EventNotifier();
+    ~EventNotifier();
+
+    EventNotifier(const EventNotifier&) = delete;
+    EventNotifier& operator=(const EventNotifier&) = delete;
+
+    void notify();
+    void notify_if_waiting();
+
+    // Parks the calling thread until notified, unless has_work()
+    // returns true after we've marked ourselves as waiting.
+    template<typename Predicate>
+    void wait(Predicate has_work)
+    {
+        m_is_consumer_waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!has_work()) {
+            block();
+        }
+
+        m_is_consumer_waiting.store(false, std::memory_order_relaxed);
+    }
+
+    uint64_t wakeups() const { return m_wakeups; }
+
+private:
+    void block();
+
+    int32_t m_file_descriptor { -1 };
+    std::atomic<bool> m_is_consumer_waiting { false };
+    uint64_t m_wakeups { 0 };
+};
@@ -0,0 +1,86 @@
+#include "FrameRing.h"
+
+#include <thread>
+
+namespace {
+
+size_t round_up_to_power_of_two(size_t value)
+{
+    size_t power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+} // namespace
+
+FrameRing::FrameRing(size_t capacity, OverflowPolicy policy, EventNotifier& notifier)
+    : m_policy(policy)
+    , m_notifier(notifier)
+{
+    const size_t real_capacity = round_up_to_power_of_two(capacity > 1 ? capacity : 2);
+
+    m_frames.resize(real_capacity);
+    m_mask = real_capacity - 1;
+}
+
+bool FrameRing::push(const CAN::Frame& frame)
+{
+    while (!try_push(frame)) {
+        if (m_policy == OverflowPolicy::DropNewest) {
+            m_frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            // The consumer might be parked with a full ring,
+            // which should never happen, but just in case.
+            m_notifier.notify_if_waiting();
+            return false;
+        }
+
+        m_notifier.notify_if_waiting();
+        std::this_thread::yield();
+    }
+
+    m_frames_pushed.fetch_add(1, std::memory_order_relaxed);
+    m_notifier.notify_if_waiting();
+    return true;
+}
+
+bool FrameRing::try_push(const CAN::Frame& frame)
+{
+    const size_t head = m_head.load(std::memory_order_relaxed);
+
+    if (head - m_cached_tail > m_mask) {
+        // We look full, but our copy of m_tail might be stale.
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+
+        if (head - m_cached_tail > m_mask) {
+            return false;
+        }
+    }
+
+    m_frames[head & m_mask] = frame;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::pop(CAN::Frame* frame)
+{
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    if (tail == m_cached_head) {
+        m_cached_head = m_head.load(std::memory_order_acquire);
+
+        if (tail == m_cached_head) {
+            return false;
+        }
+    }
+
+    *frame = m_frames[tail & m_mask];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::is_empty() const
+{
+    return m_tail.load(std::memory_order_relaxed) == m_head.load(std::memory_order_acquire);
+}
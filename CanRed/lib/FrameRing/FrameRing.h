@@ -0,0 +1,71 @@
+#pragma once
+
+#include <CanFrame.h>
+#include <EventNotifier.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A bounded, lock-free, single-producer/single-consumer queue of CAN::Frames.
+// Each interface thread gets its own ring, so pushing a frame never waits
+// on the thread that dispatches them, or on any other interface.
+
+// Only one thread may ever call push(), and only one thread may ever
+// call pop()/is_empty().
+
+enum class OverflowPolicy : uint8_t {
+    // Throw away the frame being pushed, the reading thread keeps going.
+    DropNewest,
+    // Wait for the consumer to make room. Nothing gets dropped, but the
+    // producer is now as slow as whoever is dispatching frames.
+    Block,
+};
+
+class FrameRing {
+public:
+    // capacity is rounded up to the next power of two.
+    FrameRing(size_t capacity, OverflowPolicy policy, EventNotifier& notifier);
+    ~FrameRing() = default;
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // Producer
+    // Returns false if the frame was dropped.
+    bool push(const CAN::Frame& frame);
+
+    // Consumer
+    bool pop(CAN::Frame* frame);
+    bool is_empty() const;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // Counters, safe to read from any thread.
+    uint64_t frames_pushed() const { return m_frames_pushed.load(std::memory_order_relaxed); }
+    uint64_t frames_dropped() const { return m_frames_dropped.load(std::memory_order_relaxed); }
+
+private:
+    bool try_push(const CAN::Frame& frame);
+
+    std::vector<CAN::Frame> m_frames;
+    size_t m_mask { 0 };
+    OverflowPolicy m_policy;
+    EventNotifier& m_notifier;
+
+    // m_head is only written by the producer, and m_tail only by the
+    // consumer, they are padded apart so the two threads don't
+    // fight over the same cache line.
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::atomic<size_t> m_head { 0 };
+    size_t m_cached_tail { 0 }; // Producer's last known m_tail
+    char m_head_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    std::atomic<size_t> m_tail { 0 };
+    size_t m_cached_head { 0 }; // Consumer's last known m_head
+    char m_tail_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    std::atomic<uint64_t> m_frames_pushed { 0 };
+    std::atomic<uint64_t> m_frames_dropped { 0 };
+};
@@ -0,0 +1,94 @@
+#include "WaitStrategy.h"
+
+#include <fmt/format.h>
+#include <string.h>
+
+WaitStrategy::WaitStrategy(WaitMode mode, bool is_automatic, uint64_t spin_budget_ns /* DEFAULT_SPIN_BUDGET_NS */)
+    : m_mode(is_automatic ? WaitMode::Block : mode)
+    , m_is_automatic(is_automatic)
+    , m_spin_budget_ns(spin_budget_ns)
+    , m_window_start_ns(get_monotonic_time_ns())
+{
+}
+
+void WaitStrategy::update_mode(uint64_t now)
+{
+    const uint64_t window_ns = now - m_window_start_ns;
+
+    if (!m_is_automatic || window_ns < WINDOW_NS) {
+        return;
+    }
+
+    const uint64_t frame_rate = m_window_frames * 1000000000ull / window_ns;
+
+    m_window_start_ns = now;
+    m_window_frames = 0;
+
+    // Going up takes the full rate, coming back down takes half of it.
+    const WaitMode current_mode = mode();
+    WaitMode new_mode = current_mode;
+    switch (current_mode) {
+    case WaitMode::Block:
+        if (frame_rate >= BUSY_POLL_FRAME_RATE) {
+            new_mode = WaitMode::BusyPoll;
+        } else if (frame_rate >= SPIN_FRAME_RATE) {
+            new_mode = WaitMode::SpinThenPark;
+        }
+        break;
+    case WaitMode::SpinThenPark:
+        if (frame_rate >= BUSY_POLL_FRAME_RATE) {
+            new_mode = WaitMode::BusyPoll;
+        } else if (frame_rate < SPIN_FRAME_RATE / 2) {
+            new_mode = WaitMode::Block;
+        }
+        break;
+    case WaitMode::BusyPoll:
+        if (frame_rate < SPIN_FRAME_RATE / 2) {
+            new_mode = WaitMode::Block;
+        } else if (frame_rate < BUSY_POLL_FRAME_RATE / 2) {
+            new_mode = WaitMode::SpinThenPark;
+        }
+        break;
+    }
+
+    if (new_mode == current_mode) {
+        return;
+    }
+
+    fmt::print("WaitStrategy: {} -> {} ({} frames/s)\n", mode_name(current_mode), mode_name(new_mode), frame_rate);
+
+    m_mode.store(new_mode, std::memory_order_relaxed);
+    m_mode_switches.fetch_add(1, std::memory_order_relaxed);
+}
+
+const char* WaitStrategy::mode_name(WaitMode mode)
+{
+    switch (mode) {
+    case WaitMode::Block:
+        return "block";
+    case WaitMode::SpinThenPark:
+        return "spin";
+    case WaitMode::BusyPoll:
+        return "busy";
+    }
+    return "unknown";
+}
+
+bool WaitStrategy::parse_mode(const char* name, WaitMode* mode, bool* is_automatic)
+{
+    *is_automatic = false;
+
+    if (strcmp(name, "block") == 0) {
+        *mode = WaitMode::Block;
+    } else if (strcmp(name, "spin") == 0) {
+        *mode = WaitMode::SpinThenPark;
+    } else if (strcmp(name, "busy") == 0) {
+        *mode = WaitMode::BusyPoll;
+    } else if (strcmp(name, "auto") == 0) {
+        *mode = WaitMode::Block;
+        *is_automatic = true;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <get_monotonic_time_ns.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decides how the dispatch loop waits for work.
+// Parking (blocking in the kernel) costs a syscall and a wakeup, but no
+// CPU while idle, which is what we want when the car is off.
+// Polling costs a core, but a frame is picked up the moment it arrives,
+// which is what we want while streaming diagnostics with the engine running.
+
+// With automatic switching, the loop reports how many frames it handled,
+// and once per WINDOW_NS the mode is picked from the frame rate:
+// - Below SPIN_FRAME_RATE: Block
+// - Below BUSY_POLL_FRAME_RATE: SpinThenPark
+// - Otherwise: BusyPoll
+// A mode is only left once the rate drops under half of what it took to
+// get into it, so we don't flip flop around a threshold.
+
+enum class WaitMode : uint8_t {
+    // Always park.
+    Block,
+    // Poll for up to the spin budget, then park.
+    SpinThenPark,
+    // Never park.
+    BusyPoll,
+};
+
+class WaitStrategy {
+public:
+    static constexpr uint64_t DEFAULT_SPIN_BUDGET_NS = 50 * 1000;
+    static constexpr uint64_t WINDOW_NS = 1000 * 1000 * 1000;
+    static constexpr uint64_t SPIN_FRAME_RATE = 2000;
+    static constexpr uint64_t BUSY_POLL_FRAME_RATE = 20000;
+
+    WaitStrategy(WaitMode mode, bool is_automatic, uint64_t spin_budget_ns = DEFAULT_SPIN_BUDGET_NS);
+    ~WaitStrategy() = default;
+
+    WaitStrategy(const WaitStrategy&) = delete;
+    WaitStrategy& operator=(const WaitStrategy&) = delete;
+
+    // Waits until poll() returns true, or park() returns.
+    // poll() checks for work without blocking (it may also do the work), and
+    // park() blocks until there is work, it must never miss a wakeup.
+    template<typename Poll, typename Park>
+    void wait(Poll poll, Park park)
+    {
+        uint64_t now = get_monotonic_time_ns();
+        update_mode(now);
+
+        if (mode() != WaitMode::Block) {
+            const uint64_t spin_until = now + m_spin_budget_ns;
+
+            for (;;) {
+                if (poll()) {
+                    m_polls_with_work.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                cpu_relax();
+                now = get_monotonic_time_ns();
+
+                // In automatic mode, a busy poll that has gone quiet falls back to parking.
+                if (mode() == WaitMode::BusyPoll && now >= m_window_start_ns + WINDOW_NS) {
+                    update_mode(now);
+                }
+
+                const auto current_mode = mode();
+                if (current_mode == WaitMode::Block || (current_mode == WaitMode::SpinThenPark && now >= spin_until)) {
+                    break;
+                }
+            }
+        }
+
+        park();
+
+        m_wakeups.fetch_add(1, std::memory_order_relaxed);
+        m_parked_ns.fetch_add(get_monotonic_time_ns() - now, std::memory_order_relaxed);
+    }
+
+    // Called by the dispatch loop, with the amount of frames it just handled.
+    void record_frames(size_t frame_count) { m_window_frames += frame_count; }
+
+    // Counters, safe to read from any thread.
+    WaitMode mode() const { return m_mode.load(std::memory_order_relaxed); }
+    bool is_automatic() const { return m_is_automatic; }
+    uint64_t wakeups() const { return m_wakeups.load(std::memory_order_relaxed); }
+    uint64_t parked_ns() const { return m_parked_ns.load(std::memory_order_relaxed); }
+    uint64_t polls_with_work() const { return m_polls_with_work.load(std::memory_order_relaxed); }
+    uint64_t mode_switches() const { return m_mode_switches.load(std::memory_order_relaxed); }
+
+    static const char* mode_name(WaitMode mode);
+
+    // Parses "block", "spin", "busy", or "auto". Returns false if name isn't one of them.
+    static bool parse_mode(const char* name, WaitMode* mode, bool* is_automatic);
+
+private:
+    static void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    void update_mode(uint64_t now);
+
+    // Only written by the dispatch thread.
+    std::atomic<WaitMode> m_mode;
+    bool m_is_automatic;
+    uint64_t m_spin_budget_ns;
+
+    uint64_t m_window_start_ns { 0 };
+    uint64_t m_window_frames { 0 };
+
+    std::atomic<uint64_t> m_wakeups { 0 };
+    std::atomic<uint64_t> m_parked_ns { 0 };
+    std::atomic<uint64_t> m_polls_with_work { 0 };
+    std::atomic<uint64_t> m_mode_switches { 0 };
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "AutomatoInterface.h"
+
+#include <mutex>
+
+// Lets several threads send through the same interface, by only
+// letting one of them send at a time.
+// Reading is left to the interface's own thread, so read_frame()
+// always fails, and this interface can't be polled.
+
+class LockedInterface : public AutomatoInterface {
+public:
+    explicit LockedInterface(AutomatoInterface& interface)
+        : m_interface(interface)
+    {
+    }
+    ~LockedInterface() = default;
+
+    bool read_frame(CAN::Frame*) override { return false; }
+
+    bool send_frame(const CAN::Frame& frame) override
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_interface.send_frame(frame);
+    }
+
+    size_t send_frames(const CAN::Frame frames[], size_t frame_count) override
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_interface.send_frames(frames, frame_count);
+    }
+
+private:
+    AutomatoInterface& m_interface;
+    std::mutex m_lock;
+};
@@ -0,0 +1,103 @@
+#include "SerialFramer.h"
+
+#include <CanSerializer.h>
+#include <SerialCommon.h>
+#include <fmt/color.h>
+#include <fmt/format.h>
+
+SerialFramer::SerialFramer()
+{
+    m_module_output.reserve(512); // 512 Bytes
+}
+
+size_t SerialFramer::consume(const uint8_t bytes[], size_t size, std::vector<CAN::Frame>& frames)
+{
+    size_t frames_found = 0;
+
+    for (size_t i = 0; i < size; i += 1) {
+        const uint8_t byte = bytes[i];
+
+        if (!m_currently_reading) {
+            if (byte == SERIAL_MESSAGE_START_BYTE) {
+                // New Frame
+                reset_frame();
+                m_currently_reading = true;
+                continue;
+            }
+
+            // We parsed a byte of data, but we didn't get a start byte,
+            // This might be garbage, or it might be a module we're
+            // connected to via serial, sending out bytes via
+            // Serial.print / .println / .write. etc
+            append_module_output(byte);
+            continue;
+        }
+
+        if (m_expected_frame_size && m_frame_bytes_index == m_expected_frame_size) {
+            // We have every byte of the frame, the only thing
+            // left is the stop byte.
+            const uint8_t frame_size = m_expected_frame_size;
+            reset_frame();
+
+            if (byte == SERIAL_MESSAGE_STOP_BYTE) {
+                frames.push_back(CAN::deserialize_frame(m_frame_bytes, frame_size));
+                m_frames_parsed += 1;
+                frames_found += 1;
+                continue;
+            }
+
+            // We lost a byte somewhere, throw away what we have
+            // and try to sync back up with the next start byte.
+            m_frames_dropped += 1;
+            m_currently_reading = (byte == SERIAL_MESSAGE_START_BYTE);
+            continue;
+        }
+
+        m_frame_bytes[m_frame_bytes_index++] = byte;
+
+        if (m_frame_bytes_index == FRAME_HEADER_SIZE) {
+            const uint8_t can_dlc = m_frame_bytes[FRAME_HEADER_SIZE - 1];
+
+            if (can_dlc > 8) {
+                // Not a valid frame, we most likely started
+                // reading in the middle of one.
+                m_frames_dropped += 1;
+                reset_frame();
+                continue;
+            }
+
+            m_expected_frame_size = FRAME_HEADER_SIZE + can_dlc;
+        }
+    }
+
+    return frames_found;
+}
+
+void SerialFramer::print_module_output()
+{
+    if (m_module_output.size() == 0) {
+        return;
+    }
+
+    fmt::print(fmt::fg(fmt::color::yellow), "> {}", fmt::join(m_module_output, ""));
+
+    m_module_output.clear();
+}
+
+void SerialFramer::reset_frame()
+{
+    m_frame_bytes_index = 0;
+    m_expected_frame_size = 0;
+    m_currently_reading = false;
+}
+
+void SerialFramer::append_module_output(uint8_t byte)
+{
+    // We accumulate these bytes, and print them out when
+    // we receive a \n, as an easy way of seeing module logging
+    m_module_output.push_back(byte);
+
+    if (byte == '\n') {
+        print_module_output();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <CanFrame.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Serial Frame Format:
+// byte[0]: SERIAL_MESSAGE_START_BYTE
+// byte[1..5]: can_id + can_dlc, see CanSerializer.h
+// byte[6..n]: can_dlc bytes of frame data
+// byte[n + 1]: SERIAL_MESSAGE_STOP_BYTE
+
+// The SerialFramer turns a stream of bytes from a serial port into
+// CAN::Frames. It does no I/O on its own, whoever owns the file
+// descriptor reads as many bytes as they can, and hands them over.
+// Partially received frames are kept between calls, so a frame can
+// be split across any number of reads.
+
+// Since the serial format does not escape the start/stop bytes,
+// we use the can_dlc byte to know exactly where a frame has to end,
+// which lets frame data contain SERIAL_MESSAGE_STOP_BYTE
+// (aka CAN::Primitive::BOOL_1_BYTES) without cutting the frame short.
+
+class SerialFramer {
+public:
+    SerialFramer();
+    ~SerialFramer() = default;
+
+    // Scans size bytes for frames, appending every complete frame to frames.
+    // Returns the amount of frames appended.
+    size_t consume(const uint8_t bytes[], size_t size, std::vector<CAN::Frame>& frames);
+
+    // Prints, and then clears, any bytes we read that were not
+    // part of a frame.
+    void print_module_output();
+
+    uint64_t frames_parsed() const { return m_frames_parsed; }
+    uint64_t frames_dropped() const { return m_frames_dropped; }
+
+private:
+    void reset_frame();
+    void append_module_output(uint8_t byte);
+
+    // 4 bytes for can_id + 1 byte for can_dlc
+    static constexpr uint8_t FRAME_HEADER_SIZE = 4 + 1;
+
+    uint8_t m_frame_bytes[CAN::Frame::MAX_SERIALIZED_SIZE];
+    uint8_t m_frame_bytes_index { 0 };
+    uint8_t m_expected_frame_size { 0 };
+    bool m_currently_reading { false };
+
+    // Modules connected to us over serial may also be printing
+    // via Serial.print / .println / .write. etc
+    std::vector<char> m_module_output;
+
+    uint64_t m_frames_parsed { 0 };
+    uint64_t m_frames_dropped { 0 };
+};
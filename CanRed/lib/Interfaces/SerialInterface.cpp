@@ -3,14 +3,14 @@
 #include <CanSerializer.h>
 #include <SerialCommon.h>
 #include <fcntl.h> /* open() */
-#include <fmt/color.h>
 #include <fmt/format.h>
 #include <string.h>  /* strerror() */
+#include <sys/uio.h> /* writev() */
 #include <termios.h> /* termios */
 #include <thread>
 #include <unistd.h> /* read() */
 
-SerialInterface::SerialInterface(const char* serial_port /* /dev/ttyUSB0 */) noexcept
+SerialInterface::SerialInterface(const char* serial_port /* /dev/ttyUSB0 */, size_t read_buffer_size /* READ_BUFFER_SIZE */) noexcept
     : m_serial_port_filename(serial_port)
 {
     m_file_descriptor = get_file_descriptor();
@@ -20,21 +20,52 @@ SerialInterface::SerialInterface(const char* serial_port /* /dev/ttyUSB0 */) noe
         exit(0);
     }
 
-    m_bytes.reserve(CAN::Frame::MAX_SERIALIZED_SIZE);
     configure_serial_port();
 
-    m_module_output.reserve(512); // 512 Bytes
+    m_read_buffer.resize(read_buffer_size > 0 ? read_buffer_size : 1);
+
+    // A full read buffer can hold a frame for every 15 bytes.
+    m_pending_frames.reserve(m_read_buffer.size() / (CAN::Frame::MAX_SERIALIZED_SIZE + 2) + 1);
 }
 
-// This function maintains its own state.
 bool SerialInterface::read_frame(CAN::Frame* frame)
 {
-    // const size_t READ_BUFFER_MAX_SIZE = 1024; // 1KB TODO
-    const size_t READ_BUFFER_MAX_SIZE = 1; // 1B
-    static uint8_t buffer[READ_BUFFER_MAX_SIZE];
-    static bool currently_reading = false;
+    if (m_pending_frames_index == m_pending_frames.size()) {
+        // We've handed out every frame from our last read.
+        m_pending_frames.clear();
+        m_pending_frames_index = 0;
+
+        if (!read_into_framer(m_pending_frames) || m_pending_frames.empty()) {
+            return false;
+        }
+    }
+
+    *frame = m_pending_frames[m_pending_frames_index];
+    m_pending_frames_index += 1;
+    return true;
+}
+
+size_t SerialInterface::read_frames(std::vector<CAN::Frame>& frames)
+{
+    const size_t starting_size = frames.size();
+
+    // Hand out anything read_frame() didn't get to first.
+    if (m_pending_frames_index < m_pending_frames.size()) {
+        frames.insert(frames.end(), m_pending_frames.begin() + m_pending_frames_index, m_pending_frames.end());
+        m_pending_frames.clear();
+        m_pending_frames_index = 0;
+        return frames.size() - starting_size;
+    }
+
+    read_into_framer(frames);
 
-    ssize_t bytes_read = read(m_file_descriptor, &buffer, READ_BUFFER_MAX_SIZE);
+    return frames.size() - starting_size;
+}
+
+bool SerialInterface::read_into_framer(std::vector<CAN::Frame>& frames)
+{
+    ssize_t bytes_read = read(m_file_descriptor, m_read_buffer.data(), m_read_buffer.size());
+    m_read_calls += 1;
 
     if (bytes_read == -1) {
         fmt::print("Some error happened with read in serial interface\n");
@@ -42,82 +73,83 @@ bool SerialInterface::read_frame(CAN::Frame* frame)
     }
 
     if (bytes_read == 0) {
-        print_module_output();
+        m_framer.print_module_output();
         // We timed out, return control flow back to whoever called us.
         return false;
     }
 
-    for (ssize_t i = 0; i < bytes_read; i += 1) {
+    m_framer.consume(m_read_buffer.data(), bytes_read, frames);
+    return true;
+}
 
-        if (buffer[i] == SERIAL_MESSAGE_START_BYTE && !currently_reading) {
-            // New Frame
+bool SerialInterface::send_frame(const CAN::Frame& frame)
+{
+    return send_frames(&frame, 1) == 1;
+}
 
-            currently_reading = true;
-            continue;
-        }
-        if (buffer[i] == SERIAL_MESSAGE_STOP_BYTE && currently_reading) {
-            // We're finished reading a frame
+size_t SerialInterface::send_frames(const CAN::Frame frames[], size_t frame_count)
+{
+    size_t frames_sent = 0;
 
-            currently_reading = false;
+    while (frames_sent < frame_count) {
+        const size_t frames_left = frame_count - frames_sent;
+        const size_t batch_size = (frames_left < SEND_BATCH_SIZE) ? frames_left : SEND_BATCH_SIZE;
 
-            *frame = CAN::deserialize_frame(m_bytes.data(), m_bytes.size());
+        for (size_t i = 0; i < batch_size; i += 1) {
+            uint8_t* buffer = m_send_buffer[i];
 
-            m_bytes.clear();
-            return true;
-        }
+            buffer[0] = SERIAL_MESSAGE_START_BYTE;
+            const uint8_t bytes_used = CAN::serialize_frame(frames[frames_sent + i], &buffer[1]);
+            buffer[1 + bytes_used] = SERIAL_MESSAGE_STOP_BYTE;
 
-        if (currently_reading) {
-            // We were expecting a byte and got one.
-            m_bytes.push_back(buffer[i]);
-            continue;
+            m_send_iovecs[i].iov_base = buffer;
+            m_send_iovecs[i].iov_len = bytes_used + 2;
         }
 
-        if (!currently_reading) {
-            // We parsed a byte of data, but we didn't get a start byte,
-            // This might be garbage, or it might be a module we're
-            // connected to via serial, sending out bytes via
-            // Serial.print / .println / .write. etc
-            // We accumulate these bytes, and print them out when
-            // we receive a \n, so we can print them out via fmt::print
-            // As an easy way of seeing module logging
-            m_module_output.push_back(buffer[i]);
-
-            if (buffer[i] == '\n') {
-                print_module_output();
-            }
-            continue;
+        if (!write_staged_frames(batch_size)) {
+            return frames_sent;
         }
+
+        frames_sent += batch_size;
     }
 
-    __builtin_unreachable();
-    return false;
+    return frames_sent;
 }
 
-bool SerialInterface::send_frame(const CAN::Frame& frame)
+bool SerialInterface::write_staged_frames(size_t frame_count)
 {
-    // + 2 For start/stop bytes
-    uint8_t buffer[CAN::Frame::MAX_SERIALIZED_SIZE + 2];
-
-    buffer[0] = SERIAL_MESSAGE_START_BYTE;
-
-    uint8_t bytes_used = CAN::serialize_frame(frame, &buffer[1]);
+    iovec* iovecs = m_send_iovecs;
+    size_t iovec_count = frame_count;
 
-    buffer[1 + bytes_used] = SERIAL_MESSAGE_STOP_BYTE;
+    // A serial port can accept less than we asked it to write.
+    while (iovec_count > 0) {
+        auto write_rc = writev(m_file_descriptor, iovecs, iovec_count);
+        m_write_calls += 1;
 
-    auto write_rc = write(m_file_descriptor, buffer, bytes_used + 2);
+        if (write_rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fmt::print("Some error happened with write in serial interface\n");
+            return false;
+        }
 
-    return write_rc != -1;
-}
+        // Skip past every frame that was fully written, and
+        // whatever part of the next one made it out.
+        size_t bytes_written = write_rc;
+        while (iovec_count > 0 && bytes_written >= iovecs->iov_len) {
+            bytes_written -= iovecs->iov_len;
+            iovecs += 1;
+            iovec_count -= 1;
+        }
 
-void SerialInterface::print_module_output()
-{
-    if (m_module_output.size() == 0) {
-        return;
+        if (iovec_count > 0) {
+            iovecs->iov_base = static_cast<uint8_t*>(iovecs->iov_base) + bytes_written;
+            iovecs->iov_len -= bytes_written;
+        }
     }
 
-    fmt::print(fmt::fg(fmt::color::yellow), "> {}", fmt::join(m_module_output, ""));
-
-    m_module_output.clear();
+    return true;
 }
 
 int32_t SerialInterface::get_file_descriptor()
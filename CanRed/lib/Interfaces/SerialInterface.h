@@ -4,24 +4,66 @@
 // or, we should define some common start and stop bytes.
 
 #include "AutomatoInterface.h"
+#include "SerialFramer.h"
+
+#include <sys/uio.h>
+#include <vector>
 
 class SerialInterface : public AutomatoInterface {
 public:
-    explicit SerialInterface(const char* serial_port = "/dev/ttyUSB0") noexcept;
+    // How many bytes we ask read() for at once, a read returns
+    // early with whatever is available, so this is only an upper bound.
+    static constexpr size_t READ_BUFFER_SIZE = 1024; // 1KB
+
+    // Frames we serialize ahead of a single writev(), more than this are
+    // written in several. A whole long frame group (at most 38 frames) fits.
+    static constexpr size_t SEND_BATCH_SIZE = 64;
+
+    explicit SerialInterface(const char* serial_port = "/dev/ttyUSB0", size_t read_buffer_size = READ_BUFFER_SIZE) noexcept;
     ~SerialInterface() = default;
 
     bool read_frame(CAN::Frame* frame) override;
     bool send_frame(const CAN::Frame& frame) override;
 
+    // Blocks until atleast one read() completes, and appends every
+    // frame we have fully received to frames.
+    // Returns the amount of frames appended.
+    size_t read_frames(std::vector<CAN::Frame>& frames) override;
+
+    // Serializes frames into our staging slots, and writev()s up to
+    // SEND_BATCH_SIZE of them at once. Nothing is allocated.
+    size_t send_frames(const CAN::Frame frames[], size_t frame_count) override;
+
+    int32_t file_descriptor() const override { return m_file_descriptor; }
+
+    uint64_t read_calls() const { return m_read_calls; }
+    uint64_t write_calls() const { return m_write_calls; }
+    uint64_t frames_read() const { return m_framer.frames_parsed(); }
+
 private:
     const char* m_serial_port_filename;
 
     int32_t get_file_descriptor();
     bool configure_serial_port();
 
-    void print_module_output();
+    // Does a single read() and hands every byte to the framer.
+    bool read_into_framer(std::vector<CAN::Frame>& frames);
+
+    // writev()s every staged slot, retrying whatever a partial write left behind.
+    bool write_staged_frames(size_t frame_count);
+
+    SerialFramer m_framer;
+    std::vector<uint8_t> m_read_buffer;
+
+    // + 2 For start/stop bytes
+    uint8_t m_send_buffer[SEND_BATCH_SIZE][CAN::Frame::MAX_SERIALIZED_SIZE + 2];
+    iovec m_send_iovecs[SEND_BATCH_SIZE];
+
+    // Frames we've parsed, but that read_frame() hasn't returned yet.
+    std::vector<CAN::Frame> m_pending_frames;
+    size_t m_pending_frames_index { 0 };
 
-    std::vector<uint8_t> m_bytes;
-    std::vector<char> m_module_output;
+    uint64_t m_read_calls { 0 };
+    uint64_t m_write_calls { 0 };
     int32_t m_file_descriptor;
 };
@@ -0,0 +1,193 @@
+#include "SocketCanInterface.h"
+
+#include <errno.h>
+#include <fmt/format.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+void to_can_frame(const CAN::Frame& frame, can_frame* out)
+{
+    memset(out, 0, sizeof(can_frame));
+    out->can_id = frame.extended_can_id() | CAN_EFF_FLAG;
+    out->can_dlc = frame.can_dlc;
+    memcpy(out->data, frame.data, frame.can_dlc);
+}
+
+} // namespace
+
+SocketCanInterface::SocketCanInterface(const char* interface_name /* can0 */) noexcept
+{
+    m_file_descriptor = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+
+    if (m_file_descriptor == -1) {
+        fmt::print("SocketCanInterface: Could not create a CAN socket: {}\n", strerror(errno));
+        exit(1);
+    }
+
+    ifreq request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.ifr_name, interface_name, IFNAMSIZ - 1);
+
+    if (ioctl(m_file_descriptor, SIOCGIFINDEX, &request) == -1) {
+        fmt::print("SocketCanInterface: Could not find CAN interface {}: {}\n", interface_name, strerror(errno));
+        exit(1);
+    }
+
+    sockaddr_can address;
+    memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    address.can_ifindex = request.ifr_ifindex;
+
+    if (bind(m_file_descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        fmt::print("SocketCanInterface: Could not bind to {}: {}\n", interface_name, strerror(errno));
+        exit(1);
+    }
+
+    setup_batches();
+}
+
+SocketCanInterface::SocketCanInterface(int32_t file_descriptor) noexcept
+    : m_file_descriptor(file_descriptor)
+{
+    setup_batches();
+}
+
+SocketCanInterface::~SocketCanInterface()
+{
+    close(m_file_descriptor);
+}
+
+void SocketCanInterface::setup_batches()
+{
+    // Every message points at its own can_frame for the whole
+    // lifetime of the interface, so a batch never allocates.
+    memset(m_receive_messages, 0, sizeof(m_receive_messages));
+    memset(m_send_messages, 0, sizeof(m_send_messages));
+
+    for (size_t i = 0; i < BATCH_SIZE; i += 1) {
+        m_receive_iovecs[i].iov_base = &m_receive_buffer[i];
+        m_receive_iovecs[i].iov_len = sizeof(can_frame);
+        m_receive_messages[i].msg_hdr.msg_iov = &m_receive_iovecs[i];
+        m_receive_messages[i].msg_hdr.msg_iovlen = 1;
+
+        m_send_iovecs[i].iov_base = &m_send_buffer[i];
+        m_send_iovecs[i].iov_len = sizeof(can_frame);
+        m_send_messages[i].msg_hdr.msg_iov = &m_send_iovecs[i];
+        m_send_messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    m_pending_frames.reserve(BATCH_SIZE);
+}
+
+bool SocketCanInterface::read_frame(CAN::Frame* frame)
+{
+    if (m_pending_frames_index == m_pending_frames.size()) {
+        // We've handed out every frame from our last batch.
+        m_pending_frames.clear();
+        m_pending_frames_index = 0;
+
+        if (!receive_batch(m_pending_frames) || m_pending_frames.empty()) {
+            return false;
+        }
+    }
+
+    *frame = m_pending_frames[m_pending_frames_index];
+    m_pending_frames_index += 1;
+    return true;
+}
+
+size_t SocketCanInterface::read_frames(std::vector<CAN::Frame>& frames)
+{
+    const size_t starting_size = frames.size();
+
+    // Hand out anything read_frame() didn't get to first.
+    if (m_pending_frames_index < m_pending_frames.size()) {
+        frames.insert(frames.end(), m_pending_frames.begin() + m_pending_frames_index, m_pending_frames.end());
+        m_pending_frames.clear();
+        m_pending_frames_index = 0;
+        return frames.size() - starting_size;
+    }
+
+    receive_batch(frames);
+
+    return frames.size() - starting_size;
+}
+
+bool SocketCanInterface::receive_batch(std::vector<CAN::Frame>& frames)
+{
+    // MSG_WAITFORONE: block for the first frame, then take
+    // whatever else is already queued without waiting for more.
+    int messages_read = recvmmsg(m_file_descriptor, m_receive_messages, BATCH_SIZE, MSG_WAITFORONE, nullptr);
+    m_read_calls += 1;
+
+    if (messages_read == -1) {
+        fmt::print("SocketCanInterface: recvmmsg() failed: {}\n", strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < messages_read; i += 1) {
+        const can_frame& frame = m_receive_buffer[i];
+
+        // We only speak extended data frames, anything else
+        // (standard ids, remote frames, error frames) isn't for us.
+        const bool is_extended_data_frame = (frame.can_id & CAN_EFF_FLAG) && !(frame.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG));
+
+        if (m_receive_messages[i].msg_len != sizeof(can_frame) || !is_extended_data_frame || frame.can_dlc > 8) {
+            m_frames_dropped += 1;
+            continue;
+        }
+
+        frames.push_back(CAN::Frame(CAN::ID::from_extended_can_id(frame.can_id & CAN_EFF_MASK), frame.data, frame.can_dlc));
+        m_frames_read += 1;
+    }
+
+    return true;
+}
+
+bool SocketCanInterface::send_frame(const CAN::Frame& frame)
+{
+    return send_frames(&frame, 1) == 1;
+}
+
+size_t SocketCanInterface::send_frames(const CAN::Frame frames[], size_t frame_count)
+{
+    size_t frames_sent = 0;
+
+    while (frames_sent < frame_count) {
+        const size_t frames_left = frame_count - frames_sent;
+        const size_t batch_size = (frames_left < BATCH_SIZE) ? frames_left : BATCH_SIZE;
+
+        for (size_t i = 0; i < batch_size; i += 1) {
+            to_can_frame(frames[frames_sent + i], &m_send_buffer[i]);
+        }
+
+        // sendmmsg() may send only part of a batch, so resend the rest.
+        size_t batch_sent = 0;
+        while (batch_sent < batch_size) {
+            int messages_sent = sendmmsg(m_file_descriptor, &m_send_messages[batch_sent], batch_size - batch_sent, 0);
+            m_write_calls += 1;
+
+            if (messages_sent == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                fmt::print("SocketCanInterface: sendmmsg() failed: {}\n", strerror(errno));
+                m_frames_sent += batch_sent;
+                return frames_sent + batch_sent;
+            }
+
+            batch_sent += messages_sent;
+        }
+
+        frames_sent += batch_sent;
+        m_frames_sent += batch_sent;
+    }
+
+    return frames_sent;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "AutomatoInterface.h"
+
+#include <linux/can.h>
+#include <sys/socket.h>
+#include <vector>
+
+// An interface for a CAN controller the kernel knows about (can0, vcan0, etc),
+// using a raw SocketCAN socket. Frames are sent as extended frames, using
+// CAN::ID::extended_can_id() as the 29 bit id.
+
+// Reads and writes use recvmmsg()/sendmmsg(), so a busy bus costs
+// one syscall per batch of frames, instead of one per frame.
+
+class SocketCanInterface : public AutomatoInterface {
+public:
+    // The most frames we move with a single syscall.
+    static constexpr size_t BATCH_SIZE = 64;
+
+    // Binds to the given network interface, eg: "can0" or "vcan0".
+    explicit SocketCanInterface(const char* interface_name = "can0") noexcept;
+
+    // Takes ownership of an already connected socket that sends and
+    // receives struct can_frame's, like one end of a socketpair().
+    explicit SocketCanInterface(int32_t file_descriptor) noexcept;
+
+    ~SocketCanInterface();
+
+    SocketCanInterface(const SocketCanInterface&) = delete;
+    SocketCanInterface& operator=(const SocketCanInterface&) = delete;
+
+    bool read_frame(CAN::Frame* frame) override;
+    bool send_frame(const CAN::Frame& frame) override;
+
+    // Blocks until atleast one frame arrives, then appends it and
+    // every other frame already waiting, up to BATCH_SIZE.
+    // Returns the amount of frames appended.
+    size_t read_frames(std::vector<CAN::Frame>& frames) override;
+
+    // Sends frame_count frames, BATCH_SIZE frames per sendmmsg().
+    // Returns the amount of frames sent.
+    size_t send_frames(const CAN::Frame frames[], size_t frame_count) override;
+
+    int32_t file_descriptor() const override { return m_file_descriptor; }
+
+    uint64_t read_calls() const { return m_read_calls; }
+    uint64_t frames_read() const { return m_frames_read; }
+    uint64_t write_calls() const { return m_write_calls; }
+    uint64_t frames_sent() const { return m_frames_sent; }
+
+    // Frames we received that weren't extended data frames.
+    uint64_t frames_dropped() const { return m_frames_dropped; }
+
+private:
+    void setup_batches();
+
+    // Does a single recvmmsg(), appending every valid frame to frames.
+    bool receive_batch(std::vector<CAN::Frame>& frames);
+
+    can_frame m_receive_buffer[BATCH_SIZE];
+    iovec m_receive_iovecs[BATCH_SIZE];
+    mmsghdr m_receive_messages[BATCH_SIZE];
+
+    can_frame m_send_buffer[BATCH_SIZE];
+    iovec m_send_iovecs[BATCH_SIZE];
+    mmsghdr m_send_messages[BATCH_SIZE];
+
+    // Frames we've received, but that read_frame() hasn't returned yet.
+    std::vector<CAN::Frame> m_pending_frames;
+    size_t m_pending_frames_index { 0 };
+
+    uint64_t m_read_calls { 0 };
+    uint64_t m_frames_read { 0 };
+    uint64_t m_write_calls { 0 };
+    uint64_t m_frames_sent { 0 };
+    uint64_t m_frames_dropped { 0 };
+
+    int32_t m_file_descriptor { -1 };
+};
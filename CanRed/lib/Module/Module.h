@@ -48,12 +48,14 @@ struct ModuleCommand {
     uint16_t module_uid;
     uint8_t command_uid;
     std::string name;
+    std::string return_format;
 
     bool operator==(const ModuleCommand& other) const
     {
         return (module_uid == other.module_uid
             && command_uid == other.command_uid
-            && name == other.name);
+            && name == other.name
+            && return_format == other.return_format);
     }
 
     void print() const
@@ -0,0 +1,264 @@
+#include "ModuleRegistry.h"
+
+#include <DatabaseWriter.h>
+#include <TypedQuery.h>
+
+namespace {
+
+const char* module_type_name(ModuleType type)
+{
+    return (type == ModuleType::Writer) ? "WRITER" : "READER";
+}
+
+struct DescriptorHash {
+    uint16_t module_uid;
+    uint32_t hash;
+};
+
+} // namespace
+
+// is_active and type are stored as text, the queries below turn them into
+// bools, so every column here is read straight into the struct.
+template<>
+struct QueryRow<Module> {
+    static constexpr int32_t COLUMN_COUNT = 5;
+
+    static void read(sqlite3_stmt* statement, Module& module)
+    {
+        bool is_writer = false;
+        sqlite_read_columns(statement, 0, module.uid, module.active, is_writer, module.name, module.description);
+
+        module.type = is_writer ? ModuleType::Writer : ModuleType::Reader;
+        module.did_come_online = false;
+    }
+};
+
+template<>
+struct QueryRow<ModuleCommand> {
+    static constexpr int32_t COLUMN_COUNT = 4;
+
+    static void read(sqlite3_stmt* statement, ModuleCommand& command)
+    {
+        sqlite_read_columns(statement, 0, command.module_uid, command.command_uid, command.name, command.return_format);
+    }
+};
+
+template<>
+struct QueryRow<DescriptorHash> {
+    static constexpr int32_t COLUMN_COUNT = 2;
+
+    static void read(sqlite3_stmt* statement, DescriptorHash& row)
+    {
+        sqlite_read_columns(statement, 0, row.module_uid, row.hash);
+    }
+};
+
+namespace {
+
+const TypedQuery<Module> select_modules("SELECT uid, is_active = 'TRUE', type = 'WRITER', name, description FROM can_modules");
+const TypedQuery<ModuleCommand> select_module_commands("SELECT module_uid, command_uid, name, return_format FROM can_module_commands");
+const TypedQuery<DescriptorHash> select_descriptor_hashes("SELECT module_uid, descriptor_hash FROM can_module_descriptor_hashes");
+
+const TypedQuery<void, uint16_t, std::string, std::string, std::string> insert_module("INSERT INTO can_modules (uid, type, name, description) VALUES (?, ?, ?, ?)");
+const TypedQuery<void, std::string, std::string, std::string, uint16_t> update_module("UPDATE can_modules SET type = ?, name = ?, description = ? WHERE uid = ?");
+const TypedQuery<void, uint16_t, uint8_t, std::string, std::string> insert_module_command("INSERT INTO can_module_commands (module_uid, command_uid, name, return_format) VALUES (?, ?, ?, ?)");
+const TypedQuery<void, std::string, std::string, uint16_t, uint8_t> update_module_command("UPDATE can_module_commands SET name = ?, return_format = ? WHERE module_uid = ? AND command_uid = ?");
+const TypedQuery<void, uint16_t, uint32_t> insert_descriptor_hash("INSERT OR REPLACE INTO can_module_descriptor_hashes (module_uid, descriptor_hash) VALUES (?, ?)");
+
+} // namespace
+
+ModuleRegistry::ModuleRegistry()
+{
+    select_modules.for_each([this](const Module& module) {
+        m_module_uids_by_name[module.name] = module.uid;
+        m_modules[module.uid] = module;
+    });
+
+    select_module_commands.for_each([this](const ModuleCommand& command) {
+        auto& table = m_command_tables[command.module_uid];
+        table.uids_by_name[command.name] = command.command_uid;
+        table.commands[command.command_uid] = command;
+    });
+
+    select_descriptor_hashes.for_each([this](const DescriptorHash& row) {
+        m_descriptor_hashes[row.module_uid] = row.hash;
+    });
+}
+
+bool ModuleRegistry::mark_online(uint16_t uid)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_modules.find(uid);
+    if (iter == m_modules.end()) {
+        return false;
+    }
+
+    iter->second.did_come_online = true;
+    return true;
+}
+
+bool ModuleRegistry::has_module(uint16_t uid) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_modules.count(uid) != 0;
+}
+
+bool ModuleRegistry::find_module(uint16_t uid, Module* module) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_modules.find(uid);
+    if (iter == m_modules.end()) {
+        return false;
+    }
+
+    *module = iter->second;
+    return true;
+}
+
+bool ModuleRegistry::find_module_uid(const std::string& name, uint16_t* uid) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_module_uids_by_name.find(name);
+    if (iter == m_module_uids_by_name.end()) {
+        return false;
+    }
+
+    *uid = iter->second;
+    return true;
+}
+
+bool ModuleRegistry::find_command(uint16_t module_uid, uint8_t command_uid, ModuleCommand* command) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto table = m_command_tables.find(module_uid);
+    if (table == m_command_tables.end()) {
+        return false;
+    }
+
+    auto iter = table->second.commands.find(command_uid);
+    if (iter == table->second.commands.end()) {
+        return false;
+    }
+
+    *command = iter->second;
+    return true;
+}
+
+bool ModuleRegistry::find_command_uid(uint16_t module_uid, const std::string& command_name, uint8_t* command_uid) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto table = m_command_tables.find(module_uid);
+    if (table == m_command_tables.end()) {
+        return false;
+    }
+
+    auto iter = table->second.uids_by_name.find(command_name);
+    if (iter == table->second.uids_by_name.end()) {
+        return false;
+    }
+
+    *command_uid = iter->second;
+    return true;
+}
+
+StoredModuleStatus ModuleRegistry::insert_or_update_module(const Module& module)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_modules.find(module.uid);
+
+    if (iter == m_modules.end()) {
+        // We're not storing the module, store it!
+        DatabaseWriter::the().write(insert_module, module.uid, module_type_name(module.type), module.name, module.description);
+
+        Module stored_module = module;
+        stored_module.active = true;
+
+        m_module_uids_by_name[module.name] = module.uid;
+        m_modules[module.uid] = stored_module;
+        return StoredModuleStatus::NOT_STORED;
+    }
+
+    auto& stored_module = iter->second;
+    if (stored_module == module) {
+        return StoredModuleStatus::NOT_MODIFIED;
+    }
+
+    DatabaseWriter::the().write(update_module, module_type_name(module.type), module.name, module.description, module.uid);
+
+    // The module might have been renamed.
+    m_module_uids_by_name.erase(stored_module.name);
+    m_module_uids_by_name[module.name] = module.uid;
+
+    stored_module.type = module.type;
+    stored_module.name = module.name;
+    stored_module.description = module.description;
+    return StoredModuleStatus::MODIFIED;
+}
+
+StoredModuleStatus ModuleRegistry::insert_or_update_module_command(const ModuleCommand& command)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto& table = m_command_tables[command.module_uid];
+    auto iter = table.commands.find(command.command_uid);
+
+    if (iter == table.commands.end()) {
+        // We're not storing the command, store it!
+        DatabaseWriter::the().write(insert_module_command, command.module_uid, command.command_uid, command.name, command.return_format);
+
+        table.uids_by_name[command.name] = command.command_uid;
+        table.commands[command.command_uid] = command;
+        return StoredModuleStatus::NOT_STORED;
+    }
+
+    auto& stored_command = iter->second;
+    if (stored_command == command) {
+        return StoredModuleStatus::NOT_MODIFIED;
+    }
+
+    DatabaseWriter::the().write(update_module_command, command.name, command.return_format, command.module_uid, command.command_uid);
+
+    table.uids_by_name.erase(stored_command.name);
+    table.uids_by_name[command.name] = command.command_uid;
+
+    stored_command = command;
+    return StoredModuleStatus::MODIFIED;
+}
+
+bool ModuleRegistry::find_descriptor_hash(uint16_t uid, uint32_t* hash) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_descriptor_hashes.find(uid);
+    if (iter == m_descriptor_hashes.end()) {
+        return false;
+    }
+
+    *hash = iter->second;
+    return true;
+}
+
+void ModuleRegistry::store_descriptor_hash(uint16_t uid, uint32_t hash)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_descriptor_hashes.find(uid);
+    if (iter != m_descriptor_hashes.end() && iter->second == hash) {
+        return;
+    }
+
+    DatabaseWriter::the().write(insert_descriptor_hash, uid, hash);
+    m_descriptor_hashes[uid] = hash;
+}
+
+size_t ModuleRegistry::module_count() const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_modules.size();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Module.h>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+// Every module, module command, and descriptor hash we've stored in the database, kept in memory.
+// Loaded once at startup, after that lookups never touch the database,
+// and every change is made to us, and queued on the DatabaseWriter,
+// so whoever made it never waits on the disk.
+
+// Shared between everything that handles frames, events, and socket
+// requests, so every function here is safe to call from any thread.
+
+class ModuleRegistry {
+public:
+    // Loads every stored module, and module command from the database.
+    ModuleRegistry();
+    ~ModuleRegistry() = default;
+
+    ModuleRegistry(const ModuleRegistry&) = delete;
+    ModuleRegistry& operator=(const ModuleRegistry&) = delete;
+
+    // Returns false if we don't have a module with the given uid.
+    bool mark_online(uint16_t uid);
+
+    bool has_module(uint16_t uid) const;
+
+    // Lookups return false if there's no such module/command.
+    bool find_module(uint16_t uid, Module* module) const;
+    bool find_module_uid(const std::string& name, uint16_t* uid) const;
+    bool find_command(uint16_t module_uid, uint8_t command_uid, ModuleCommand* command) const;
+    bool find_command_uid(uint16_t module_uid, const std::string& command_name, uint8_t* command_uid) const;
+
+    // Stores the module/command in the registry, and queues it to be
+    // stored in the database, if it's new or has changed. Returns what we did.
+    StoredModuleStatus insert_or_update_module(const Module& module);
+    StoredModuleStatus insert_or_update_module_command(const ModuleCommand& command);
+
+    // The hash of the last ModuleDescriptor the module sent us,
+    // returns false if it's only ever sent us its JSON configuration.
+    bool find_descriptor_hash(uint16_t uid, uint32_t* hash) const;
+    void store_descriptor_hash(uint16_t uid, uint32_t hash);
+
+    size_t module_count() const;
+
+private:
+    struct CommandTable {
+        std::unordered_map<uint8_t, ModuleCommand> commands;
+        std::unordered_map<std::string, uint8_t> uids_by_name;
+    };
+
+    mutable std::mutex m_lock;
+
+    std::unordered_map<uint16_t, Module> m_modules;
+    std::unordered_map<std::string, uint16_t> m_module_uids_by_name;
+
+    // module_uid -> that module's commands
+    std::unordered_map<uint16_t, CommandTable> m_command_tables;
+
+    std::unordered_map<uint16_t, uint32_t> m_descriptor_hashes;
+};
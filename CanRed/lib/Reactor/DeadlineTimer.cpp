@@ -0,0 +1,44 @@
+#include "DeadlineTimer.h"
+
+#include <errno.h>
+#include <fmt/format.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+DeadlineTimer::DeadlineTimer()
+{
+    // get_monotonic_time_ns() uses steady_clock, which is CLOCK_MONOTONIC.
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if (m_timer_fd == -1) {
+        fmt::print("DeadlineTimer: Failed to create a timerfd, errno={}\n", errno);
+    }
+}
+
+DeadlineTimer::~DeadlineTimer()
+{
+    if (m_timer_fd != -1) {
+        close(m_timer_fd);
+    }
+}
+
+void DeadlineTimer::arm(uint64_t deadline_ns)
+{
+    if (m_timer_fd == -1 || deadline_ns == m_deadline_ns) {
+        return;
+    }
+
+    // An it_value of 0 disarms the timer.
+    itimerspec deadline;
+    memset(&deadline, 0, sizeof(deadline));
+    deadline.it_value.tv_sec = deadline_ns / 1000000000;
+    deadline.it_value.tv_nsec = deadline_ns % 1000000000;
+
+    if (timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &deadline, nullptr) == -1) {
+        fmt::print("DeadlineTimer: Failed to arm the timerfd, errno={}\n", errno);
+        return;
+    }
+
+    m_deadline_ns = deadline_ns;
+}
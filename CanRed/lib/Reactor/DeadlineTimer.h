@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// A one shot timerfd, armed for a deadline on the get_monotonic_time_ns() clock.
+// Its file descriptor becomes readable once the deadline passes, and
+// stays readable until it's read, or the timer is armed again.
+
+class DeadlineTimer {
+public:
+    DeadlineTimer();
+    ~DeadlineTimer();
+
+    DeadlineTimer(const DeadlineTimer&) = delete;
+    DeadlineTimer& operator=(const DeadlineTimer&) = delete;
+
+    // A deadline of 0 disarms the timer. Arming it for the deadline
+    // it's already armed for does nothing, so it's cheap to call often.
+    void arm(uint64_t deadline_ns);
+
+    uint64_t deadline_ns() const { return m_deadline_ns; }
+    int32_t file_descriptor() const { return m_timer_fd; }
+
+private:
+    int32_t m_timer_fd { -1 };
+    // 0 if it isn't armed.
+    uint64_t m_deadline_ns { 0 };
+};
@@ -0,0 +1,133 @@
+#include "Reactor.h"
+
+#include <errno.h>
+#include <fmt/format.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+Reactor::Reactor()
+{
+    memset(m_events, 0, (sizeof(epoll_event) * EPOLL_MAX_EVENTS));
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_epoll_fd == -1) {
+        fmt::print("Reactor: Failed to create an epoll fd!\n");
+        exit(1);
+    }
+}
+
+Reactor::~Reactor()
+{
+    for (const auto file_descriptor : m_owned_fds) {
+        close(file_descriptor);
+    }
+
+    close(m_epoll_fd);
+}
+
+bool Reactor::add(int32_t file_descriptor, const Callback& callback)
+{
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+
+    event.events = (EPOLLIN | EPOLLPRI);
+    event.data.fd = file_descriptor;
+
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, file_descriptor, &event) == -1) {
+        fmt::print("Reactor: Failed to add fd {} to epoll, errno={}\n", file_descriptor, errno);
+        return false;
+    }
+
+    m_callbacks[file_descriptor] = callback;
+    return true;
+}
+
+bool Reactor::remove(int32_t file_descriptor)
+{
+    m_callbacks.erase(file_descriptor);
+
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, file_descriptor, nullptr) == -1) {
+        fmt::print("Reactor: Failed to remove fd {} from epoll, errno={}\n", file_descriptor, errno);
+        return false;
+    }
+    return true;
+}
+
+int32_t Reactor::add_interval_timer(uint32_t interval_ms, const Callback& callback)
+{
+    int32_t timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if (timer_fd == -1) {
+        fmt::print("Reactor: Failed to create a timerfd, errno={}\n", errno);
+        return -1;
+    }
+
+    itimerspec interval;
+    memset(&interval, 0, sizeof(interval));
+
+    interval.it_interval.tv_sec = interval_ms / 1000;
+    interval.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+    interval.it_value = interval.it_interval;
+
+    if (timerfd_settime(timer_fd, 0, &interval, nullptr) == -1) {
+        fmt::print("Reactor: Failed to arm a timerfd, errno={}\n", errno);
+        close(timer_fd);
+        return -1;
+    }
+
+    m_owned_fds.push_back(timer_fd);
+
+    add(timer_fd, [timer_fd, callback]() {
+        // Reading clears the expiration count, if we don't,
+        // epoll will keep telling us the timer is readable.
+        uint64_t expirations = 0;
+        if (read(timer_fd, &expirations, sizeof(expirations)) == -1) {
+            return;
+        }
+        callback();
+    });
+
+    return timer_fd;
+}
+
+int32_t Reactor::run_once(int32_t timeout_ms /* -1 */)
+{
+    auto triggered_events = epoll_wait(m_epoll_fd, m_events, EPOLL_MAX_EVENTS, timeout_ms);
+
+    if (triggered_events == -1) {
+        if (errno != EINTR) {
+            fmt::print("Reactor: epoll_wait returned -1. errno={}\n", errno);
+        }
+        return 0;
+    }
+
+    // Polling and finding nothing isn't a wakeup.
+    if (triggered_events == 0) {
+        return 0;
+    }
+
+    m_wakeups += 1;
+
+    for (int32_t i = 0; i < triggered_events; i += 1) {
+        const auto callback = m_callbacks.find(m_events[i].data.fd);
+
+        // A callback earlier in this loop may have removed this fd.
+        if (callback == m_callbacks.end()) {
+            continue;
+        }
+
+        callback->second();
+    }
+
+    return triggered_events;
+}
+
+void Reactor::run()
+{
+    for (;;) {
+        run_once();
+    }
+}
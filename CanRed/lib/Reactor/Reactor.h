@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+// A single threaded event loop, built on epoll.
+// Every source of work (interfaces, timers, inotify, sockets)
+// is registered as a file descriptor with a callback, which is
+// called from run() whenever that file descriptor is readable.
+
+// The Reactor is level triggered, so a callback does not need
+// to read everything available, whatever it leaves behind
+// will trigger it again on the next loop.
+
+class Reactor {
+public:
+    using Callback = std::function<void()>;
+
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Calls callback every time file_descriptor is readable.
+    bool add(int32_t file_descriptor, const Callback& callback);
+    bool remove(int32_t file_descriptor);
+
+    // Calls callback every interval_ms, using a timerfd.
+    // Returns the timerfd, or -1 on error.
+    int32_t add_interval_timer(uint32_t interval_ms, const Callback& callback);
+
+    // Blocks until atleast one file descriptor is ready (or timeout_ms passes),
+    // and runs the callbacks for every ready file descriptor.
+    // Returns how many file descriptors were ready, a timeout of 0 just polls.
+    int32_t run_once(int32_t timeout_ms = -1);
+
+    // Loops forever.
+    void run();
+
+    uint64_t wakeups() const { return m_wakeups; }
+
+private:
+    // The maximum amount of events we handle per epoll_wait()
+    static const size_t EPOLL_MAX_EVENTS = 64;
+
+    int32_t m_epoll_fd { -1 };
+
+    std::unordered_map<int32_t, Callback> m_callbacks;
+    // File descriptors we created, and need to close.
+    std::vector<int32_t> m_owned_fds;
+
+    epoll_event m_events[EPOLL_MAX_EVENTS];
+
+    uint64_t m_wakeups { 0 };
+};
@@ -0,0 +1,118 @@
+#include "SocketRequestTable.h"
+
+#include <get_monotonic_time_ns.h>
+
+SocketRequestTable::SocketRequestTable(uint64_t timeout_ns /* DEFAULT_TIMEOUT_NS */)
+    : m_timeout_ns(timeout_ns)
+{
+}
+
+void SocketRequestTable::add(const SocketRequest& request)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    const uint32_t key = key_for(request.module_uid, request.command_uid);
+    const uint64_t id = m_next_id++;
+
+    m_requests[key].push_back({ id, request });
+    m_deadlines.push_back({ id, key, get_monotonic_time_ns() + m_timeout_ns });
+
+    m_in_flight[request.module_uid] += 1;
+    m_stats.added += 1;
+    m_stats.pending += 1;
+}
+
+bool SocketRequestTable::take(uint16_t module_uid, uint8_t command_uid, SocketRequest* request)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_requests.find(key_for(module_uid, command_uid));
+    if (iter == m_requests.end() || iter->second.empty()) {
+        m_stats.unmatched_replies += 1;
+        return false;
+    }
+
+    auto& queue = iter->second;
+    *request = std::move(queue.front().request);
+    queue.pop_front();
+
+    m_in_flight[module_uid] -= 1;
+    m_stats.replied += 1;
+    m_stats.pending -= 1;
+    return true;
+}
+
+bool SocketRequestTable::take_sequenced(uint16_t module_uid, uint8_t command_uid, uint8_t sequence, SocketRequest* request)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_requests.find(key_for(module_uid, command_uid));
+    if (iter == m_requests.end()) {
+        m_stats.unmatched_replies += 1;
+        return false;
+    }
+
+    auto& queue = iter->second;
+    for (auto pending = queue.begin(); pending != queue.end(); ++pending) {
+        if (pending->request.sequence != sequence) {
+            continue;
+        }
+
+        // The queue stays in the order requests were added, so expire()
+        // still finds the oldest request at the front.
+        *request = std::move(pending->request);
+        queue.erase(pending);
+
+        m_in_flight[module_uid] -= 1;
+        m_stats.replied += 1;
+        m_stats.pending -= 1;
+        return true;
+    }
+
+    // Most likely the reply to a request that already timed out.
+    m_stats.unmatched_replies += 1;
+    return false;
+}
+
+size_t SocketRequestTable::in_flight(uint16_t module_uid) const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    auto iter = m_in_flight.find(module_uid);
+    return (iter == m_in_flight.end()) ? 0 : iter->second;
+}
+
+void SocketRequestTable::expire(uint64_t now_ns, std::vector<SocketRequest>& expired)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (!m_deadlines.empty() && m_deadlines.front().deadline_ns <= now_ns) {
+        const auto deadline = m_deadlines.front();
+        m_deadlines.pop_front();
+
+        // Anything older than this request is already gone, so if it's
+        // not at the front of its queue, it was taken.
+        auto iter = m_requests.find(deadline.key);
+        if (iter == m_requests.end() || iter->second.empty() || iter->second.front().id != deadline.id) {
+            continue;
+        }
+
+        auto& queue = iter->second;
+        m_in_flight[queue.front().request.module_uid] -= 1;
+        expired.push_back(std::move(queue.front().request));
+        queue.pop_front();
+
+        if (queue.empty()) {
+            m_requests.erase(iter);
+        }
+
+        m_stats.timed_out += 1;
+        m_stats.pending -= 1;
+    }
+}
+
+SocketRequestStats SocketRequestTable::stats() const
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_stats;
+}
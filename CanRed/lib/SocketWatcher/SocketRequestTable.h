@@ -0,0 +1,87 @@
+#pragma once
+
+#include <SocketWatcher.h>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Socket requests that we've sent to a module, and are
+// waiting on a REPLY_COMMAND for.
+// Safe to use from any thread.
+
+// Requests are queued per (module_uid, command_uid), oldest first, since
+// a module answers the same command in the order it was asked.
+// Every request gets the same timeout, so deadlines are handed out in the
+// order requests are added, and the timer is just one more queue, where
+// the front always expires first. A request that got its reply is left in
+// the timer queue, and skipped when its deadline comes up.
+// Adding, taking, and expiring a request are all O(1).
+// Taking a request by its sequence number scans its queue, but that's
+// bounded by how many commands we let a module have in flight, and the
+// reply we want is almost always the oldest anyway.
+
+struct SocketRequestStats {
+    uint64_t added { 0 };
+    uint64_t replied { 0 };
+    uint64_t timed_out { 0 };
+    // REPLY_COMMAND's that nobody was waiting on.
+    uint64_t unmatched_replies { 0 };
+    size_t pending { 0 };
+};
+
+class SocketRequestTable {
+public:
+    static constexpr uint64_t DEFAULT_TIMEOUT_NS = 5ull * 1000 * 1000 * 1000;
+
+    explicit SocketRequestTable(uint64_t timeout_ns = DEFAULT_TIMEOUT_NS);
+    ~SocketRequestTable() = default;
+
+    SocketRequestTable(const SocketRequestTable&) = delete;
+    SocketRequestTable& operator=(const SocketRequestTable&) = delete;
+
+    void add(const SocketRequest& request);
+
+    // Removes the oldest request waiting on module_uid's command_uid,
+    // and copies it into request. Returns false if there wasn't one.
+    bool take(uint16_t module_uid, uint8_t command_uid, SocketRequest* request);
+
+    // Same as take(), but for the request that was sent with sequence.
+    bool take_sequenced(uint16_t module_uid, uint8_t command_uid, uint8_t sequence, SocketRequest* request);
+
+    // How many requests are waiting on module_uid.
+    size_t in_flight(uint16_t module_uid) const;
+
+    // Removes every request whose deadline is at or before now_ns,
+    // and appends them to expired.
+    void expire(uint64_t now_ns, std::vector<SocketRequest>& expired);
+
+    SocketRequestStats stats() const;
+
+private:
+    struct PendingRequest {
+        uint64_t id;
+        SocketRequest request;
+    };
+
+    struct Deadline {
+        uint64_t id;
+        uint32_t key;
+        uint64_t deadline_ns;
+    };
+
+    static uint32_t key_for(uint16_t module_uid, uint8_t command_uid) { return (static_cast<uint32_t>(module_uid) << 8) | command_uid; }
+
+    mutable std::mutex m_lock;
+
+    uint64_t m_timeout_ns;
+    uint64_t m_next_id { 0 };
+
+    std::unordered_map<uint32_t, std::deque<PendingRequest>> m_requests;
+    std::deque<Deadline> m_deadlines;
+
+    std::unordered_map<uint16_t, size_t> m_in_flight;
+
+    SocketRequestStats m_stats;
+};
@@ -84,10 +84,10 @@ SocketWatcher::~SocketWatcher()
     unlink(SOCKET_FILE);
 }
 
-bool SocketWatcher::watch()
+bool SocketWatcher::watch(int32_t timeout_ms /* -1 */)
 {
     if (are_we_okay) {
-        auto triggered_events = epoll_wait(m_epoll_fd, m_events, EPOLL_MAX_EVENTS, -1);
+        auto triggered_events = epoll_wait(m_epoll_fd, m_events, EPOLL_MAX_EVENTS, timeout_ms);
 
         if (triggered_events == -1) {
             // We got an interupt syscall
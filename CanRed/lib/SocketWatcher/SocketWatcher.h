@@ -11,6 +11,9 @@ struct SocketRequest {
     std::string module_function;
     uint16_t module_uid { 0 };
     uint8_t command_uid { 0 };
+    // Sent with the COMMAND, modules that understand it send it back
+    // in a REPLY_COMMAND_SEQUENCED.
+    uint8_t sequence { 0 };
     int32_t file_descriptor { 0 };
 };
 
@@ -33,7 +36,12 @@ public:
     SocketWatcher() = delete;
     ~SocketWatcher();
 
-    bool watch();
+    // Waits up to timeout_ms (-1 for forever) for socket activity,
+    // returns true if we have a new SocketRequest.
+    bool watch(int32_t timeout_ms = -1);
+
+    // Our epoll fd, which becomes readable when watch() won't block.
+    int32_t file_descriptor() const { return m_epoll_fd; }
 
 private:
     const char* SOCKET_FILE = "/tmp/CanRed/red.sock";
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+// Unlike get_current_time_ms(), this never jumps when the
+// wall clock is changed, so it's good for measuring time between things.
+inline uint64_t get_monotonic_time_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
@@ -1,26 +1,224 @@
 #include <CanManager.h>
+#include <CaptureLog.h>
+#include <CapturingInterface.h>
 #include <Database.h>
+#include <DatabaseWriter.h>
 #include <EventManager.h>
+#include <EventNotifier.h>
 #include <FileWatcher.h>
+#include <FrameRing.h>
+#include <Reactor.h>
 #include <SerialInterface.h>
+#include <ShardedDispatcher.h>
+#include <SocketCanInterface.h>
 #include <SocketWatcher.h>
+#include <WaitStrategy.h>
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
 #include <fmt/format.h>
 #include <fstream>
+#include <functional>
+#include <get_monotonic_time_ns.h>
 #include <json.hpp>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <poll.h>
+#include <seconds_to_ms.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
 
-void handle_sigint(int signal_number)
+namespace {
+
+// Used for comparing the two main loops against each other.
+std::atomic<uint64_t> frames_handled { 0 };
+
+const std::string INJECT_FILE_NAME = "/tmp/CanRed/inject";
+
+// Set when running with --capture.
+Capture::Writer* capture_writer = nullptr;
+
+// How the main loop waits for work, set by main().
+WaitStrategy* wait_strategy = nullptr;
+uint64_t start_time_ns = 0;
+
+// Set by main(), to whichever manager is handling frames.
+std::function<std::vector<ProtocolHandlerStats>()> get_protocol_handler_stats;
+
+// Socket requests waiting on a REPLY_COMMAND, set by main().
+SocketRequestTable* socket_request_table = nullptr;
+
+// SIGINT is blocked in every thread, and read from here by the main loop instead,
+// so stopping happens on the main loop, not inside of a signal handler, where
+// taking a lock, or running destructors, can deadlock. Set by main().
+int32_t stop_signal_fd = -1;
+std::atomic<bool> should_stop { false };
+
+// Set by main(), to whichever manager is handling frames.
+std::function<ACKStats()> get_ack_stats;
+std::function<std::vector<ModuleLinkStats>()> get_module_link_stats;
+std::function<LongFrameStats()> get_long_frame_stats;
+
+} // namespace
+
+void flush_capture()
+{
+    if (capture_writer) {
+        capture_writer->flush();
+    }
+}
+
+void print_protocol_handler_stats()
+{
+    if (!get_protocol_handler_stats) {
+        return;
+    }
+
+    auto stats = get_protocol_handler_stats();
+    std::sort(stats.begin(), stats.end(), [](const ProtocolHandlerStats& a, const ProtocolHandlerStats& b) {
+        return a.total_ns > b.total_ns;
+    });
+
+    uint64_t total_ns = 0;
+    for (const auto& handler : stats) {
+        total_ns += handler.total_ns;
+    }
+
+    fmt::print("Protocol handlers, by time spent:\n");
+    for (const auto& handler : stats) {
+        if (handler.invocations == 0) {
+            continue;
+        }
+
+        fmt::print("  {:<24} {:>10} calls, {:>8.0f}ns avg, {:>8.1f}us max, {:>5.1f}%\n",
+            handler.name,
+            handler.invocations,
+            static_cast<double>(handler.total_ns) / handler.invocations,
+            handler.max_ns / 1000.0,
+            total_ns ? 100.0 * handler.total_ns / total_ns : 0.0);
+    }
+}
+
+void print_runtime_stats()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return;
+    }
+
+    const double cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+
+    fmt::print("Frames handled: {}\nCPU time: {:.3f}s\nContext switches: {} voluntary, {} involuntary\n",
+        frames_handled.load(), cpu_seconds, usage.ru_nvcsw, usage.ru_nivcsw);
+
+    print_protocol_handler_stats();
+
+    if (get_ack_stats) {
+        const auto stats = get_ack_stats();
+        fmt::print("ACKs: waited on {}, {} acknowledged, {} expired, {} unexpected, {} pending\n",
+            stats.waiting_on, stats.acknowledged, stats.expired, stats.unexpected, stats.pending);
+
+        if (stats.acknowledged > 0) {
+            fmt::print("ACK round trip: {:.1f}us avg, p50 < {:.0f}us, p99 < {:.0f}us, {:.1f}us max\n",
+                stats.rtt_total_ns / 1000.0 / stats.acknowledged,
+                stats.rtt_percentile_ns(50) / 1000.0,
+                stats.rtt_percentile_ns(99) / 1000.0,
+                stats.rtt_max_ns / 1000.0);
+        }
+    }
+
+    if (get_long_frame_stats) {
+        const auto stats = get_long_frame_stats();
+        fmt::print("Long frame groups: {} completed, {} in flight, {} evicted, {} dropped (out of buffers), {} dropped (too long)\n",
+            stats.completed, stats.in_flight, stats.evicted, stats.pool_exhausted, stats.overflowed);
+    }
+
+    if (get_module_link_stats) {
+        auto stats = get_module_link_stats();
+        std::sort(stats.begin(), stats.end(), [](const ModuleLinkStats& a, const ModuleLinkStats& b) {
+            return a.loss_rate() > b.loss_rate();
+        });
+
+        for (const auto& module : stats) {
+            fmt::print("Module {}: {} transmissions, {} failed ({:.1f}% loss), {} frames resent, {} delivered, {} lost\n",
+                module.module_uid, module.transmissions, module.failed_transmissions, 100.0 * module.loss_rate(),
+                module.retransmitted_frames, module.delivered, module.lost);
+        }
+    }
+
+    const auto statement_cache_stats = Database::the().statement_cache_stats();
+    fmt::print("Statement cache: {} hits, {} misses, {} statements cached\n",
+        statement_cache_stats.hits, statement_cache_stats.misses, statement_cache_stats.cached);
+
+    const auto writer_stats = DatabaseWriter::the().stats();
+    fmt::print("Database writer: {} queued, {} written, {} failed, {} pending, {} groups committed, {} writes in the largest group\n",
+        writer_stats.queued, writer_stats.written, writer_stats.failed, writer_stats.pending, writer_stats.groups, writer_stats.largest_group);
+
+    if (socket_request_table) {
+        const auto stats = socket_request_table->stats();
+        fmt::print("Socket requests: {} sent, {} replied, {} timed out, {} pending, {} unmatched replies\n",
+            stats.added, stats.replied, stats.timed_out, stats.pending, stats.unmatched_replies);
+    }
+
+    if (!wait_strategy) {
+        return;
+    }
+
+    const double seconds = (get_monotonic_time_ns() - start_time_ns) / 1e9;
+    const double parked_seconds = wait_strategy->parked_ns() / 1e9;
+
+    fmt::print("Wait strategy: {}{}, {:.1f} wakeups/s, parked {:.3f}s ({:.1f}%), {} polls found work, {} mode switches\n",
+        WaitStrategy::mode_name(wait_strategy->mode()),
+        wait_strategy->is_automatic() ? " (auto)" : "",
+        wait_strategy->wakeups() / seconds,
+        parked_seconds,
+        100.0 * parked_seconds / seconds,
+        wait_strategy->polls_with_work(),
+        wait_strategy->mode_switches());
+}
+
+// Must be called before any thread is created, so they all inherit the blocked SIGINT.
+void block_stop_signal()
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    stop_signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+}
+
+// Returns true once SIGINT has been received, blocks until a signal is pending.
+bool read_stop_signal()
+{
+    signalfd_siginfo info;
+    if (read(stop_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        should_stop = true;
+    }
+    return should_stop;
+}
+
+// Called by main() once the main loop has returned.
+// Interface threads, and the rest, are still blocked in their reads, so this
+// never returns, running static destructors underneath them isn't safe.
+[[noreturn]] void shut_down()
 {
     // Most terminals will output ^C when receiving a ctrl-c
     // So this just completes the message :^)
     fmt::print("anRed Stopped!\n");
-    exit(signal_number);
+
+    DatabaseWriter::the().flush();
+    print_runtime_stats();
+    flush_capture();
+
+    fflush(stdout);
+    _exit(SIGINT);
 }
 
 // When running on a battery powered embedded OS, a big
@@ -35,7 +233,21 @@ void handle_sigint(int signal_number)
 // to around 3%. Not even counting the common-case of nothing happening
 // at all.
 
-// Created Threads:
+// That trade-off is wrong while streaming diagnostics with the engine
+// running, so how the main loop waits is picked with --wait:
+// --wait block: Always sleep until woken, the battery friendly option.
+// --wait spin:  Poll for up to --spin-budget-us, then sleep.
+// --wait busy:  Never sleep, a frame is picked up the moment it arrives.
+// --wait auto (default): Starts out blocking, and moves between the three
+//                        based on the frame rate, see WaitStrategy.h.
+
+// CanRed has two main loops, picked at startup:
+// --threaded (default): A thread per source of work, as described below.
+// --reactor: A single thread that epoll()s every file descriptor
+//            we care about, trading the threads and their wakeups
+//            for one syscall that waits on everything.
+
+// Created Threads (--threaded):
 // 1. A Thread for every interface
 // 2. The Main Thread
 // 3. ACK Checking Thread
@@ -44,22 +256,52 @@ void handle_sigint(int signal_number)
 // 6. Checking For Incoming Socket Data
 
 // Basic Overview:
-// - The main thread waits on a condition variable, 
-//   and when given, checks for which process reported work to be done.
+// - The main thread waits on an EventNotifier (an eventfd),
+//   and when woken, checks for which process reported work to be done.
 // - All other threads wait on an event to happen and when it does
-//   they notify the main thread, and go back to sleeping. 
+//   they notify the main thread, and go back to sleeping.
+// - Every interface thread pushes frames into its own FrameRing,
+//   which the main thread drains without taking any locks, so a slow
+//   dispatch never stalls an interface from reading.
+
+// Size of each interfaces FrameRing, and what to do when it fills up.
+const size_t FRAME_RING_CAPACITY = 4096;
+const OverflowPolicy FRAME_RING_OVERFLOW_POLICY = OverflowPolicy::DropNewest;
 
-int main(int, const char**)
+// Returns the byte written to the inject file, or 0 if it's empty.
+int32_t read_inject_file()
 {
-    signal(SIGINT, handle_sigint);
+    std::ifstream inject_file(INJECT_FILE_NAME);
+    std::string line = "";
+    std::getline(inject_file, line);
 
-    fmt::print("CanRed Started!\n");
+    if (line.empty()) {
+        // Our own truncate() also counts as a modification.
+        return 0;
+    }
 
-    std::condition_variable cv;
-    std::mutex main_lock;
+    truncate(INJECT_FILE_NAME.c_str(), 0);
 
-    std::queue<CAN::Frame> frame_queue;
-    std::mutex frame_queue_mutex;
+    return std::stoi(line);
+}
+
+template<typename Manager>
+void inject_command(Manager& manager, uint8_t command)
+{
+    uint8_t buffer[1];
+    buffer[0] = command;
+
+    CAN::ID id(CAN::UID::MCM, CAN::UID::CCM);
+    CAN::Frame frame(id, buffer, 1);
+
+    manager.inject_frame(frame);
+}
+
+// Manager is either a CanManager, or a ShardedDispatcher.
+template<typename Manager>
+int run_threaded(std::vector<AutomatoInterface*>& interfaces, Manager& manager, const ModuleRegistry& module_registry, WaitStrategy& wait_strategy)
+{
+    EventNotifier notifier;
 
     std::vector<EventUpdate> events_needing_update;
     std::mutex events_mutex;
@@ -70,56 +312,93 @@ int main(int, const char**)
     std::atomic<bool> do_we_have_new_socket_data { false };
 
     std::atomic<bool> should_check_acks { false };
+    std::atomic<bool> should_report_ring_drops { false };
+    std::atomic<bool> should_expire_socket_requests { false };
     std::atomic<int> command_to_inject { 0 };
 
-    // Initialize all interfaces, This should be able to be done
-    // via a config file later on.
-    // Store them in an array for easy iterating.
-    SerialInterface serial_interface("/dev/ttyUSB1");
-    std::vector<AutomatoInterface*> interfaces;
-    interfaces.push_back(&serial_interface);
+    // One ring per interface, the interface thread is the only producer
+    // and the main thread is the only consumer.
+    std::vector<std::unique_ptr<FrameRing>> frame_rings;
+    for (size_t i = 0; i < interfaces.size(); i += 1) {
+        frame_rings.emplace_back(new FrameRing(FRAME_RING_CAPACITY, FRAME_RING_OVERFLOW_POLICY, notifier));
+    }
 
     // Create a thread for every interface, where
     // each will block forever until they read a frame.
     std::vector<std::thread> interface_threads;
-    for (auto* interface : interfaces) {
-        interface_threads.push_back(std::thread([interface, &cv, &frame_queue, &frame_queue_mutex] {
+    for (size_t i = 0; i < interfaces.size(); i += 1) {
+        auto* interface = interfaces[i];
+        auto* frame_ring = frame_rings[i].get();
+
+        interface_threads.push_back(std::thread([interface, frame_ring] {
             CAN::Frame holder_frame;
             for (;;) {
                 if (interface->read_frame(&holder_frame)) {
-                    std::unique_lock<std::mutex> lock(frame_queue_mutex);
-
-                    frame_queue.push(holder_frame);
-                    cv.notify_one();
+                    frame_ring->push(holder_frame);
                 }
             }
         }));
     }
 
+    const auto has_work = [&]() {
+        for (const auto& frame_ring : frame_rings) {
+            if (!frame_ring->is_empty()) {
+                return true;
+            }
+        }
+        return should_stop || should_check_acks || should_report_ring_drops || should_expire_socket_requests || do_events_need_updating || command_to_inject > 0 || do_we_have_new_socket_data;
+    };
+
     auto main_thread = std::thread([&]() {
-        std::unique_lock<std::mutex> lock(main_lock);
-        // TODO: in CanRed, adding interfaces should
-        // be easy, and not require editing source code
-        // for a default configuration.
+        std::vector<uint64_t> reported_drops(frame_rings.size(), 0);
 
-        CanManager manager(interfaces);
+        // Everything drained from the rings in one wakeup is handled as one batch.
+        std::vector<CAN::Frame> frame_batch;
+        frame_batch.reserve(FRAME_RING_CAPACITY * frame_rings.size());
 
         for (;;) {
-            cv.wait(lock);
+            wait_strategy.wait(has_work, [&]() { notifier.wait(has_work); });
+
+            if (should_stop) {
+                return;
+            }
 
-            {
-                std::unique_lock<std::mutex> frame_queue_lock(frame_queue_mutex);
-                while (!frame_queue.empty()) {
-                    manager.handle_incoming_frame(frame_queue.front());
-                    frame_queue.pop();
+            CAN::Frame frame;
+            for (auto& frame_ring : frame_rings) {
+                while (frame_ring->pop(&frame)) {
+                    frame_batch.push_back(frame);
                 }
             }
 
+            if (!frame_batch.empty()) {
+                manager.handle_incoming_frames(frame_batch.data(), frame_batch.size());
+                frames_handled += frame_batch.size();
+                wait_strategy.record_frames(frame_batch.size());
+                frame_batch.clear();
+            }
+
             if (should_check_acks) {
                 manager.check_for_old_acks();
                 should_check_acks = false;
             }
 
+            if (should_report_ring_drops) {
+                should_report_ring_drops = false;
+
+                for (size_t i = 0; i < frame_rings.size(); i += 1) {
+                    const auto dropped = frame_rings[i]->frames_dropped();
+                    if (dropped != reported_drops[i]) {
+                        fmt::print("Interface {} dropped {} frames, its FrameRing was full! ({} total)\n", i, dropped - reported_drops[i], dropped);
+                        reported_drops[i] = dropped;
+                    }
+                }
+            }
+
+            if (should_expire_socket_requests) {
+                manager.expire_socket_requests();
+                should_expire_socket_requests = false;
+            }
+
             if (do_events_need_updating) {
                 std::unique_lock<std::mutex> events_lock(events_mutex);
                 manager.update_events(events_needing_update);
@@ -127,14 +406,7 @@ int main(int, const char**)
             }
 
             if (command_to_inject > 0) {
-                uint8_t buffer[1];
-                buffer[0] = (uint8_t)command_to_inject;
-
-                CAN::ID id(CAN::UID::MCM, CAN::UID::CCM);
-                CAN::Frame frame(id, buffer, 1);
-
-                manager.inject_frame(frame);
-
+                inject_command(manager, command_to_inject);
                 command_to_inject = 0;
             }
 
@@ -145,20 +417,50 @@ int main(int, const char**)
         }
     });
 
+    // The ACK timers fire the moment the oldest ACK we're waiting on
+    // expires, or a retransmission is due.
     auto check_acks_thread = std::thread([&]() {
+        std::vector<pollfd> ack_timers;
+        for (const auto file_descriptor : manager.ack_timer_file_descriptors()) {
+            ack_timers.push_back({ file_descriptor, POLLIN, 0 });
+        }
+
         for (;;) {
-            std::this_thread::sleep_for(std::chrono::seconds(3));
-            should_check_acks = true;
-            cv.notify_one();
+            if (poll(ack_timers.data(), ack_timers.size(), -1) <= 0) {
+                continue;
+            }
+
+            for (const auto& ack_timer : ack_timers) {
+                uint64_t expirations = 0;
+                if ((ack_timer.revents & POLLIN) && read(ack_timer.fd, &expirations, sizeof(expirations)) > 0) {
+                    should_check_acks = true;
+                }
+            }
+            notifier.notify();
+        }
+    });
+
+    // Ticks once a second, socket requests are expired every tick,
+    // the capture log is flushed every third.
+    auto ticker_thread = std::thread([&]() {
+        for (size_t tick = 1;; tick += 1) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            should_expire_socket_requests = true;
+
+            if (tick % 3 == 0) {
+                flush_capture();
+                should_report_ring_drops = true;
+            }
+            notifier.notify();
         }
     });
 
     auto events_thread = std::thread([&]() {
         for (;;) {
-            if (EventManager::wait_for_changes(events_needing_update, events_mutex)) {
+            if (EventManager::wait_for_changes(events_needing_update, events_mutex, module_registry)) {
                 fmt::print("updating do_events_need_updating\n");
                 do_events_need_updating = true;
-                cv.notify_one();
+                notifier.notify();
             }
         }
     });
@@ -169,21 +471,20 @@ int main(int, const char**)
     // and have buttons to repeat and stuff
     // would be kinda cool using sockets!
     auto inject_thread = std::thread([&]() {
-        const std::string INJECT_FILE_NAME = "/tmp/CanRed/inject";
         mkdir("/tmp/CanRed", 0700);
         std::ofstream test(INJECT_FILE_NAME);
 
         for (;;) {
             if (wait_for_file_change(INJECT_FILE_NAME)) {
                 // inject file was modified
-                std::ifstream inject_file(INJECT_FILE_NAME);
-                std::string line = "";
-                std::getline(inject_file, line);
-                truncate(INJECT_FILE_NAME.c_str(), 0);
+                const auto command = read_inject_file();
+                if (command <= 0) {
+                    continue;
+                }
 
-                command_to_inject = std::stoi(line);
+                command_to_inject = command;
                 fmt::print("Injecting byte {} into CAN\n", command_to_inject);
-                cv.notify_one();
+                notifier.notify();
             }
         }
     });
@@ -194,20 +495,250 @@ int main(int, const char**)
         for (;;) {
             if (watcher.watch()) {
                 do_we_have_new_socket_data = true;
-                cv.notify_one();
+                notifier.notify();
             }
         }
     });
 
+    auto stop_thread = std::thread([&]() {
+        while (!read_stop_signal()) { }
+        notifier.notify();
+    });
+
     main_thread.join();
-    check_acks_thread.join();
-    events_thread.join();
-    inject_thread.join();
-    socket_thread.join();
+    stop_thread.join();
+
+    // Every other thread is blocked waiting on something that might never come,
+    // they're left running, see shut_down().
+    check_acks_thread.detach();
+    ticker_thread.detach();
+    events_thread.detach();
+    inject_thread.detach();
+    socket_thread.detach();
 
     for (auto& interface_thread : interface_threads) {
-        interface_thread.join();
+        interface_thread.detach();
+    }
+
+    return 0;
+}
+
+template<typename Manager>
+int run_reactor(std::vector<AutomatoInterface*>& interfaces, Manager& manager, const ModuleRegistry& module_registry, WaitStrategy& wait_strategy)
+{
+    Reactor reactor;
+
+    // Interfaces
+    std::vector<CAN::Frame> frames;
+    frames.reserve(SerialInterface::READ_BUFFER_SIZE / CAN::Frame::MAX_SERIALIZED_SIZE);
+
+    for (auto* interface : interfaces) {
+        if (interface->file_descriptor() == -1) {
+            fmt::print("An interface cannot be polled, it can only be used with --threaded!\n");
+            return 1;
+        }
+
+        reactor.add(interface->file_descriptor(), [interface, &manager, &frames, &wait_strategy]() {
+            frames.clear();
+            interface->read_frames(frames);
+
+            manager.handle_incoming_frames(frames.data(), frames.size());
+            frames_handled += frames.size();
+            wait_strategy.record_frames(frames.size());
+        });
+    }
+
+    // ACKs, the timers fire the moment the oldest ACK we're waiting on
+    // expires, or a retransmission is due.
+    for (const auto ack_timer : manager.ack_timer_file_descriptors()) {
+        reactor.add(ack_timer, [ack_timer, &manager]() {
+            uint64_t expirations = 0;
+            if (read(ack_timer, &expirations, sizeof(expirations)) > 0) {
+                manager.check_for_old_acks();
+            }
+        });
+    }
+
+    // Capture log
+    reactor.add_interval_timer(seconds_to_ms(3), []() { flush_capture(); });
+
+    // Socket requests that never got a reply
+    reactor.add_interval_timer(seconds_to_ms(1), [&manager]() {
+        manager.expire_socket_requests();
+    });
+
+    // Node-Red Events and Injected Frames
+    mkdir("/tmp/CanRed", 0700);
+    std::ofstream create_inject_file(INJECT_FILE_NAME);
+
+    FileWatcher file_watcher;
+    const auto inject_watch = file_watcher.watch(INJECT_FILE_NAME);
+    // -1 until the flows file exists, see below.
+    auto flows_watch = file_watcher.watch(EventManager::flows_file());
+
+    std::vector<EventUpdate> events_needing_update;
+
+    reactor.add(file_watcher.file_descriptor(), [&]() {
+        for (const auto watch_descriptor : file_watcher.read_changes()) {
+            if (watch_descriptor == flows_watch && EventManager::read_changes(events_needing_update, module_registry)) {
+                manager.update_events(events_needing_update);
+            }
+
+            if (watch_descriptor == inject_watch) {
+                const auto command = read_inject_file();
+                if (command > 0) {
+                    fmt::print("Injecting byte {} into CAN\n", command);
+                    inject_command(manager, command);
+                }
+            }
+        }
+    });
+
+    // NodeRed only creates the flows file on its first deploy, so
+    // if it didn't exist at startup, it's watched as soon as it does.
+    reactor.add_interval_timer(seconds_to_ms(1), [&]() {
+        if (flows_watch != -1 || access(EventManager::flows_file().c_str(), F_OK) != 0) {
+            return;
+        }
+
+        flows_watch = file_watcher.watch(EventManager::flows_file());
+        if (flows_watch != -1 && EventManager::read_changes(events_needing_update, module_registry)) {
+            manager.update_events(events_needing_update);
+        }
+    });
+
+    // Sockets
+    std::vector<SocketRequest> socket_requests;
+    std::mutex socket_request_lock;
+    SocketWatcher watcher(socket_requests, socket_request_lock);
+
+    reactor.add(watcher.file_descriptor(), [&]() {
+        // We know there's something to read, so don't wait.
+        if (watcher.watch(0)) {
+            manager.parse_socket_input(socket_requests, socket_request_lock);
+        }
+    });
+
+    // SIGINT
+    reactor.add(stop_signal_fd, []() { read_stop_signal(); });
+
+    // Polling runs whatever is ready, parking waits in epoll_wait().
+    const auto poll = [&reactor]() { return reactor.run_once(0) > 0; };
+    const auto park = [&reactor]() { reactor.run_once(); };
+
+    while (!should_stop) {
+        wait_strategy.wait(poll, park);
     }
 
     return 0;
 }
+
+int main(int argc, const char** argv)
+{
+    block_stop_signal();
+
+    bool use_reactor = false;
+    const char* socketcan_interface = nullptr;
+    size_t shard_count = 1;
+    const char* capture_file = nullptr;
+    WaitMode wait_mode = WaitMode::Block;
+    bool is_wait_automatic = true;
+    uint64_t spin_budget_ns = WaitStrategy::DEFAULT_SPIN_BUDGET_NS;
+
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--reactor") == 0) {
+            use_reactor = true;
+        } else if (strcmp(argv[i], "--threaded") == 0) {
+            use_reactor = false;
+        } else if (strcmp(argv[i], "--socketcan") == 0 && i + 1 < argc) {
+            socketcan_interface = argv[++i];
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shard_count = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_file = argv[++i];
+        } else if (strcmp(argv[i], "--wait") == 0 && i + 1 < argc && WaitStrategy::parse_mode(argv[i + 1], &wait_mode, &is_wait_automatic)) {
+            i += 1;
+        } else if (strcmp(argv[i], "--spin-budget-us") == 0 && i + 1 < argc) {
+            spin_budget_ns = strtoull(argv[++i], nullptr, 10) * 1000;
+        } else {
+            fmt::print("Unknown argument: {}\nUsage: CanRed [--threaded | --reactor] [--socketcan <can0>] [--shards <count>] [--capture <file>] "
+                       "[--wait <block | spin | busy | auto>] [--spin-budget-us <us>]\n",
+                argv[i]);
+            return 1;
+        }
+    }
+
+    fmt::print("CanRed Started! ({}, --wait {})\n", use_reactor ? "reactor" : "threaded",
+        is_wait_automatic ? "auto" : WaitStrategy::mode_name(wait_mode));
+
+    WaitStrategy strategy(wait_mode, is_wait_automatic, spin_budget_ns);
+    wait_strategy = &strategy;
+    start_time_ns = get_monotonic_time_ns();
+
+    // Initialize all interfaces, This should be able to be done
+    // via a config file later on.
+    // Store them in an array for easy iterating.
+    // With --socketcan we talk to the CAN bus directly, instead of
+    // going through a module acting as a USB-serial bridge.
+    std::unique_ptr<AutomatoInterface> interface;
+    if (socketcan_interface) {
+        interface.reset(new SocketCanInterface(socketcan_interface));
+    } else {
+        interface.reset(new SerialInterface("/dev/ttyUSB1"));
+    }
+
+    std::vector<AutomatoInterface*> interfaces;
+    interfaces.push_back(interface.get());
+
+    // With --capture, every frame we read or send is appended to
+    // a capture log, which canred_replay can play back later.
+    Capture::Writer writer;
+    std::vector<std::unique_ptr<CapturingInterface>> capturing_interfaces;
+
+    if (capture_file) {
+        if (!writer.open(capture_file)) {
+            return 1;
+        }
+        capture_writer = &writer;
+
+        for (size_t i = 0; i < interfaces.size(); i += 1) {
+            capturing_interfaces.emplace_back(new CapturingInterface(*interfaces[i], i, writer));
+            interfaces[i] = capturing_interfaces.back().get();
+        }
+
+        fmt::print("Capturing every frame to {}\n", capture_file);
+    }
+
+    // TODO: in CanRed, adding interfaces should
+    // be easy, and not require editing source code
+    // for a default configuration.
+
+    ModuleRegistry module_registry;
+    SocketRequestTable pending_socket_requests;
+    socket_request_table = &pending_socket_requests;
+
+    // With --shards, frames are handled by that many worker
+    // threads, with each module always going to the same one.
+    if (shard_count > 1) {
+        fmt::print("Handling frames with {} shards\n", shard_count);
+        ShardedDispatcher dispatcher(shard_count, interfaces, module_registry, pending_socket_requests);
+        get_protocol_handler_stats = [&dispatcher]() { return dispatcher.protocol_handler_stats(); };
+        get_ack_stats = [&dispatcher]() { return dispatcher.ack_stats(); };
+        get_module_link_stats = [&dispatcher]() { return dispatcher.module_link_stats(); };
+        get_long_frame_stats = [&dispatcher]() { return dispatcher.long_frame_stats(); };
+        if ((use_reactor ? run_reactor(interfaces, dispatcher, module_registry, strategy) : run_threaded(interfaces, dispatcher, module_registry, strategy)) != 0) {
+            return 1;
+        }
+        shut_down();
+    }
+
+    CanManager manager(interfaces, module_registry, pending_socket_requests);
+    get_protocol_handler_stats = [&manager]() { return manager.protocol_handler_stats(); };
+    get_ack_stats = [&manager]() { return manager.ack_stats(); };
+    get_module_link_stats = [&manager]() { return manager.module_link_stats(); };
+    get_long_frame_stats = [&manager]() { return manager.long_frame_stats(); };
+    if ((use_reactor ? run_reactor(interfaces, manager, module_registry, strategy) : run_threaded(interfaces, manager, module_registry, strategy)) != 0) {
+        return 1;
+    }
+    shut_down();
+}
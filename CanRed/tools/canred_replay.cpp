@@ -0,0 +1,167 @@
+// Plays back a capture log made with `CanRed --capture <file>`, feeding every
+// received frame into a CanManager, in the same order and with the same
+// timing they were captured with. Frames CanManager sends go nowhere, but
+// are counted.
+
+// Like CanRed, this needs to run from a directory with a .env,
+// use a throwaway dbFile if you don't want the replay touching your database.
+
+// Usage: canred_replay <capture file> [--speed <N | max>]
+//     --speed 1   : Real time (default)
+//     --speed 10  : 10x faster than real time
+//     --speed max : As fast as CanManager can go, a repeatable throughput benchmark
+
+#include <CanManager.h>
+#include <CaptureLog.h>
+#include <chrono>
+#include <cmath>
+#include <errno.h>
+#include <fmt/format.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class ReplayInterface : public AutomatoInterface {
+public:
+    bool read_frame(CAN::Frame*) override { return false; }
+
+    bool send_frame(const CAN::Frame&) override
+    {
+        frames_sent += 1;
+        return true;
+    }
+
+    size_t send_frames(const CAN::Frame[], size_t frame_count) override
+    {
+        frames_sent += frame_count;
+        return frame_count;
+    }
+
+    uint64_t frames_sent { 0 };
+};
+
+// Frames handed to CanManager at once when replaying at max speed.
+const size_t MAX_SPEED_BATCH_SIZE = 256;
+
+void print_usage()
+{
+    fmt::print("Usage: canred_replay <capture file> [--speed <N | max>]\n");
+}
+
+// Returns false if text isn't max, or a positive number.
+bool parse_speed(const char* text, double* speed)
+{
+    if (strcmp(text, "max") == 0) {
+        *speed = 0;
+        return true;
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    *speed = strtod(text, &end);
+    return end != text && *end == '\0' && errno == 0 && std::isfinite(*speed) && *speed > 0;
+}
+
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    const char* capture_file = argv[1];
+    double speed = 1.0; // 0 for max speed
+
+    for (int i = 2; i < argc; i += 1) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            i += 1;
+            if (!parse_speed(argv[i], &speed)) {
+                fmt::print("--speed has to be a positive number, or max, not {}\n", argv[i]);
+                print_usage();
+                return 1;
+            }
+        } else {
+            fmt::print("Unknown argument: {}\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+    }
+
+    Capture::Reader reader;
+    if (!reader.open(capture_file)) {
+        return 1;
+    }
+
+    // We only replay what the bus sent us, what we sent
+    // back is up to CanManager this time around.
+    std::vector<Capture::Record> records;
+    records.reserve(reader.size());
+    for (size_t i = 0; i < reader.size(); i += 1) {
+        auto record = reader.at(i);
+        if (record.direction == Capture::Direction::Received) {
+            records.push_back(record);
+        }
+    }
+
+    if (records.empty()) {
+        fmt::print("{} has no received frames to replay\n", capture_file);
+        return 0;
+    }
+
+    fmt::print("Replaying {} of {} frames from {} at {}\n", records.size(), reader.size(), capture_file,
+        speed == 0 ? "max speed" : fmt::format("{}x", speed));
+
+    ReplayInterface interface;
+    std::vector<AutomatoInterface*> interfaces { &interface };
+    ModuleRegistry module_registry;
+    SocketRequestTable socket_requests;
+    CanManager manager(interfaces, module_registry, socket_requests);
+
+    std::vector<CAN::Frame> batch;
+    batch.reserve(MAX_SPEED_BATCH_SIZE);
+
+    const uint64_t first_timestamp_ns = records.front().timestamp_ns;
+    const auto start = std::chrono::steady_clock::now();
+
+    size_t index = 0;
+    while (index < records.size()) {
+        if (speed == 0) {
+            while (index < records.size() && batch.size() < MAX_SPEED_BATCH_SIZE) {
+                batch.push_back(records[index++].frame);
+            }
+        } else {
+            // Everything that's due gets handled as one batch,
+            // just like a burst drained from an interface.
+            const auto due = [&](size_t i) {
+                const auto offset = std::chrono::nanoseconds(static_cast<uint64_t>((records[i].timestamp_ns - first_timestamp_ns) / speed));
+                return start + offset;
+            };
+
+            if (due(index) > std::chrono::steady_clock::now()) {
+                std::this_thread::sleep_until(due(index));
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            while (index < records.size() && due(index) <= now) {
+                batch.push_back(records[index++].frame);
+            }
+        }
+
+        manager.handle_incoming_frames(batch.data(), batch.size());
+        batch.clear();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double captured_seconds = (records.back().timestamp_ns - first_timestamp_ns) / 1e9;
+
+    fmt::print("Replayed {} frames in {:.3f}s (captured over {:.3f}s), {:.0f} frames/s, CanManager sent {} frames\n",
+        records.size(), seconds, captured_seconds, records.size() / seconds, interface.frames_sent);
+
+    return 0;
+}
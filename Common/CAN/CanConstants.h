@@ -37,6 +37,13 @@ const uint8_t EVENT_RUN_NEXT_PART = 144;
 
 // TODO: Docs
 const uint8_t FORMAT_EEPROM = 145;
+
+// REPLY_COMMAND, with the sequence number the COMMAND was sent with.
+const uint8_t REPLY_COMMAND_SEQUENCED = 146;
+
+// REPLY_UPDATE_INFO, with a ModuleDescriptor instead of JSON.
+const uint8_t REPLY_UPDATE_INFO_BINARY = 147;
+
 const uint8_t INVALID = 199;
 
 } // namespace Protocol
@@ -15,7 +15,7 @@ namespace CAN {
 #if defined ESP8266 || defined ESP32
 
 Frame::Frame(can_frame frame)
-    : ID(frame.can_id)
+    : ID(ID::from_extended_can_id(frame.can_id & CAN_EFF_MASK))
     , can_dlc(frame.can_dlc)
 {
     memcpy(data, frame.data, can_dlc);
@@ -24,7 +24,7 @@ Frame::Frame(can_frame frame)
 Frame::operator can_frame() const
 {
     can_frame frame {
-        .can_id = formatted_can_id(),
+        .can_id = extended_can_id() | CAN_EFF_FLAG,
         .can_dlc = can_dlc,
         .data = {},
     };
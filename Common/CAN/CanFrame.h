@@ -21,6 +21,7 @@ public:
 #endif
     Frame() = default;
     Frame(const ID can_id, const uint8_t data[8], const uint8_t can_dlc);
+    Frame(const Frame& other) = default;
     Frame& operator=(const Frame& other);
     ~Frame() = default;
 
@@ -35,7 +36,14 @@ public:
     bool is_for_everyone() const;
 
     static uint16_t get_temporary_can_id() { return (rand() % 41) + 2000; }
-    static uint8_t get_long_frame_uid() { return rand() % 255; };
+    // Counts up, so a sender's groups in a row never share a uid, even if one's last frame was lost.
+    // Never 0, since modules take it to mean an empty buffer.
+    static uint8_t get_long_frame_uid()
+    {
+        static uint8_t uid = 0;
+        uid = (uid % 255) + 1;
+        return uid;
+    }
 
     uint8_t operator[](const uint8_t index) const { return data[index]; }
     uint8_t& operator[](const uint8_t index) { return data[index]; }
@@ -18,6 +18,12 @@ ID::ID(uint16_t from_id, uint16_t to_id, uint8_t priority /* CAN::Priority::NORM
 {
 }
 
+ID ID::from_extended_can_id(uint32_t extended_can_id)
+{
+    // Put back the Extended Frame Flag bit formatted_can_id() always sets.
+    return ID(((0x1FFFFFFF & extended_can_id) << 3) | 1);
+}
+
 // Maybe store this in a temporary?
 uint32_t ID::formatted_can_id() const
 {
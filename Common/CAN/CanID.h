@@ -19,6 +19,12 @@ public:
 
     uint32_t formatted_can_id() const;
 
+    // Real CAN buses only have 29 bits of extended id, and the bottom
+    // 3 bits of formatted_can_id() never change, so we drop them.
+    // Does not include the EFF flag, that's up to the CAN driver.
+    uint32_t extended_can_id() const { return formatted_can_id() >> 3; }
+    static ID from_extended_can_id(uint32_t extended_can_id);
+
     uint16_t from_id { 0 };
     uint16_t to_id { 0 };
     uint8_t priority { CAN::Priority::NORMAL };
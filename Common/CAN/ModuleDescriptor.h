@@ -0,0 +1,382 @@
+#pragma once
+
+#include <CanConstants.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A module's configuration, in a compact binary format. Modules send it
+// in a REPLY_UPDATE_INFO_BINARY, when the UPDATE_INFO asking for it says
+// the MCM understands its version, otherwise they send their JSON configuration.
+
+// Format, every number is a single byte:
+// version
+// Then any number of fields, each one a tag, a length, and length bytes of value.
+//   TYPE:        TypeFlags
+//   NAME:        text, without a null terminator
+//   DESCRIPTION: text
+//   COMMAND:     command_id, the primitive it returns, then its name as text
+// A reader skips any field with a tag it doesn't know, so fields can be
+// added without a new version, changing an existing one needs a new version.
+
+// Descriptors are built at compile time, with module() and command():
+// const auto DESCRIPTOR PROGMEM = ModuleDescriptor::module(ModuleDescriptor::TypeFlags::READER, "Name", "Description",
+//     ModuleDescriptor::command(1, CAN::Primitive::FLOAT_4_BYTES, "Read Something"));
+
+namespace ModuleDescriptor {
+
+const uint8_t VERSION = 1;
+
+namespace Tag {
+
+const uint8_t TYPE = 1;
+const uint8_t NAME = 2;
+const uint8_t DESCRIPTION = 3;
+const uint8_t COMMAND = 4;
+
+} // namespace Tag
+
+namespace TypeFlags {
+
+const uint8_t READER = 1 << 0;
+const uint8_t WRITER = 1 << 1;
+
+} // namespace TypeFlags
+
+template<size_t Size>
+struct Bytes {
+    uint8_t data[Size];
+
+    static constexpr size_t size() { return Size; }
+};
+
+namespace Detail {
+
+template<size_t... I>
+struct Indices { };
+
+template<size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> { };
+
+template<size_t... I>
+struct MakeIndices<0, I...> {
+    typedef Indices<I...> Type;
+};
+
+template<size_t... Sizes>
+struct Sum;
+
+template<>
+struct Sum<> {
+    static constexpr size_t value = 0;
+};
+
+template<size_t First, size_t... Rest>
+struct Sum<First, Rest...> {
+    static constexpr size_t value = First + Sum<Rest...>::value;
+};
+
+template<size_t A, size_t B, size_t... I>
+constexpr Bytes<A + B> concat(const Bytes<A>& a, const Bytes<B>& b, Indices<I...>)
+{
+    return { { ((I < A) ? a.data[I] : b.data[I - A])... } };
+}
+
+template<size_t A>
+constexpr Bytes<A> concat_all(const Bytes<A>& a)
+{
+    return a;
+}
+
+template<size_t A, size_t B, size_t... Rest>
+constexpr Bytes<Sum<A, B, Rest...>::value> concat_all(const Bytes<A>& a, const Bytes<B>& b, const Bytes<Rest>&... rest)
+{
+    return concat_all(concat(a, b, typename MakeIndices<A + B>::Type()), rest...);
+}
+
+// Text is N - 1 characters, since N counts the null terminator.
+template<size_t N, size_t... I>
+constexpr Bytes<N + 1> text_field(uint8_t tag, const char (&text)[N], Indices<I...>)
+{
+    static_assert(N - 1 <= 255, "Descriptor text can't be longer than 255 characters");
+    return { { tag, static_cast<uint8_t>(N - 1), static_cast<uint8_t>(text[I])... } };
+}
+
+template<size_t N, size_t... I>
+constexpr Bytes<N + 3> command_field(uint8_t command_id, uint8_t return_primitive, const char (&name)[N], Indices<I...>)
+{
+    static_assert(N - 1 + 2 <= 255, "Command names can't be longer than 253 characters");
+    return { { Tag::COMMAND, static_cast<uint8_t>(N - 1 + 2), command_id, return_primitive, static_cast<uint8_t>(name[I])... } };
+}
+
+} // namespace Detail
+
+template<size_t N>
+constexpr Bytes<N + 3> command(uint8_t command_id, uint8_t return_primitive, const char (&name)[N])
+{
+    return Detail::command_field(command_id, return_primitive, name, typename Detail::MakeIndices<N - 1>::Type());
+}
+
+template<size_t NameSize, size_t DescriptionSize, size_t... CommandSizes>
+constexpr Bytes<1 + 3 + (NameSize + 1) + (DescriptionSize + 1) + Detail::Sum<CommandSizes...>::value>
+module(uint8_t type_flags, const char (&name)[NameSize], const char (&description)[DescriptionSize], const Bytes<CommandSizes>&... commands)
+{
+    return Detail::concat_all(
+        Bytes<1> { { VERSION } },
+        Bytes<3> { { Tag::TYPE, 1, type_flags } },
+        Detail::text_field(Tag::NAME, name, typename Detail::MakeIndices<NameSize - 1>::Type()),
+        Detail::text_field(Tag::DESCRIPTION, description, typename Detail::MakeIndices<DescriptionSize - 1>::Type()),
+        commands...);
+}
+
+namespace Detail {
+
+// What matches_config() needs, all of it works in C++11's constexpr, where a function is a single
+// return. Searches split what they search in half, rather than going a character at a time, since
+// a configuration is longer than the compiler lets constexpr calls nest.
+
+const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+constexpr size_t first_found(size_t a, size_t b)
+{
+    return a != NOT_FOUND ? a : b;
+}
+
+constexpr char lowercase(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// text is null terminated, and is compared ignoring case if ignore_case is set, with text in lowercase.
+constexpr bool text_at(const char* config, size_t size, size_t at, const char* text, bool ignore_case = false)
+{
+    return *text == '\0' || (at < size && (ignore_case ? lowercase(config[at]) : config[at]) == *text && text_at(config, size, at + 1, text + 1, ignore_case));
+}
+
+// Text from a descriptor, which isn't null terminated, in quotes.
+constexpr bool bytes_at(const char* config, size_t size, size_t at, const uint8_t* bytes, size_t count)
+{
+    return count == 0 || (at < size && static_cast<uint8_t>(config[at]) == *bytes && bytes_at(config, size, at + 1, bytes + 1, count - 1));
+}
+
+constexpr bool quoted_at(const char* config, size_t size, size_t at, const uint8_t* bytes, size_t count)
+{
+    return text_at(config, size, at, "\"") && bytes_at(config, size, at + 1, bytes, count) && text_at(config, size, at + 1 + count, "\"");
+}
+
+// The first place text is in config[from..to), or NOT_FOUND.
+constexpr size_t find_text(const char* config, size_t size, const char* text, size_t from, size_t to)
+{
+    return from >= to       ? NOT_FOUND
+        : (to - from == 1) ? (text_at(config, size, from, text) ? from : NOT_FOUND)
+                           : first_found(find_text(config, size, text, from, from + (to - from) / 2), find_text(config, size, text, from + (to - from) / 2, to));
+}
+
+constexpr size_t find_quoted(const char* config, size_t size, const uint8_t* bytes, size_t count, size_t from, size_t to)
+{
+    return from >= to       ? NOT_FOUND
+        : (to - from == 1) ? (quoted_at(config, size, from, bytes, count) ? from : NOT_FOUND)
+                           : first_found(find_quoted(config, size, bytes, count, from, from + (to - from) / 2), find_quoted(config, size, bytes, count, from + (to - from) / 2, to));
+}
+
+constexpr size_t count_text(const char* config, size_t size, const char* text, size_t from, size_t to)
+{
+    return from >= to       ? 0
+        : (to - from == 1) ? (text_at(config, size, from, text) ? 1 : 0)
+                           : count_text(config, size, text, from, from + (to - from) / 2) + count_text(config, size, text, from + (to - from) / 2, to);
+}
+
+constexpr size_t skip_separator(const char* config, size_t size, size_t at)
+{
+    return (at < size && (config[at] == ' ' || config[at] == ':' || config[at] == '\n' || config[at] == '\r' || config[at] == '\t')) ? skip_separator(config, size, at + 1) : at;
+}
+
+// Where the value of the first key at, or after, from starts, key is in quotes. size if there's no such key.
+constexpr size_t value_after(const char* config, size_t size, const char* key, size_t key_size, size_t from)
+{
+    return find_text(config, size, key, from, size) == NOT_FOUND ? size : skip_separator(config, size, find_text(config, size, key, from, size) + key_size);
+}
+
+constexpr uint32_t number_at(const char* config, size_t size, size_t at, uint32_t value = 0)
+{
+    return (at < size && config[at] >= '0' && config[at] <= '9') ? number_at(config, size, at + 1, value * 10 + (config[at] - '0')) : value;
+}
+
+// A command's CommandID is the first one after its CommandName, like in every configuration.
+constexpr bool command_matches_config(const uint8_t* value, uint8_t length, const char* config, size_t size)
+{
+    return find_quoted(config, size, &value[2], length - 2, 0, size) != NOT_FOUND
+        && value_after(config, size, "\"CommandID\"", 11, find_quoted(config, size, &value[2], length - 2, 0, size)) < size
+        && number_at(config, size, value_after(config, size, "\"CommandID\"", 11, find_quoted(config, size, &value[2], length - 2, 0, size))) == value[0];
+}
+
+constexpr bool field_matches_config(uint8_t tag, const uint8_t* value, uint8_t length, const char* config, size_t size)
+{
+    return tag == Tag::TYPE  ? text_at(config, size, value_after(config, size, "\"Type\"", 6, 0), (value[0] & TypeFlags::WRITER) ? "\"writer\"" : "\"reader\"", true)
+        : tag == Tag::NAME    ? quoted_at(config, size, value_after(config, size, "\"Name\"", 6, 0), value, length)
+        : tag == Tag::COMMAND ? command_matches_config(value, length, config, size)
+                              : true;
+}
+
+constexpr bool fields_match_config(const uint8_t* descriptor, size_t descriptor_size, size_t offset, const char* config, size_t size)
+{
+    return offset >= descriptor_size
+        || (field_matches_config(descriptor[offset], &descriptor[offset + 2], descriptor[offset + 1], config, size)
+            && fields_match_config(descriptor, descriptor_size, offset + 2 + descriptor[offset + 1], config, size));
+}
+
+constexpr size_t count_commands(const uint8_t* descriptor, size_t descriptor_size, size_t offset)
+{
+    return offset >= descriptor_size ? 0 : (descriptor[offset] == Tag::COMMAND) + count_commands(descriptor, descriptor_size, offset + 2 + descriptor[offset + 1]);
+}
+
+} // namespace Detail
+
+// If a module's JSON configuration has the descriptor's type, name, and every one
+// of its commands, with the same ids, and no others. Modules check it at compile time,
+// so the two can't drift apart, both need to be constexpr:
+// static_assert(ModuleDescriptor::matches_config(DESCRIPTOR, CONFIG), "...");
+template<size_t Size, size_t N>
+constexpr bool matches_config(const Bytes<Size>& descriptor, const char (&config)[N])
+{
+    return Detail::fields_match_config(descriptor.data, Size, 1, config, N - 1)
+        && Detail::count_commands(descriptor.data, Size, 1) == Detail::count_text(config, N - 1, "\"CommandID\"", 0, N - 1);
+}
+
+// Text inside a descriptor, it's not null terminated.
+struct Text {
+    const char* data;
+    uint8_t size;
+};
+
+struct Command {
+    uint8_t command_id;
+    uint8_t return_primitive;
+    Text name;
+};
+
+// Reads a descriptor in place, nothing is copied, or allocated,
+// so the bytes have to outlive the Reader, and every Text it hands out.
+class Reader {
+public:
+    // Returns false if it's not a version we understand, or any field runs
+    // past the end, in which case nothing else should be read from it.
+    bool parse(const uint8_t data[], uint16_t size)
+    {
+        m_data = data;
+        m_size = size;
+        m_command_offset = 1;
+
+        type_flags = TypeFlags::READER;
+        name = { nullptr, 0 };
+        description = { nullptr, 0 };
+
+        if (size < 1 || data[0] != VERSION) {
+            return false;
+        }
+
+        bool has_name = false;
+        for (uint16_t offset = 1; offset < size; offset += 2 + data[offset + 1]) {
+            if (offset + 2 > size || offset + 2 + data[offset + 1] > size) {
+                return false;
+            }
+
+            const uint8_t tag = data[offset];
+            const uint8_t length = data[offset + 1];
+            const uint8_t* value = &data[offset + 2];
+
+            if (tag == Tag::TYPE && length >= 1) {
+                type_flags = value[0];
+            } else if (tag == Tag::NAME) {
+                name = { reinterpret_cast<const char*>(value), length };
+                has_name = true;
+            } else if (tag == Tag::DESCRIPTION) {
+                description = { reinterpret_cast<const char*>(value), length };
+            } else if (tag == Tag::COMMAND && length < 2) {
+                return false;
+            }
+        }
+
+        return has_name;
+    }
+
+    // Returns false once there are no more commands, only valid after parse() returns true.
+    bool next_command(Command* command)
+    {
+        while (m_command_offset < m_size) {
+            const uint8_t tag = m_data[m_command_offset];
+            const uint8_t length = m_data[m_command_offset + 1];
+            const uint8_t* value = &m_data[m_command_offset + 2];
+
+            m_command_offset += 2 + length;
+
+            if (tag == Tag::COMMAND) {
+                command->command_id = value[0];
+                command->return_primitive = value[1];
+                command->name = { reinterpret_cast<const char*>(&value[2]), static_cast<uint8_t>(length - 2) };
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint8_t type_flags { TypeFlags::READER };
+    Text name { nullptr, 0 };
+    Text description { nullptr, 0 };
+
+private:
+    const uint8_t* m_data { nullptr };
+    uint16_t m_size { 0 };
+    uint16_t m_command_offset { 1 };
+};
+
+// A short hash of a whole descriptor (32 bit FNV-1a). Modules send it in their CHECK_IN,
+// so the MCM only asks for their descriptor when it's not the one it already has.
+// Modules hash it a byte at a time with hash_byte(), since theirs is in PROGMEM.
+const uint32_t HASH_SEED = 2166136261u;
+
+inline uint32_t hash_byte(uint32_t hash, uint8_t byte)
+{
+    return (hash ^ byte) * 16777619u;
+}
+
+inline uint32_t hash(const uint8_t data[], uint16_t size)
+{
+    uint32_t result = HASH_SEED;
+    for (uint16_t i = 0; i < size; i += 1) {
+        result = hash_byte(result, data[i]);
+    }
+    return result;
+}
+
+// What a command's ReturnFormat would be in a JSON configuration.
+inline const char* return_format_for(uint8_t primitive)
+{
+    switch (primitive) {
+    case CAN::Primitive::UNSIGNED_1_BYTES:
+        return "uint8";
+    case CAN::Primitive::UNSIGNED_2_BYTES:
+        return "uint16";
+    case CAN::Primitive::UNSIGNED_4_BYTES:
+        return "uint32";
+    case CAN::Primitive::UNSIGNED_8_BYTES:
+        return "uint64";
+    case CAN::Primitive::SIGNED_1_BYTES:
+        return "int8";
+    case CAN::Primitive::SIGNED_2_BYTES:
+        return "int16";
+    case CAN::Primitive::SIGNED_4_BYTES:
+        return "int32";
+    case CAN::Primitive::SIGNED_8_BYTES:
+        return "int64";
+    case CAN::Primitive::FLOAT_4_BYTES:
+        return "float";
+    case CAN::Primitive::DOUBLE_8_BYTES:
+        return "double";
+    case CAN::Primitive::BOOL_1_BYTES:
+        return "bool";
+    default:
+        return "-";
+    }
+}
+
+} // namespace ModuleDescriptor
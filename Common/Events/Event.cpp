@@ -1,6 +1,8 @@
 #include "Event.h"
 
 #ifdef CANRED
+#    include <ModuleRegistry.h>
+
 void Event::set_condition(const std::string& value)
 {
     conditional = to_conditional(value);
@@ -11,17 +13,24 @@ void Event::set_interval_unit(const std::string& value)
     interval_unit = to_interval_unit(value);
 }
 
-Event Event::from_json(const nlohmann::json& json)
+Event Event::from_json(const nlohmann::json& json, const ModuleRegistry& module_registry)
 {
     // TODO: This function needs a lot more error handling!
     Event event;
 
     // Common
-    auto get_module_uid = Database::the().prepare("SELECT uid FROM can_modules WHERE name = ?");
-    const uint16_t module_uid = get_module_uid.get(json.at("module_name").get<std::string>()).column(0);
+    const std::string module_name = json.at("module_name");
+    const std::string module_function = json.at("module_function");
+
+    uint16_t module_uid = 0;
+    if (!module_registry.find_module_uid(module_name, &module_uid)) {
+        printf("Event uses an unknown module: %s\n", module_name.c_str());
+    }
 
-    auto get_module_function_id = Database::the().prepare("SELECT command_uid FROM can_module_commands WHERE module_uid = ? AND name = ?");
-    const uint8_t module_function_id = get_module_function_id.get(module_uid, json.at("module_function").get<std::string>()).column(0);
+    uint8_t module_function_id = 0;
+    if (!module_registry.find_command_uid(module_uid, module_function, &module_function_id)) {
+        printf("Event uses an unknown command: %s on %s\n", module_function.c_str(), module_name.c_str());
+    }
 
     event.module_uid = module_uid;
     event.this_function_id = module_function_id;
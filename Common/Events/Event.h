@@ -9,6 +9,7 @@
 #    include <Database.h>
 #    include <json.hpp>
 #    include <string>
+class ModuleRegistry;
 #elif defined PLATFORM_EMBEDDED
 #    include <Log.hpp>
 #else
@@ -74,7 +75,8 @@ public:
 #ifdef PLATFORM_DESKTOP
     void set_condition(const std::string& value);
     void set_interval_unit(const std::string& value);
-    static Event from_json(const nlohmann::json& json);
+    // Module and command names are looked up in module_registry.
+    static Event from_json(const nlohmann::json& json, const ModuleRegistry& module_registry);
     void print() const;
 
     uint16_t module_uid { 0 };
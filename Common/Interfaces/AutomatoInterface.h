@@ -2,6 +2,11 @@
 
 #include <CanFrame.h>
 
+#ifdef CANRED
+#    include <stddef.h>
+#    include <vector>
+#endif
+
 // TODO:
 // Interfaces can fail, and become invalid at any point in time.
 // I think implementing proper error handling for them is more
@@ -31,4 +36,37 @@ public:
     // Send the given frame, return true if the frame
     // sent properly.
     virtual bool send_frame(const CAN::Frame& frame) = 0;
+
+#ifdef CANRED
+    // CanRed picks its interfaces at runtime, and owns them through this class.
+    virtual ~AutomatoInterface() = default;
+
+    // Returns a file descriptor that becomes readable when
+    // read_frames() has something to read, or -1 if this
+    // interface cannot be polled.
+    virtual int32_t file_descriptor() const { return -1; }
+
+    // Appends every frame that can be read without blocking
+    // more than once, returns the amount of frames appended.
+    virtual size_t read_frames(std::vector<CAN::Frame>& frames)
+    {
+        CAN::Frame frame;
+        if (read_frame(&frame)) {
+            frames.push_back(frame);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Sends frame_count frames, in order, with as few writes as the
+    // interface allows. Returns the amount of frames sent.
+    virtual size_t send_frames(const CAN::Frame frames[], size_t frame_count)
+    {
+        size_t frames_sent = 0;
+        for (size_t i = 0; i < frame_count; i += 1) {
+            frames_sent += send_frame(frames[i]);
+        }
+        return frames_sent;
+    }
+#endif
 };
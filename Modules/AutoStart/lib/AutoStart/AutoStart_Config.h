@@ -1,7 +1,8 @@
+#include <ModuleDescriptor.h>
 #include <pgmspace.h>
 #include <stdint.h>
 
-const char CONFIG[] PROGMEM = R"=====(
+constexpr char CONFIG[] PROGMEM = R"=====(
 {
     "Name": "AutoStart",
     "Type": "writer",
@@ -31,3 +32,14 @@ const char CONFIG[] PROGMEM = R"=====(
     ]
 }
 )=====";
+
+// The same configuration, for an MCM that understands descriptors.
+constexpr auto DESCRIPTOR PROGMEM = ModuleDescriptor::module(ModuleDescriptor::TypeFlags::WRITER,
+    "AutoStart",
+    "Controls all of the functions of a car remote!",
+    ModuleDescriptor::command(1, CAN::Primitive::VOID, "Lock The Doors"),
+    ModuleDescriptor::command(2, CAN::Primitive::VOID, "Unlock The Doors"),
+    ModuleDescriptor::command(3, CAN::Primitive::VOID, "Start The Car"),
+    ModuleDescriptor::command(4, CAN::Primitive::VOID, "Blink the Light"));
+
+static_assert(ModuleDescriptor::matches_config(DESCRIPTOR, CONFIG), "DESCRIPTOR and CONFIG have to have the same type, name, and commands");
@@ -47,6 +47,7 @@ void setup()
     automato.register_callback(3, StartTheCar);
     automato.register_callback(4, BlinkTheLight);
 
+    automato.set_descriptor(DESCRIPTOR);
     automato.add_interface(&can_interface);
 
     automato.setup();
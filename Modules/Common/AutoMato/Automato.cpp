@@ -124,8 +124,10 @@ void Automato::parse_frame(uint16_t from_id, const uint8_t data[], uint16_t can_
 
     case CAN::Protocol::COMMAND: {
         // We're told to run a command!
+        // A third byte is the sequence number, which we have to send back with the reply.
 
-        external_run_command(from_id, data[1], nullptr);
+        const bool is_sequenced = can_dlc >= 3;
+        external_run_command(from_id, data[1], nullptr, is_sequenced, is_sequenced ? data[2] : 0);
         break;
     }
 
@@ -141,7 +143,13 @@ void Automato::parse_frame(uint16_t from_id, const uint8_t data[], uint16_t can_
     }
 
     case CAN::Protocol::UPDATE_INFO: {
-        send_stored_configuration();
+        // The MCM tells us the newest descriptor version it understands,
+        // older ones don't, and only understand JSON.
+        if (m_descriptor && can_dlc >= 2 && data[1] >= pgm_read_byte(&m_descriptor[0])) {
+            send_stored_descriptor();
+        } else {
+            send_stored_configuration();
+        }
         break;
     }
 
@@ -282,17 +290,72 @@ void Automato::send_stored_configuration()
     m_CAN_is_locked = false;
 }
 
+void Automato::send_stored_descriptor()
+{
+    YIELD_IF_NEEDED();
+
+    DEBUG_PRINTLN("Sending stored descriptor!");
+    m_CAN_is_locked = true;
+
+    CAN::ID id(interfacer.current_node_uid(), CAN::UID::MCM, CAN::Priority::MEDIUM, CAN::FrameFormat::Long);
+    CAN::Frame frame(id, nullptr, 8);
+
+    frame.data[0] = CAN::Frame::get_long_frame_uid();
+
+    // The protocol specifier, then the descriptor, 7 bytes to a frame.
+    const uint16_t bytes_to_send = m_descriptor_size + 1;
+    uint8_t index = 1;
+
+    for (uint16_t bytes_sent = 0; bytes_sent < bytes_to_send; bytes_sent += 1) {
+        frame.data[index] = (bytes_sent == 0) ? CAN::Protocol::REPLY_UPDATE_INFO_BINARY : pgm_read_byte(&m_descriptor[bytes_sent - 1]);
+        index += 1;
+
+        if (index == 8) {
+            frame.can_dlc = 8;
+            interfacer.send_frame_to_every_interface(frame);
+            index = 1;
+            YIELD_IF_NEEDED();
+        }
+    }
+
+    // A group ends with a frame that isn't full, even if
+    // that leaves it with nothing but the group uid.
+    frame.can_dlc = index;
+    interfacer.send_frame_to_every_interface(frame);
+
+    DEBUG_PRINTLN("Done sending!");
+
+    m_CAN_is_locked = false;
+}
+
 void Automato::send_check_in_frame()
 {
     // This function enters a holding pattern where
     // it will send a check in frame every second
     // until the MCM replies with ACK
 
-    uint8_t buffer[1];
+    // If we have a descriptor, its hash follows, so the MCM only
+    // asks for it (with UPDATE_INFO) when it's not the one it has.
+    uint8_t buffer[5];
+    uint8_t size = 1;
     buffer[0] = CAN::Protocol::CHECK_IN;
 
+    if (m_descriptor) {
+        uint32_t hash = ModuleDescriptor::HASH_SEED;
+        for (uint16_t i = 0; i < m_descriptor_size; i += 1) {
+            hash = ModuleDescriptor::hash_byte(hash, pgm_read_byte(&m_descriptor[i]));
+        }
+
+        buffer[1] = hash >> 24;
+        buffer[2] = hash >> 16;
+        buffer[3] = hash >> 8;
+        buffer[4] = hash & 0xFF;
+        size = 5;
+    }
+
     auto time_last_sent = millis();
     const uint16_t ms_between_sends = 1000;
+    bool has_sent = false;
 
     CAN::Frame frame(CAN::ID(0), nullptr, 0);
 
@@ -301,13 +364,24 @@ void Automato::send_check_in_frame()
         auto current_time = millis();
         if (current_time > time_last_sent + ms_between_sends) {
             time_last_sent = current_time;
-            interfacer.send_buffer_to_every_interface(CAN::UID::MCM, buffer, 1, CAN::Priority::MEDIUM);
+            interfacer.send_buffer_to_every_interface(CAN::UID::MCM, buffer, size, CAN::Priority::MEDIUM);
+            // If the ACK buffer was full, the CHECK_IN isn't waiting on an ACK, and
+            // we can't tell being ACKed from never being heard, so keep sending it.
+            has_sent = interfacer.is_waiting_on_ack(CAN::UID::MCM, CAN::Protocol::CHECK_IN);
             DEBUG_PRINTLN("Screaming into the void");
         }
 
         bool did_read_frame = interfacer.try_read_frame(&frame);
 
         if (did_read_frame && frame.is_only_for_me(interfacer.current_node_uid())) {
+            // Most likely UPDATE_INFO, which we still have to answer.
+            DEBUG_PRINTLN("MCM Said we're good to go!");
+            handle_frame(frame);
+            return;
+        }
+
+        // The MCM already has our descriptor, so an ACK is all we get.
+        if (has_sent && !interfacer.is_waiting_on_ack(CAN::UID::MCM, CAN::Protocol::CHECK_IN)) {
             DEBUG_PRINTLN("MCM Said we're good to go!");
             return;
         }
@@ -490,30 +564,37 @@ uint8_t Automato::run_child_event(Event event)
     return 0;
 }
 
-bool Automato::external_run_command(uint16_t from_id, uint8_t command_id, const void* function_input)
+bool Automato::external_run_command(uint16_t from_id, uint8_t command_id, const void* function_input, bool is_sequenced /* false */, uint8_t sequence /* 0 */)
 {
     auto function_output = command_handler.run(command_id);
 
-    if (function_output.get_type() == TypeUsed::NOT_SET) {
-        // Theres nothing to return.
-        uint8_t buffer[2];
+    // Sequenced replies have the sequence right after the command_id.
+    uint8_t buffer[13];
+    uint8_t header_size = 0;
+
+    if (is_sequenced) {
+        buffer[0] = CAN::Protocol::REPLY_COMMAND_SEQUENCED;
+        buffer[1] = command_id;
+        buffer[2] = sequence;
+        header_size = 3;
+    } else {
         buffer[0] = CAN::Protocol::REPLY_COMMAND;
         buffer[1] = command_id;
+        header_size = 2;
+    }
 
-        interfacer.send_buffer_to_every_interface(from_id, buffer, 2);
+    if (function_output.get_type() == TypeUsed::NOT_SET) {
+        // Theres nothing to return.
+        interfacer.send_buffer_to_every_interface(from_id, buffer, header_size);
         return true;
     }
 
     // There is something to return
-    uint8_t buffer[12];
-
-    buffer[0] = CAN::Protocol::REPLY_COMMAND;
-    buffer[1] = command_id;
-    buffer[2] = function_output.to_can_primitive();
+    buffer[header_size] = function_output.to_can_primitive();
 
-    uint8_t bytes_needed = function_output.serialize(&buffer[3]);
+    uint8_t bytes_needed = function_output.serialize(&buffer[header_size + 1]);
 
-    interfacer.send_buffer_to_every_interface(from_id, buffer, bytes_needed + 3);
+    interfacer.send_buffer_to_every_interface(from_id, buffer, bytes_needed + header_size + 1);
 
     return true;
 }
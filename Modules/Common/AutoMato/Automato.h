@@ -24,6 +24,7 @@
 #include <FilesystemInterface.h>
 #include <InterfaceHandler.h>
 #include <LongFrameHandler.h>
+#include <ModuleDescriptor.h>
 #include <stdint.h>
 
 // TODO: Not sure if sharing this libary is the best idea
@@ -50,6 +51,15 @@ public:
     void dont_use_builtin_led() { m_use_builtin_led = false; }
     void register_callback(uint8_t command_id, const CommandFunction& function);
 
+    // Sent instead of the JSON configuration, to an MCM that understands it.
+    // The descriptor has to be in PROGMEM, and outlive us.
+    template<size_t Size>
+    void set_descriptor(const ModuleDescriptor::Bytes<Size>& descriptor)
+    {
+        m_descriptor = descriptor.data;
+        m_descriptor_size = Size;
+    }
+
     // Advanced functions
     void add_interface(AutomatoInterface* interface);
     void translate_between_interfaces(AutomatoInterface* interface1, AutomatoInterface* interface2, TranslationMode mode);
@@ -67,11 +77,15 @@ private:
     void ask_for_new_id();
     void send_check_in_frame();
     void send_stored_configuration();
+    void send_stored_descriptor();
     void send_stored_events();
 
     // Config File
     const char* m_config_file;
 
+    const uint8_t* m_descriptor { nullptr };
+    uint16_t m_descriptor_size { 0 };
+
     // Filesystem interface
     FilesystemInterface* m_filesystem { nullptr };
 
@@ -80,7 +94,8 @@ private:
 
     // Command Functions
     CommandHandler command_handler;
-    bool external_run_command(uint16_t from_id, uint8_t command_id, const void* input_data);
+    // When is_sequenced, the reply is a REPLY_COMMAND_SEQUENCED carrying sequence.
+    bool external_run_command(uint16_t from_id, uint8_t command_id, const void* input_data, bool is_sequenced = false, uint8_t sequence = 0);
 
     // Broadcast Events
     // TODO: This is in a state of flux.
@@ -5,7 +5,7 @@
 InterfaceHandler::InterfaceHandler()
 {
     // Mark every slot in the ACK buffer as available for writing
-    memset(m_ack_buffer, 0, MAX_ACK_BUFFERS);
+    memset(m_ack_buffer, 0, sizeof(m_ack_buffer));
 }
 
 bool InterfaceHandler::try_read_frame(CAN::Frame* frame)
@@ -38,10 +38,13 @@ bool InterfaceHandler::try_read_frame(CAN::Frame* frame)
         return false;
     }
 
-    if (frame->data[0] == CAN::Protocol::ACKNOWLEDGEMENT) {
+    if (!frame->is_long_frame && frame->data[0] == CAN::Protocol::ACKNOWLEDGEMENT) {
         // We read a frame that's just an ACK, no need to do
         // any further parsing on it.
-        remove_waiting_on_ack(frame->from_id, frame->data[1]);
+        // CanRed packs up to 7 ACKs for us into a single frame.
+        for (uint8_t i = 1; i < frame->can_dlc; i += 1) {
+            remove_waiting_on_ack(frame->from_id, frame->data[i]);
+        }
         return false;
     }
 
@@ -146,7 +149,9 @@ void InterfaceHandler::send_frame_to_every_interface(const CAN::Frame& frame)
     if (frame[0] != CAN::Protocol::ACKNOWLEDGEMENT && !frame.is_for_everyone()) {
         // In Long Frames, the first byte we send is the frame uid
         // and the second is the command byte.
-        add_waiting_on_ack(frame.to_id, frame[frame.is_long_frame]);
+        if (!add_waiting_on_ack(frame.to_id, frame[frame.is_long_frame])) {
+            DEBUG_PRINTLN("ACK buffer is full, not waiting on an ACK for this frame!");
+        }
     }
 
     for (uint8_t i = 0; i < m_interfaces_index; i += 1) {
@@ -163,18 +168,40 @@ void InterfaceHandler::send_error_frame(uint16_t to_id, uint8_t which_error)
     send_buffer_to_every_interface(to_id, buffer, 2, CAN::Priority::IMPORTANT);
 }
 
-void InterfaceHandler::add_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
+bool InterfaceHandler::is_waiting_on_ack(uint16_t module_uid, uint8_t command_id) const
 {
+    uint32_t packed = ((static_cast<uint32_t>(module_uid) << 16) | command_id);
+    for (uint8_t i = 0; i < MAX_ACK_BUFFERS * 2; i += 2) {
+        if (m_ack_buffer[i] == packed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InterfaceHandler::add_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
+{
+    // Sending the same thing again (CHECK_IN does, until it's ACKed)
+    // shouldn't take another slot, one ACK covers both.
+    uint32_t packed = ((static_cast<uint32_t>(module_uid) << 16) | command_id);
+    for (uint8_t i = 0; i < MAX_ACK_BUFFERS * 2; i += 2) {
+        if (m_ack_buffer[i] == packed) {
+            m_ack_buffer[i + 1] = millis();
+            return true;
+        }
+    }
+
     // Find the first empty slot in the ack buffer
     for (uint8_t i = 0; i < MAX_ACK_BUFFERS * 2; i += 2) {
         if (m_ack_buffer[i] == 0) {
             // this is an empty slot!
-            uint32_t packed = ((static_cast<uint32_t>(module_uid) << 16) | command_id);
             m_ack_buffer[i] = packed;
-            m_ack_buffer[i + 2] = millis();
-            return;
+            m_ack_buffer[i + 1] = millis();
+            return true;
         }
     }
+
+    return false;
 }
 
 void InterfaceHandler::remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id)
@@ -35,13 +35,17 @@ public:
     void send_frame_to_every_interface(const CAN::Frame& frame);
     void send_error_frame(uint16_t to_id, uint8_t which_error);
 
+    // If we've sent module_uid command_id, and it hasn't ACKed it yet.
+    bool is_waiting_on_ack(uint16_t module_uid, uint8_t command_id) const;
+
     // UID
     void set_current_node_uid(uint16_t new_uid) { m_current_node_uid = new_uid; }
     uint16_t current_node_uid() { return m_current_node_uid; }
 
 private:
     // ACK
-    void add_waiting_on_ack(uint16_t module_uid, uint8_t command_id);
+    // Returns false if every slot is taken, in which case nothing is waiting on the ACK.
+    bool add_waiting_on_ack(uint16_t module_uid, uint8_t command_id);
     void remove_waiting_on_ack(uint16_t module_uid, uint8_t command_id);
     void send_ack(uint16_t module_uid, uint8_t command_id);
     void check_for_old_acks(uint64_t current_time);
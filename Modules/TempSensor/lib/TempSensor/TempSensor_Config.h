@@ -1,7 +1,8 @@
+#include <ModuleDescriptor.h>
 #include <pgmspace.h>
 #include <stdint.h>
 
-const char CONFIG[] PROGMEM = R"=====(
+constexpr char CONFIG[] PROGMEM = R"=====(
 {
     "Name": "TempSensor",
     "Type": "reader",
@@ -25,3 +26,13 @@ const char CONFIG[] PROGMEM = R"=====(
     ]
 }
 )=====";
+
+// The same configuration, for an MCM that understands descriptors.
+constexpr auto DESCRIPTOR PROGMEM = ModuleDescriptor::module(ModuleDescriptor::TypeFlags::READER,
+    "TempSensor",
+    "Reads the temperature and humidity",
+    ModuleDescriptor::command(1, CAN::Primitive::FLOAT_4_BYTES, "Read Humidity"),
+    ModuleDescriptor::command(2, CAN::Primitive::FLOAT_4_BYTES, "Read Temperature in Fahrenheit"),
+    ModuleDescriptor::command(3, CAN::Primitive::FLOAT_4_BYTES, "Read Temperature in Celsius"));
+
+static_assert(ModuleDescriptor::matches_config(DESCRIPTOR, CONFIG), "DESCRIPTOR and CONFIG have to have the same type, name, and commands");
@@ -36,6 +36,7 @@ void setup()
     automato.register_callback(2, ReadTemperatureFahrenheit);
     automato.register_callback(2, ReadTemperatureCelsius);
 
+    automato.set_descriptor(DESCRIPTOR);
     automato.add_interface(&can_interface);
 
     automato.setup();